@@ -1,33 +1,63 @@
 import os
 
-from setuptools import setup
-from setuptools.extension import Library
-from distutils.command.build_ext import build_ext as _build_ext
+from setuptools import setup, Command, Extension
+from distutils.ccompiler import new_compiler
+from distutils.sysconfig import customize_compiler
 
 
 BASE_DIR = os.path.dirname(os.path.realpath(__file__))
 
 
-class CTypesLibrary(Library): pass
+# Messages of the C library below this level are compiled out: 0 debug, 1 info (default), 2 warn, 3 error, 4 none
+LOG_COMPILE_LEVEL = os.environ.get('AFALIGNER_LOG_COMPILE_LEVEL')
 
+C_MODULES_DIR = 'src/afaligner/c_modules'
 
-class build_ext(_build_ext):
+DTWBD_SOURCES = [
+    os.path.join(C_MODULES_DIR, name) for name in [
+        'dtwbd.c', 'band_matrix.c', 'workspace.c', 'linear_dtwbd.c', 'distance.c', 'dtwbd_f32.c',
+        'diagonal_dtwbd.c', 'wavefront_dtwbd.c', 'dtwbd_stats.c', 'aligner.c', 'streaming_dtwbd.c',
+        'dtwbd_pyramid.c', 'mfcc.c', 'logger.c',
+    ]
+]
+
+DTWBD_MACROS = [('BUILDING_FASTDTWBD', '1')] + \
+               ([('LOG_COMPILE_LEVEL', LOG_COMPILE_LEVEL)] if LOG_COMPILE_LEVEL else [])
+
+DTWBD_LIBRARIES = [] if os.name == 'nt' else ['pthread']
+
+
+class build_benchmark(Command):
     """
-    Since compiled C code imported as shared library using ctypes, it is neccessary to know its name.
-    Therefore, get_ext_filename is overridden to return platform-independent name.
-    See https://stackoverflow.com/questions/4529555/building-a-ctypes-based-c-library-with-distutils
+    Builds the standalone benchmark of the C functions, dtwbd_benchmark, next to the dtwbd extension.
+    Run it with --help to see the options.
     """
-    def build_extension(self, ext):
-        self._ctypes = isinstance(ext, CTypesLibrary)
-        return super().build_extension(ext)
+    description = 'build the native benchmark of the DTWBD functions'
+    user_options = [
+        ('build-temp=', 't', 'directory for the object files'),
+    ]
+
+    def initialize_options(self):
+        self.build_temp = None
+
+    def finalize_options(self):
+        if self.build_temp is None:
+            self.build_temp = os.path.join('build', 'benchmark')
 
-    def get_ext_filename(self, ext_name):
-        # If you are going to use setuptools' build_ext:
-        # setuptools' build_ext calls get_ext_filename() once before build_extension():
-        # It's in finalize_options(), and the name doesn't seem to matter.
-        if getattr(self, '_ctypes', False):
-            return os.path.join(*ext_name.split('.')) + '.so'
-        return super().get_ext_filename(ext_name)
+    def run(self):
+        compiler = new_compiler()
+        customize_compiler(compiler)
+        objects = compiler.compile(
+            DTWBD_SOURCES + [os.path.join(C_MODULES_DIR, 'benchmark.c')],
+            output_dir=self.build_temp,
+            macros=DTWBD_MACROS,
+            extra_postargs=[] if os.name == 'nt' else ['-O2'],
+        )
+        compiler.link_executable(
+            objects, 'dtwbd_benchmark',
+            output_dir=C_MODULES_DIR,
+            libraries=DTWBD_LIBRARIES + ([] if os.name == 'nt' else ['m']),
+        )
 
 
 with open(os.path.join(BASE_DIR, 'README.md'), 'r') as f:
@@ -60,10 +90,11 @@ setup(
         'py3-aeneas',
         'Jinja2>=3.1.2',
     ],
-    ext_modules=[CTypesLibrary(
+    ext_modules=[Extension(
         'afaligner.c_modules.dtwbd',
-        sources=['src/afaligner/c_modules/dtwbd.c', 'src/afaligner/c_modules/sparse_matrix.c', 'src/afaligner/c_modules/logger.c'],
-        define_macros=[('BUILDING_FASTDTWBD', '1')]  # Define BUILDING_DTWBD for exporting symbols
+        sources=DTWBD_SOURCES + [os.path.join(C_MODULES_DIR, 'dtwbd_module.c')],
+        define_macros=DTWBD_MACROS,  # BUILDING_FASTDTWBD exports the symbols
+        libraries=DTWBD_LIBRARIES,
     )],
-    cmdclass={'build_ext': build_ext}
+    cmdclass={'build_benchmark': build_benchmark}
 )
@@ -3,27 +3,63 @@ import json
 import math
 import os.path
 import shutil
-import subprocess
+from concurrent.futures import ThreadPoolExecutor
+from contextlib import closing, ExitStack
+from functools import partial
 
-from aeneas.audiofilemfcc import AudioFileMFCC
 from aeneas.language import Language
 from aeneas.synthesizer import Synthesizer
-from aeneas.textfile import TextFile, TextFileFormat
-from aeneas.exacttiming import TimeValue
 import numpy as np
 import jinja2
 
-from afaligner.c_dtwbd_wrapper import c_FastDTWBD
+from afaligner.audio import decode_audio_mfcc
+from afaligner.c_dtwbd_wrapper import Aligner, Pyramid
+from afaligner.feature_cache import FeatureCache
+from afaligner.pipeline import prefetch
+from afaligner.synthesis import (
+    SYNTHESIS_PARAMETERS, start_synthesizer_pool, synthesize_in_worker, synthesize_text, text_content,
+)
 
 BASE_DIR = os.path.dirname(os.path.realpath(__file__))
 
+# Parameters of the audio features, part of the keys of the feature cache
+MFCC_PARAMETERS = {
+    'extractor': 'afaligner.decode_audio_mfcc',
+    'sample_rate': 16000,
+    'window_length': 0.100,
+    'window_shift': 0.040,
+    'drop_coefficients': [0],
+}
+
+# Part of the text a path must span to be trusted: its audio rate seeds the next windows,
+# a windowed path spanning less is redone on the whole audio tail
+MIN_TEXT_COVERAGE = 0.5
+
+# The audio window is never smaller than this part of the audio tail
+MIN_AUDIO_WINDOW_FRACTION = 0.125
+
+# A windowed path costing more than this part of leaving all the frames unmatched is a forced match,
+# the true one may be past the window
+WEAK_MATCH_RATIO = 0.9
+
 
 def align(
         text_dir, audio_dir, output_dir=None, output_format='smil',
         sync_map_text_path_prefix='', sync_map_audio_path_prefix='',
         skip_penalty=None, radius=None,
         times_as_timedelta=False, language=Language.ENG,
+        cache_dir=None, cache_size=None, pipeline_depth=1, synthesis_workers=1,
+        tail_window=False,
 ):
+    """
+    `cache_dir` keeps the MFCC features of the audio files and of the synthesized texts between calls
+    (see FeatureCache), `cache_size` limits its size in bytes.
+    `pipeline_depth` text and audio files are prepared ahead while the current pair is aligned,
+    `synthesis_workers` processes synthesize the texts.
+    `tail_window=True` aligns every text against the part of the audio tail it can cover at the pace
+    of the previous alignment first, which is faster on long audio files but not guaranteed to give
+    the same sync map as aligning against the whole tail.
+    """
 
     print("Using bhattarai333's branch of afaligner")
     #import time;time.sleep(10000)
@@ -52,6 +88,10 @@ def align(
         radius=radius,
         times_as_timedelta=times_as_timedelta,
         language=language,
+        feature_cache=FeatureCache(cache_dir, cache_size) if cache_dir is not None else None,
+        pipeline_depth=pipeline_depth,
+        synthesis_workers=synthesis_workers,
+        tail_window=tail_window,
     )
 
     if output_dir is not None:
@@ -71,11 +111,111 @@ def build_sync_map(
         skip_penalty, radius,
         times_as_timedelta,
         language,
+        feature_cache=None,
+        pipeline_depth=1,
+        synthesis_workers=1,
+        tail_window=False,
 ):
+    """
+    Synthesis and features of the next `pipeline_depth` text and audio files are computed on worker threads
+    while the current pair is aligned, `pipeline_depth=0` processes the files one after another.
+    With `synthesis_workers > 1` texts are synthesized by a pool of that many processes,
+    at least one text per worker ahead.
+    `feature_cache` keeps the features of the audio files and of the synthesized texts.
+    `tail_window` is passed to align_files().
+    """
+    # Tails are realigned many times, the aligner reuses its memory across the calls
+    # and the coarsened levels of every file are built once in a pyramid
+    aligner = Aligner()
+
+    with ExitStack() as stack:
+        if synthesis_workers > 1:
+            pool = stack.enter_context(start_synthesizer_pool(synthesis_workers))
+            synthesize = lambda text_path: pool.submit(synthesize_in_worker, text_path, tmp_dir, language).result()
+            # Threads that look up the cache and wait for the pool
+            executor = stack.enter_context(ThreadPoolExecutor(synthesis_workers))
+            text_depth = max(pipeline_depth, synthesis_workers)
+        else:
+            synthesizer = Synthesizer()
+            synthesize = partial(synthesize_text, tmp_dir=tmp_dir, language=language, synthesizer=synthesizer)
+            executor = None
+            text_depth = pipeline_depth
+
+        texts = stack.enter_context(closing(prefetch(
+            partial(prepare_text, synthesize=synthesize, radius=radius, language=language, feature_cache=feature_cache),
+            text_paths, text_depth, executor,
+        )))
+        audios = stack.enter_context(closing(prefetch(
+            partial(prepare_audio, radius=radius, feature_cache=feature_cache),
+            audio_paths, pipeline_depth,
+        )))
+        return align_files(
+            texts, audios,
+            sync_map_text_path_prefix, sync_map_audio_path_prefix,
+            skip_penalty, radius,
+            times_as_timedelta,
+            aligner,
+            tail_window,
+        )
 
 
-    synthesizer = Synthesizer()
-    parse_parameters = {'is_text_unparsed_id_regex': 'f[0-9]+'}
+def prepare_text(text_path, synthesize, radius, language, feature_cache=None):
+    """
+    Returns the name of the text file, its fragments, anchors' frames and the pyramid of its MFCC frames.
+    Texts whose fragments, language and synthesis parameters are in the feature cache are not synthesized.
+    """
+    if feature_cache is not None:
+        feature_key = feature_cache.content_key(
+            text_content(text_path, language), {**SYNTHESIS_PARAMETERS, 'language': language},
+        )
+        entry = feature_cache.get_with_metadata(feature_key)
+        if entry is not None:
+            text_pyramid, metadata = entry
+            return get_name_from_path(text_path), metadata['fragments'], np.array(metadata['anchors']), text_pyramid
+
+    text_name, fragments, anchors, text_mfcc_sequence = synthesize(text_path)
+    text_pyramid = Pyramid(text_mfcc_sequence, radius)
+    if feature_cache is not None:
+        feature_cache.put(feature_key, text_pyramid, {'fragments': fragments, 'anchors': anchors.tolist()})
+
+    return text_name, fragments, anchors, text_pyramid
+
+
+def prepare_audio(audio_path, radius, feature_cache=None):
+    """
+    Returns the name of the audio file and the pyramid of its MFCC frames, from the feature cache if it has them.
+    """
+    audio_name = get_name_from_path(audio_path)
+    audio_pyramid = None
+    if feature_cache is not None:
+        feature_key = feature_cache.key(audio_path, MFCC_PARAMETERS)
+        audio_pyramid = feature_cache.get(feature_key)
+
+    if audio_pyramid is None:
+        # Decoded through a pipe straight into the MFCC computation, no WAV is written
+        audio_mfcc_sequence = decode_audio_mfcc(audio_path)
+        audio_pyramid = Pyramid(audio_mfcc_sequence, radius)
+        if feature_cache is not None:
+            feature_cache.put(feature_key, audio_pyramid)
+
+    return audio_name, audio_pyramid
+
+
+def align_files(
+        texts, audios,
+        sync_map_text_path_prefix, sync_map_audio_path_prefix,
+        skip_penalty, radius,
+        times_as_timedelta,
+        aligner,
+        tail_window=False,
+):
+    """
+    Greedily aligns the prepared texts against the prepared audios, both in order.
+    Every text is aligned against the whole audio tail, or with `tail_window=True` first against
+    the window of get_audio_window(), redone on the whole tail when needs_whole_tail().
+    """
+    # Audio frames per text frame of the last alignment, seeds the audio window of the next one
+    audio_rate = None
 
     sync_map = {}
     process_next_text = True
@@ -84,54 +224,42 @@ def build_sync_map(
     while True:
         if process_next_text:
             try:
-                text_path = next(text_paths)
+                text_name, fragments, anchors, text_pyramid = next(texts)
             except StopIteration:
                 break
 
-            text_name = get_name_from_path(text_path)
             output_text_name = os.path.join(sync_map_text_path_prefix, text_name)
-            textfile = TextFile(text_path, file_format=TextFileFormat.UNPARSED, parameters=parse_parameters)
-            textfile.set_language(language)
-            text_wav_path = os.path.join(tmp_dir, f'{drop_extension(text_name)}_text.wav')
             sync_map[output_text_name] = {}
 
-            # Produce synthesized audio, get anchors
-            anchors, _, _ = synthesizer.synthesize(textfile, text_wav_path)
-
-            # Get fragments, convert anchors timings to the frames indicies
-            fragments = [a[1] for a in anchors]
-            anchors = np.array([int(a[0] / TimeValue('0.040')) for a in anchors])
-
-            # MFCC frames sequence memory layout is a n x l 2D array,
-            # where n - number of frames and l - number of MFFCs
-            # i.e it is c-contiguous, but after dropping the first coefficient it siezes to be c-contiguous.
-            # Should decide whether to make a copy or to work around the first coefficient.
-            text_mfcc_sequence = np.ascontiguousarray(
-                AudioFileMFCC(text_wav_path).all_mfcc.T[:, 1:]
-            )
+            # Keep track of the aligned part of the text
+            text_start_frame = 0
 
         if process_next_audio:
             try:
-                audio_path = next(audio_paths)
+                audio_name, audio_pyramid = next(audios)
             except StopIteration:
                 break
 
-            audio_name = get_name_from_path(audio_path)
             output_audio_name = os.path.join(sync_map_audio_path_prefix, audio_name)
-            audio_wav_path = os.path.join(tmp_dir, f'{drop_extension(audio_name)}_audio.wav')
-            subprocess.run(['ffmpeg', '-n', '-i', audio_path, '-rf64', 'auto', audio_wav_path])
-
-            audio_mfcc_sequence = np.ascontiguousarray(
-                AudioFileMFCC(audio_wav_path).all_mfcc.T[:, 1:]
-            )
 
             # Keep track to calculate frames timings
             audio_start_frame = 0
 
-        n = len(text_mfcc_sequence)
-        m = len(audio_mfcc_sequence)
+        n = len(text_pyramid) - text_start_frame
+        m = len(audio_pyramid) - audio_start_frame
 
-        _, path = c_FastDTWBD(text_mfcc_sequence, audio_mfcc_sequence, skip_penalty, radius=radius)
+        # With tail_window, align against the audio the text can cover at the pace of the previous alignment,
+        # the whole audio tail is only needed if the path may be cut by this window
+        window = get_audio_window(n, m, audio_rate, radius) if tail_window else m
+        path_distance, path = aligner.align_pyramid(
+            text_pyramid, audio_pyramid, skip_penalty, radius,
+            s_offset=text_start_frame, t_offset=audio_start_frame, m=window,
+        )
+        if window < m and needs_whole_tail(path_distance, path, n, window, skip_penalty, radius):
+            _, path = aligner.align_pyramid(
+                text_pyramid, audio_pyramid, skip_penalty, radius,
+                s_offset=text_start_frame, t_offset=audio_start_frame, m=m,
+            )
 
         if len(path) == 0:
             print(
@@ -146,6 +274,9 @@ def build_sync_map(
         audio_path_frames = path[:, 1]
 
         last_matched_audio_frame = audio_path_frames[-1]
+        if len(path) > 2 * radius and covers_text(path, n):
+            audio_rate = (audio_path_frames[-1] - audio_path_frames[0] + 1) / \
+                         (text_path_frames[-1] - text_path_frames[0] + 1)
 
         # Find first and last matched frames
         first_matched_text_frame = text_path_frames[0]
@@ -187,7 +318,7 @@ def build_sync_map(
         else:
             # Otherwise align tail of the current text
             process_next_text = False
-            text_mfcc_sequence = text_mfcc_sequence[last_matched_text_frame:]
+            text_start_frame += last_matched_text_frame
             fragments = fragments[map_anchors_to:]
             anchors = anchors[map_anchors_to:] - last_matched_text_frame
 
@@ -200,12 +331,44 @@ def build_sync_map(
         else:
             # Otherwise align tail of the current audio
             process_next_audio = False
-            audio_mfcc_sequence = audio_mfcc_sequence[last_matched_audio_frame:]
             audio_start_frame += last_matched_audio_frame
 
     return sync_map
 
 
+def get_audio_window(n, m, audio_rate, radius):
+    """
+    Returns the number of audio frames to align n text frames against:
+    twice the frames they span at audio_rate plus the radius on both sides, all m frames if the rate is unknown.
+    The window is at least MIN_AUDIO_WINDOW_FRACTION of the m frames, so a wrong rate cannot starve it.
+    """
+    if audio_rate is None:
+        return m
+    return min(m, max(int(2 * n * audio_rate) + 2 * radius, math.ceil(m * MIN_AUDIO_WINDOW_FRACTION)))
+
+
+def covers_text(path, n):
+    """
+    Whether the path spans at least MIN_TEXT_COVERAGE of the n text frames.
+    """
+    return path[-1, 0] - path[0, 0] + 1 >= MIN_TEXT_COVERAGE * n
+
+
+def needs_whole_tail(path_distance, path, n, window, skip_penalty, radius):
+    """
+    Whether the path of n text frames in the first `window` audio frames may differ from the path
+    in the whole audio tail: there is none, it ends within the radius of the end of the window,
+    where more audio could extend it, it leaves most of the text unmatched,
+    or it is hardly cheaper than leaving all the frames unmatched.
+    """
+    return (
+        len(path) == 0
+        or path[-1, 1] >= window - 1 - radius
+        or not covers_text(path, n)
+        or path_distance > WEAK_MATCH_RATIO * skip_penalty * (n + window)
+    )
+
+
 def get_name_from_path(path):
     return os.path.split(path)[1]
 
@@ -0,0 +1,50 @@
+import subprocess
+import tempfile
+
+import numpy as np
+
+from afaligner.c_dtwbd_wrapper import MFCCStream
+
+# ffmpeg decodes to mono 16 kHz PCM, the sample rate of aeneas' MFCC defaults
+SAMPLE_RATE = 16000
+
+# Bytes read from the pipe at a time, i.e. about 8 seconds of audio
+DEFAULT_BLOCK_SIZE = 256 * 1024
+
+
+def decode_audio_mfcc(audio_path, threads=1, block_size=DEFAULT_BLOCK_SIZE):
+    """
+    Returns the MFCC frames of the audio file as c_compute_mfcc() does, a float64 array of the shape (k, 12).
+
+    The file is decoded by ffmpeg to 16-bit PCM on its stdout and the samples are fed to a MFCCStream
+    as they arrive, so no WAV file is written and besides the frames only a block of samples is held.
+    """
+    stream = MFCCStream(SAMPLE_RATE, threads)
+    blocks = []
+    # A file rather than a pipe, so ffmpeg never blocks on its messages while stdout is read
+    with tempfile.TemporaryFile() as messages:
+        process = subprocess.Popen(
+            [
+                'ffmpeg', '-nostdin', '-v', 'error', '-i', audio_path,
+                '-f', 's16le', '-acodec', 'pcm_s16le', '-ac', '1', '-ar', str(SAMPLE_RATE), '-',
+            ],
+            stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=messages,
+        )
+
+        # A sample may be split between two reads
+        rest = b''
+        with process:
+            for data in iter(lambda: process.stdout.read(block_size), b''):
+                data = rest + data
+                end = len(data) - len(data) % 2
+                rest = data[end:]
+                blocks.append(stream.push(np.frombuffer(data, dtype='<i2', count=end // 2).astype(np.int16)))
+
+        if process.returncode != 0:
+            messages.seek(0)
+            raise RuntimeError(
+                f'ffmpeg failed to decode {audio_path}: {messages.read().decode(errors="replace").strip()}'
+            )
+
+    blocks.append(stream.finish())
+    return np.concatenate(blocks)
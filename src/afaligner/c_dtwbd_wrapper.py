@@ -1,54 +1,509 @@
-import ctypes
-import os.path
+import os
 
 import numpy as np
 
+from afaligner.c_modules import dtwbd as c_module
+
 
 class FastDTWBDError(Exception):
     pass
 
 
-BASE_DIR = os.path.dirname(os.path.realpath(__file__))
+# Layouts of the DTWBD matrix, see DTWBDStorage in `c_modules/dtwbd.h`
+STORAGES = {
+    'rolling': 0,
+    'band': 1,
+    'linear': 2,
+}
+
+
+# Computation of the distances between frames, see DTWBDDistance in `c_modules/dtwbd.h`
+DISTANCES = {
+    'direct': 0,
+    'tile': 1,
+}
+
+
+# Type of the accumulated distances of the float32 functions, see DTWBDAccumulator in `c_modules/dtwbd.h`
+ACCUMULATORS = {
+    'float32': 0,
+    'float64': 1,
+}
+
+
+# Order in which the cells of the DTWBD matrix are filled, see DTWBDOrder in `c_modules/dtwbd.h`
+ORDERS = {
+    'rows': 0,
+    'diagonals': 1,
+}
+
+
+# Projection of the coarse path onto the window of the next level, see DTWBDWindow in `c_modules/dtwbd.h`
+WINDOWS = {
+    'fixed': 0,
+    'adaptive': 1,
+}
 
 
-def c_FastDTWBD(s, t, skip_penalty, radius):
+def get_options(storage, distance, accumulator='float32', order='rows', threads=1, prune=False,
+                window='fixed', window_budget=0):
     """
-    Wrapper for FastDTWDB C implementation.
+    Returns the fields of DTWBDOptions in `c_modules/dtwbd.h` as a tuple.
     """
-    c_module = ctypes.cdll[os.path.join(BASE_DIR, 'c_modules/dtwbd.so')]
-    c_module.FastDTWBD.argtypes = (
-        ctypes.POINTER(ctypes.c_double),
-        ctypes.POINTER(ctypes.c_double),
-        ctypes.c_size_t,
-        ctypes.c_size_t,
-        ctypes.c_size_t,
-        ctypes.c_double,
-        ctypes.c_int,
-        ctypes.POINTER(ctypes.c_double),
-        ctypes.POINTER(ctypes.c_size_t),
+    if storage not in STORAGES:
+        raise ValueError(f'Unknown storage {storage!r}, expected one of {list(STORAGES)}')
+    if distance not in DISTANCES:
+        raise ValueError(f'Unknown distance {distance!r}, expected one of {list(DISTANCES)}')
+    if accumulator not in ACCUMULATORS:
+        raise ValueError(f'Unknown accumulator {accumulator!r}, expected one of {list(ACCUMULATORS)}')
+    if order not in ORDERS:
+        raise ValueError(f'Unknown order {order!r}, expected one of {list(ORDERS)}')
+    if threads < 1:
+        raise ValueError(f'Expected a positive number of threads, got {threads!r}')
+    if window not in WINDOWS:
+        raise ValueError(f'Unknown window {window!r}, expected one of {list(WINDOWS)}')
+    if window_budget < 0:
+        raise ValueError(f'Expected a non-negative window budget, got {window_budget!r}')
+
+    return (
+        STORAGES[storage], DISTANCES[distance], ACCUMULATORS[accumulator], ORDERS[order], threads, int(prune),
+        WINDOWS[window], window_budget,
     )
-    c_module.FastDTWBD.restype = ctypes.c_ssize_t
-    
-    n, l = s.shape
-    m, _ = t.shape
-    path_distance = ctypes.c_double()
-    path_buffer = np.empty((n+m, 2), dtype='uintp')
-    path_len = c_module.FastDTWBD(
-        s.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
-        t.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
-        ctypes.c_size_t(n),
-        ctypes.c_size_t(m),
-        ctypes.c_size_t(l),
-        ctypes.c_double(skip_penalty),
-        radius,
-        ctypes.byref(path_distance),
-        path_buffer.ctypes.data_as(ctypes.POINTER(ctypes.c_size_t))
+
+
+def c_FastDTWBD(s, t, skip_penalty, radius, storage='rolling', distance='direct', order='rows', threads=1,
+                prune=False, window='fixed', window_budget=0, return_stats=False):
+    """
+    Wrapper for FastDTWDB C implementation.
+
+    `storage` selects the layout of the DTWBD matrix:
+    'rolling' keeps two rows of distances and 2-bit backpointers,
+    'band' keeps the distance and the predecessor of every cell,
+    'linear' recovers the path in O(n + m) memory when the matrix is not windowed,
+    i.e. at the base case of the recursion, at the cost of about 2.5x more distance computations.
+    All storages give the same path.
+
+    `distance` selects how the distances between frames are computed:
+    'direct' computes them cell by cell,
+    'tile' computes blocks of rows from the squared norms of the frames, which is faster at large radii
+    but rounds differently, so distances may differ in the last bits.
+    It has no effect on the unwindowed levels of the 'linear' storage.
+
+    `order` selects the order in which the matrix is filled:
+    'rows' fills it row by row,
+    'diagonals' fills it anti-diagonal by anti-diagonal computing several cells per SIMD instruction.
+    It gives the same path as 'rows' with the 'scalar' distance kernel, but computes distances itself,
+    so `distance` has no effect, and is not used with the 'band' storage.
+
+    `threads` fills large matrices of the 'rolling' and 'linear' storages with several threads
+    sweeping the band as a wavefront of tiles. Distances are then direct and the order is 'rows',
+    the path does not depend on the number of threads.
+
+    `prune=True` skips the cells whose accumulated distance exceeds the cost of a complete path found so far,
+    starting from the cost of the coarse path projected on the window. The path is the same,
+    the evaluated cells in the stats show the savings, which are largest at low skip penalties.
+    It applies to the 'rolling' and 'linear' storages with the 'rows' order and a single thread,
+    distances are then direct.
+
+    `window` selects how the path of a coarser level is widened into the window of the next one:
+    'fixed' widens every path cell by `radius`,
+    'adaptive' widens every path cell by its own radius up to `radius`: wide where other rows or columns
+    of the coarser level are about as close as the path cell, narrow where the path is clear.
+    `window_budget` caps the adaptive window to about that many cells per row on average by narrowing
+    the widest parts first, 0 leaves it uncapped.
+
+    With `return_stats=True` a dict of counters is returned as the third value:
+    for every level of the recursion from the finest one, the sequence lengths,
+    the window cells in total and in the smallest and largest rows, the cells and distances evaluated,
+    the wall time and the workspace bytes allocated and at peak, and the totals of the alignment.
+    """
+    options = get_options(
+        storage, distance, order=order, threads=threads, prune=prune, window=window, window_budget=window_budget
     )
 
-    if path_len < 0:
+    return call_FastDTWBD('FastDTWBD', 'd', s, t, skip_penalty, radius, options, return_stats)
+
+
+def c_FastDTWBD_f32(s, t, skip_penalty, radius, accumulator='float32', return_stats=False):
+    """
+    Wrapper for float32 FastDTWDB C implementation, `s` and `t` must be float32 arrays.
+
+    MFCCs, distances and accumulated distances are float32,
+    `accumulator='float64'` accumulates distances in float64 for very long sequences.
+    The matrix is kept as with the 'rolling' storage.
+    `return_stats` is as in c_FastDTWBD().
+    """
+    options = get_options('rolling', 'direct', accumulator)
+
+    return call_FastDTWBD('FastDTWBD_f32', 'f', s, t, skip_penalty, radius, options, return_stats)
+
+
+def call_FastDTWBD(function_name, dtype, s, t, skip_penalty, radius, options, return_stats=False):
+    """
+    Calls FastDTWBD() for `dtype='d'` or FastDTWBD_f32() for `dtype='f'`,
+    `s` and `t` must be C-contiguous 2D arrays of that dtype, TypeError is raised otherwise.
+    The GIL is released during the alignment, so several alignments can run in parallel threads.
+    """
+    result = c_module.fast_dtwbd(s, t, dtype, skip_penalty, radius, options, return_stats)
+
+    return unpack_result(function_name, result, return_stats)
+
+
+def unpack_result(function_name, result, return_stats):
+    path_distance, path, stats = result
+
+    if path is None:
+        raise FastDTWBDError(
+            f'The {function_name}() C function raised an error. '
+            'See stderr for more details.'
+        )
+
+    path = np.frombuffer(path, dtype='uintp').reshape(-1, 2)
+
+    if return_stats:
+        return path_distance, path, stats
+
+    return path_distance, path
+
+
+def c_FastDTWBD_workspace_size(n, m, l, radius, storage='rolling', distance='direct', order='rows', threads=1,
+                               prune=False, window='fixed', dtype='float64'):
+    """
+    Returns the number of bytes of scratch memory that FastDTWDB C implementation
+    allocates to align sequences of n and m frames of l MFCCs.
+    The whole alignment makes a single allocation of this size.
+    `dtype='float32'` gives the size for c_FastDTWBD_f32().
+    """
+    options = get_options(storage, distance, order=order, threads=threads, prune=prune, window=window)
+
+    return c_module.workspace_size(n, m, l, radius, options, dtype == 'float32')
+
+
+def c_compute_mfcc(samples, sample_rate=16000, threads=1):
+    """
+    Computes the MFCC frames of mono audio as aeneas' AudioFileMFCC does with its default parameters,
+    i.e. a frame every 40 ms of a 100 ms window, 40 mel filters and 13 coefficients.
+    Coefficient 0 is dropped: the result is a C-contiguous float64 array of the shape (len(samples) // shift, 12),
+    the layout build_sync_map aligns.
+
+    `samples` is a 1D array of float64 in [-1, 1] or of int16 PCM,
+    frames are computed in blocks by up to `threads` threads.
+    """
+    frames = c_module.mfcc(samples, sample_rate, threads)
+    if frames is None:
         raise FastDTWBDError(
-            'The FastDTWDB() C function raised an error. '
+            'The mfcc_compute() C function raised an error. '
             'See stderr for more details.'
         )
 
-    return path_distance.value, path_buffer[:path_len]
+    return np.frombuffer(frames, dtype='float64').reshape(-1, MFCC_SIZE - 1)
+
+
+# Coefficients computed by c_compute_mfcc() including the dropped coefficient 0
+MFCC_SIZE = 13
+
+
+def c_set_distance_kernel(name):
+    """
+    Selects the kernel of the Euclidean distance between frames:
+    'scalar', 'sse2', 'avx2', 'avx512' or 'neon'.
+    The best kernel supported by the CPU is selected when the library is loaded.
+    """
+    if c_module.set_distance_kernel(name) < 0:
+        raise ValueError(f'Distance kernel {name!r} is unknown or not supported by the CPU')
+
+
+def c_get_distance_kernel():
+    """
+    Returns the name of the kernel of the Euclidean distance in use.
+    """
+    return c_module.get_distance_kernel()
+
+
+# Levels of the messages of the C library, see `c_modules/logger.h`
+LOG_LEVELS = {
+    'debug': 0,
+    'info': 1,
+    'warn': 2,
+    'error': 3,
+    'none': 4,
+}
+
+
+def c_set_log_level(level):
+    """
+    Sets the lowest level of the messages written by the C library: 'debug', 'info', 'warn', 'error' or 'none'.
+    Levels below the one the library is compiled with (LOG_COMPILE_LEVEL, 'info' by default) are not available.
+    """
+    if level not in LOG_LEVELS:
+        raise ValueError(f'Unknown log level {level!r}, expected one of {list(LOG_LEVELS)}')
+
+    c_module.log_set_level(LOG_LEVELS[level])
+
+
+def c_get_log_level():
+    """
+    Returns the lowest level of the messages written by the C library.
+    """
+    level = c_module.log_get_level()
+
+    return next(name for name, value in LOG_LEVELS.items() if value == level)
+
+
+def c_set_log_file(path):
+    """
+    Appends the following messages of the C library to the file at `path`, `None` discards them.
+    Messages are written by a background thread, call c_flush_log() to have them in the file.
+    Errors are also printed to stderr.
+    """
+    if c_module.log_set_file(os.fspath(path) if path is not None else None) < 0:
+        raise ValueError(f'Log file path {path!r} is too long')
+
+
+def c_get_log_file():
+    """
+    Returns the path of the log file of the C library or `None` if messages are discarded.
+    """
+    return c_module.log_get_file()
+
+
+def c_flush_log():
+    """
+    Writes the queued messages of the C library to the log file.
+    """
+    c_module.log_flush()
+
+
+class Pyramid:
+    """
+    Coarsened levels of a float64 MFCC sequence, built once for the alignments of its parts.
+
+    FastDTWBD coarsens both sequences at every call, so aligning the tails of a long sequence
+    rebuilds the same levels again and again. Aligner.align_pyramid() takes them from the pyramid instead.
+    `radius` is the one of the alignments: levels are built while the recursion of FastDTWBD needs them.
+
+    A pyramid can be saved to a file and opened again with Pyramid.open(), which maps the file read-only,
+    so the frames and the levels of a sequence aligned many times are read from the page cache.
+    """
+    def __init__(self, sequence, radius):
+        self._pyramid = c_module.Pyramid(sequence, radius)
+
+    @classmethod
+    def open(cls, path):
+        """
+        Maps the pyramid file at `path` written by save().
+        """
+        pyramid = c_module.open_pyramid(os.fspath(path))
+        if pyramid is None:
+            raise FastDTWBDError(
+                f'The dtwbd_pyramid_open() C function failed to open {path!r}. '
+                'See stderr for more details.'
+            )
+
+        self = cls.__new__(cls)
+        self._pyramid = pyramid
+        return self
+
+    def save(self, path):
+        """
+        Writes the frames and all the levels to a pyramid file, see `c_modules/dtwbd_pyramid.h`.
+        """
+        if self._pyramid.save(os.fspath(path)) < 0:
+            raise FastDTWBDError(
+                f'The dtwbd_pyramid_save() C function failed to write {path!r}. '
+                'See stderr for more details.'
+            )
+
+    def __len__(self):
+        return self._pyramid.length
+
+    @property
+    def frames(self):
+        """
+        Read-only (n, l) float64 view of the sequence, without copying.
+        """
+        return np.asarray(self._pyramid)
+
+    @property
+    def radius(self):
+        """
+        Radius the levels are built for.
+        """
+        return self._pyramid.radius
+
+    @property
+    def mapped(self):
+        """
+        Whether the pyramid is mapped from a file.
+        """
+        return self._pyramid.mapped
+
+    @property
+    def levels(self):
+        """
+        Number of levels including the sequence itself.
+        """
+        return self._pyramid.levels
+
+    @property
+    def memory(self):
+        """
+        Bytes of the coarsened levels.
+        """
+        return self._pyramid.memory
+
+
+class Aligner:
+    """
+    Reusable context of FastDTWBD alignments.
+
+    It keeps the scratch memory of the largest alignment so far and reuses it for the next ones,
+    which saves the allocation and the page faults of every call when many pairs are aligned.
+    The options are as in c_FastDTWBD(), `accumulator` as in c_FastDTWBD_f32() for float32 sequences.
+    `log_level` sets the lowest level of the messages of this context's alignments,
+    `None` follows c_set_log_level().
+
+    Different aligners can be used by different threads at once,
+    one aligner raises RuntimeError if it is called while it aligns in another thread.
+    """
+    def __init__(self, storage='rolling', distance='direct', order='rows', threads=1, accumulator='float32',
+                 prune=False, window='fixed', window_budget=0, log_level=None):
+        self._context = c_module.Aligner(
+            get_options(storage, distance, accumulator, order, threads, prune, window, window_budget)
+        )
+        self.set_log_level(log_level)
+
+    def align(self, s, t, skip_penalty, radius, return_stats=False):
+        """
+        Aligns float64 or float32 sequences, returns the same as c_FastDTWBD().
+        """
+        result = self._context.align(s, t, skip_penalty, radius, return_stats)
+
+        return unpack_result('aligner_align', result, return_stats)
+
+    def align_pyramid(self, s, t, skip_penalty, radius, s_offset=0, n=None, t_offset=0, m=None, return_stats=False):
+        """
+        Aligns the parts `s[s_offset:s_offset + n]` and `t[t_offset:t_offset + m]` of two pyramids,
+        `None` lengths stand for the rest of the sequences. Returns the same as c_FastDTWBD(),
+        the path is relative to the offsets.
+        The finest level is the same as for the slices, the coarsened levels of odd offsets may start one frame
+        earlier than the coarsened slices would, which only shifts the windows of the finer levels.
+        """
+        if n is None:
+            n = len(s) - s_offset
+        if m is None:
+            m = len(t) - t_offset
+        result = self._context.align_pyramid(
+            s._pyramid, s_offset, n, t._pyramid, t_offset, m, skip_penalty, radius, return_stats
+        )
+
+        return unpack_result('aligner_align_pyramid', result, return_stats)
+
+    def reset(self):
+        """
+        Frees the scratch memory held by the aligner.
+        """
+        self._context.reset()
+
+    def set_log_level(self, level):
+        if level is not None and level not in LOG_LEVELS:
+            raise ValueError(f'Unknown log level {level!r}, expected one of {list(LOG_LEVELS)}')
+
+        self._context.set_log_level(LOG_LEVELS[level] if level is not None else -1)
+
+    @property
+    def workspace_size(self):
+        """
+        Bytes of scratch memory held by the aligner.
+        """
+        return self._context.workspace_size
+
+
+class StreamingAligner:
+    """
+    Online DTWBD of a text sequence `s` against audio MFCC frames pushed in chunks.
+
+    Every audio frame is aligned against `2 * radius + 1` text frames around the cheapest partial path,
+    and only the last `window` audio frames of the matrix are kept, so memory does not grow with the recording.
+    push() returns the cells of the path that are stable, i.e. on the paths of all the live cells
+    and of the best end so far, finish() returns the distance and the rest of the path.
+    The path follows the DTWBD rules of c_FastDTWBD(): it starts at (0, 0), skips leading audio
+    along the first text frame and may end anywhere at `skip_penalty` per unmatched frame.
+    When the paths do not meet within `window` frames, the prefix of the best one is committed.
+    With `radius >= len(s)` and `window` at least the audio length the path is that of the whole sequences.
+    """
+    def __init__(self, s, skip_penalty, radius=100, window=1024):
+        self._stream = c_module.Stream(s, skip_penalty, radius, window)
+
+    def push(self, frames):
+        """
+        Aligns the next audio frames, float64 of the shape (k, l), returns the newly committed (i, j) cells.
+        """
+        path = self._stream.push(frames)
+        if path is None:
+            raise FastDTWBDError(
+                'The streaming_dtwbd_push() C function raised an error. '
+                'See stderr for more details.'
+            )
+
+        return np.frombuffer(path, dtype='uintp').reshape(-1, 2)
+
+    def finish(self):
+        """
+        Ends the audio, returns the distance of the whole path and its cells not returned by push().
+        """
+        return unpack_result('streaming_dtwbd_finish', (*self._stream.finish(), None), False)
+
+    @property
+    def frames(self):
+        """
+        Audio frames pushed so far.
+        """
+        return self._stream.frames
+
+    @property
+    def memory(self):
+        """
+        Bytes held by the aligner, fixed at creation.
+        """
+        return self._stream.memory
+
+
+class MFCCStream:
+    """
+    Incremental c_compute_mfcc() of int16 PCM pushed in chunks, e.g. as it is decoded.
+
+    Only the samples of the frames that are not complete yet are kept, so memory is bounded by the chunks.
+    The concatenation of the frames returned by push() and finish() equals c_compute_mfcc() of the whole audio.
+    """
+    def __init__(self, sample_rate=16000, threads=1):
+        self._stream = c_module.MFCCStream(sample_rate, threads)
+
+    def push(self, samples):
+        """
+        Appends 1D int16 samples, returns the frames whose windows are complete, float64 of the shape (k, 12).
+        """
+        return self._unpack('mfcc_stream_push_pcm16', self._stream.push(samples))
+
+    def finish(self):
+        """
+        Ends the audio, returns the remaining frames, whose windows are padded with zeros.
+        """
+        return self._unpack('mfcc_stream_finish', self._stream.finish())
+
+    @property
+    def memory(self):
+        """
+        Bytes of the buffer of pending samples.
+        """
+        return self._stream.memory
+
+    @staticmethod
+    def _unpack(function_name, frames):
+        if frames is None:
+            raise FastDTWBDError(
+                f'The {function_name}() C function raised an error. '
+                f'See stderr for more details.'
+            )
+
+        return np.frombuffer(frames, dtype='float64').reshape(-1, MFCC_SIZE - 1)
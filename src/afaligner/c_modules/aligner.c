@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include "aligner.h"
+#include "fastdtwbd.h"
+#include "dtwbd_f32.h"
+#include "workspace.h"
+#include "logger.h"
+
+
+struct Aligner {
+    DTWBDOptions options;
+    Workspace ws;       // empty until the first alignment
+    DTWBDStats stats;   // of the last alignment
+    int log_level;
+};
+
+
+Aligner *aligner_create(const DTWBDOptions *options) {
+    Aligner *aligner = calloc(1, sizeof(Aligner));
+    if (!aligner) {
+        log_error("[Aligner] Failed to allocate the context.");
+        return NULL;
+    }
+
+    aligner->options = options ? *options : DTWBD_DEFAULT_OPTIONS;
+    aligner->log_level = -1;
+
+    return aligner;
+}
+
+void aligner_destroy(Aligner *aligner) {
+    if (!aligner) {
+        return;
+    }
+
+    workspace_free(&aligner->ws);
+    free(aligner);
+}
+
+void aligner_reset(Aligner *aligner) {
+    workspace_free(&aligner->ws);
+    aligner->stats.levels_count = 0;
+    aligner->stats.workspace_size = 0;
+    aligner->stats.workspace_peak = 0;
+    aligner->stats.seconds = 0;
+}
+
+
+ssize_t aligner_align(
+    Aligner *aligner,
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer
+) {
+    int thread_level = log_thread_level;
+    log_thread_level = aligner->log_level;
+
+    ssize_t path_len = -1;
+    if (workspace_reserve(&aligner->ws, FastDTWBD_workspace_size(n, m, l, radius, &aligner->options))) {
+        path_len = fast_dtwbd_run(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer,
+                                  &aligner->options, &aligner->ws, &aligner->stats);
+    } else {
+        aligner->stats.levels_count = 0;
+    }
+
+    log_thread_level = thread_level;
+    return path_len;
+}
+
+ssize_t aligner_align_f32(
+    Aligner *aligner,
+    float *s, float *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer
+) {
+    int thread_level = log_thread_level;
+    log_thread_level = aligner->log_level;
+
+    ssize_t path_len = -1;
+    if (workspace_reserve(&aligner->ws, FastDTWBD_f32_workspace_size(n, m, l, radius, &aligner->options))) {
+        path_len = fast_dtwbd_f32_run(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer,
+                                      &aligner->options, &aligner->ws, &aligner->stats);
+    } else {
+        aligner->stats.levels_count = 0;
+    }
+
+    log_thread_level = thread_level;
+    return path_len;
+}
+
+ssize_t aligner_align_pyramid(
+    Aligner *aligner,
+    const DTWBDPyramid *s, size_t s_offset, size_t n,
+    const DTWBDPyramid *t, size_t t_offset, size_t m,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer
+) {
+    int thread_level = log_thread_level;
+    log_thread_level = aligner->log_level;
+
+    ssize_t path_len = -1;
+    if (workspace_reserve(&aligner->ws, FastDTWBD_workspace_size(n, m, dtwbd_pyramid_dim(s), radius, &aligner->options))) {
+        path_len = fast_dtwbd_pyramid_run(s, s_offset, n, t, t_offset, m, skip_penalty, radius, path_distance, path_buffer,
+                                          &aligner->options, &aligner->ws, &aligner->stats);
+    } else {
+        aligner->stats.levels_count = 0;
+    }
+
+    log_thread_level = thread_level;
+    return path_len;
+}
+
+
+const DTWBDStats *aligner_stats(const Aligner *aligner) {
+    return &aligner->stats;
+}
+
+size_t aligner_workspace_size(const Aligner *aligner) {
+    return aligner->ws.size;
+}
+
+int aligner_set_log_level(Aligner *aligner, int level) {
+    if (level < -1 || level > LOG_LEVEL_NONE) {
+        return -1;
+    }
+    aligner->log_level = level;
+    return 0;
+}
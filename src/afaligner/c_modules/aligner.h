@@ -0,0 +1,68 @@
+#ifndef ALIGNER_H
+#define ALIGNER_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "dtwbd.h"  // for EXPORT, DTWBDOptions and DTWBDStats
+#include "dtwbd_pyramid.h"
+
+
+// Reusable context of FastDTWBD() alignments.
+// It owns the workspace, the counters of the last alignment and its log level,
+// the workspace grows to the largest alignment so far and is reused by the next ones.
+// A context must not be used by several threads at once, different contexts share no mutable state
+// and can align in parallel.
+typedef struct Aligner Aligner;
+
+// Returns NULL if out of memory, NULL options stand for the defaults
+EXPORT Aligner *aligner_create(const DTWBDOptions *options);
+EXPORT void aligner_destroy(Aligner *aligner);
+
+// Same as FastDTWBD() and FastDTWBD_f32() with the options of the context
+EXPORT ssize_t aligner_align(
+    Aligner *aligner,
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer
+);
+EXPORT ssize_t aligner_align_f32(
+    Aligner *aligner,
+    float *s, float *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer
+);
+
+// Same as FastDTWBD_pyramid() with the options of the context
+EXPORT ssize_t aligner_align_pyramid(
+    Aligner *aligner,
+    const DTWBDPyramid *s, size_t s_offset, size_t n,
+    const DTWBDPyramid *t, size_t t_offset, size_t m,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer
+);
+
+// Frees the workspace and clears the counters, the options and the log level are kept
+EXPORT void aligner_reset(Aligner *aligner);
+
+// Counters of the last alignment, levels_count is 0 before the first one
+EXPORT const DTWBDStats *aligner_stats(const Aligner *aligner);
+
+// Bytes of the workspace held by the context
+EXPORT size_t aligner_workspace_size(const Aligner *aligner);
+
+// Lowest level of the messages of the alignments of the context, -1 follows log_set_level().
+// Returns 0 on success and -1 on an invalid level.
+EXPORT int aligner_set_log_level(Aligner *aligner, int level);
+
+#endif // ALIGNER_H
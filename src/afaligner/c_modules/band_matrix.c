@@ -0,0 +1,91 @@
+#include "band_matrix.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+size_t band_cells_count(size_t n, size_t m, size_t *window) {
+    if (!window) {
+        return n * m;
+    }
+
+    BandMatrix mat = { .n = n, .m = m, .window = window };
+    size_t cells_count = 0;
+    for (size_t i = 0; i < n; i++) {
+        cells_count += band_hi(&mat, i) - band_lo(&mat, i);
+    }
+
+    return cells_count;
+}
+
+size_t band_matrix_workspace_size(size_t n, size_t m, size_t cells_count, int storage) {
+    size_t offsets_size = workspace_block_size((n + 1) * sizeof(size_t));
+
+    if (storage == DTWBD_STORAGE_BAND) {
+        return offsets_size + workspace_block_size(cells_count * sizeof(D_matrix_element));
+    }
+
+    return offsets_size +
+           workspace_block_size((cells_count + 3) / 4) +
+           workspace_block_size(2 * m * sizeof(double));
+}
+
+bool init_band_matrix(BandMatrix *mat, size_t n, size_t m, size_t *window, int storage, Workspace *ws) {
+    mat->n = n;
+    mat->m = m;
+    mat->window = window;
+    mat->cells = NULL;
+    mat->directions = NULL;
+    mat->rows = NULL;
+    mat->offsets = workspace_alloc(ws, (n + 1) * sizeof(size_t));
+    if (!mat->offsets) {
+        log_error("[BandMatrix] Failed to allocate memory for %zu row offsets.", n + 1);
+        return false;
+    }
+
+    // Row offsets are the prefix sums of the row widths
+    mat->offsets[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        mat->offsets[i + 1] = mat->offsets[i] + band_hi(mat, i) - band_lo(mat, i);
+    }
+
+    size_t cells_count = mat->offsets[n];
+    if (storage == DTWBD_STORAGE_BAND) {
+        mat->cells = workspace_alloc(ws, cells_count * sizeof(D_matrix_element));
+        if (!mat->cells) {
+            log_error("[BandMatrix] Failed to allocate memory for %zu cells.", cells_count);
+            return false;
+        }
+    } else {
+        mat->directions = workspace_alloc(ws, (cells_count + 3) / 4);
+        mat->rows = workspace_alloc(ws, 2 * m * sizeof(double));
+        if (!mat->directions || !mat->rows) {
+            log_error("[BandMatrix] Failed to allocate memory for %zu backpointers.", cells_count);
+            return false;
+        }
+        memset(mat->directions, 0, (cells_count + 3) / 4);
+    }
+
+    log_debug("[BandMatrix] BandMatrix of %zu cells created, storage %d", cells_count, storage);
+
+    return true;
+}
+
+ssize_t band_trace_path(const BandMatrix *mat, size_t end_i, size_t end_j, size_t *path_buffer) {
+    ssize_t path_len = 0;
+
+    for (ssize_t i = end_i, j = end_j; i != -1;) {
+        path_buffer[2 * path_len] = i;
+        path_buffer[2 * path_len + 1] = j;
+        path_len++;
+
+        switch (band_get_direction(mat, band_index(mat, i, j))) {
+            case DIRECTION_UP: i--; break;
+            case DIRECTION_LEFT: j--; break;
+            case DIRECTION_DIAG: i--; j--; break;
+            default: i = -1; break;
+        }
+    }
+
+    return path_len;
+}
@@ -0,0 +1,80 @@
+#ifndef BAND_MATRIX_H
+#define BAND_MATRIX_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "dtwbd.h" // for D_matrix_element
+#include "workspace.h"
+
+
+// Backpointers of DTWBD_STORAGE_ROLLING
+#define DIRECTION_NONE 0    // no predecessor, the path starts here
+#define DIRECTION_UP 1      // (i - 1, j)
+#define DIRECTION_LEFT 2    // (i, j - 1)
+#define DIRECTION_DIAG 3    // (i - 1, j - 1)
+
+
+// Dense storage of the DTWBD matrix restricted to a window.
+// Row i holds the cells [lo(i), hi(i)) contiguously and rows are stored one after another,
+// so any cell is found by a single indexed load: cells[offsets[i] + j - lo(i)].
+// With DTWBD_STORAGE_ROLLING only 2-bit backpointers are kept for every cell
+// and accumulated distances are kept for the current and the previous rows.
+typedef struct {
+    size_t n;
+    size_t m;
+    size_t *window;     // 2 x n array of [lo, hi) row limits (not owned) or NULL for full rows
+    size_t *offsets;    // n + 1 row offsets into cells
+    D_matrix_element *cells;    // DTWBD_STORAGE_BAND only
+    uint8_t *directions;        // DTWBD_STORAGE_ROLLING only, four cells per byte
+    double *rows;               // DTWBD_STORAGE_ROLLING only, 2 x m accumulated distances
+} BandMatrix;
+
+
+// API
+size_t band_cells_count(size_t n, size_t m, size_t *window);
+size_t band_matrix_workspace_size(size_t n, size_t m, size_t cells_count, int storage);
+bool init_band_matrix(BandMatrix *mat, size_t n, size_t m, size_t *window, int storage, Workspace *ws);
+// Follows the backpointers of DTWBD_STORAGE_ROLLING from the path end, writes the path in reverse order
+ssize_t band_trace_path(const BandMatrix *mat, size_t end_i, size_t end_j, size_t *path_buffer);
+
+
+static inline size_t band_lo(const BandMatrix *mat, size_t i) {
+    return mat->window ? mat->window[2 * i] : 0;
+}
+
+static inline size_t band_hi(const BandMatrix *mat, size_t i) {
+    if (!mat->window) return mat->m;
+    // empty rows are initialized as [m, 0)
+    return mat->window[2 * i + 1] > mat->window[2 * i] ? mat->window[2 * i + 1] : mat->window[2 * i];
+}
+
+static inline bool band_contains(const BandMatrix *mat, size_t i, size_t j) {
+    return i < mat->n && j >= band_lo(mat, i) && j < band_hi(mat, i);
+}
+
+// Returns the index of the cell (i, j), which must be inside the band
+static inline size_t band_index(const BandMatrix *mat, size_t i, size_t j) {
+    return mat->offsets[i] + j - band_lo(mat, i);
+}
+
+// Returns the first cell of row i, i.e. the cell (i, band_lo(i))
+static inline D_matrix_element *band_row(const BandMatrix *mat, size_t i) {
+    return &mat->cells[mat->offsets[i]];
+}
+
+// Returns the cell (i, j), which must be inside the band
+static inline D_matrix_element *band_element(const BandMatrix *mat, size_t i, size_t j) {
+    return &mat->cells[band_index(mat, i, j)];
+}
+
+// Directions are zeroed on init, so every cell is set only once
+static inline void band_set_direction(BandMatrix *mat, size_t cell, unsigned direction) {
+    mat->directions[cell / 4] |= (uint8_t)(direction << (2 * (cell % 4)));
+}
+
+static inline unsigned band_get_direction(const BandMatrix *mat, size_t cell) {
+    return (mat->directions[cell / 4] >> (2 * (cell % 4))) & 3;
+}
+
+#endif
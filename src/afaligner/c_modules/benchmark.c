@@ -0,0 +1,486 @@
+// Standalone benchmark of the DTWBD functions, built next to the dtwbd extension by `python setup.py build_benchmark`.
+//
+// Usage:
+//   dtwbd_benchmark [--quick] [--sizes 1000,10000] [--dims 12,26] [--radii 10,100]
+//                   [--skip-penalties 0.75,5] [--repeat 3] [--output FILE]
+//   dtwbd_benchmark --compare BASELINE.json CANDIDATE.json [--threshold 0.05]
+//
+// The first form times DTWBD() on a band window, FastDTWBD(), get_coarsed_sequence() and get_window()
+// on synthetic MFCC-like sequences and mfcc_compute_pcm16() on synthetic 16 kHz audio of as many frames,
+// and writes the results as JSON, one result per line. peak_workspace_bytes is the workspace of the result,
+// process_peak_rss_bytes the peak RSS of the process so far, which includes all the previous results.
+// The second form compares the ns/cell of the results of two builds with the same names
+// and fails if any of them is slower than the baseline by more than the threshold.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "dtwbd.h"
+#include "fastdtwbd.h"
+#include "band_matrix.h"
+#include "dtwbd_stats.h"
+#include "mfcc.h"
+
+#if !defined(_WIN32) && !defined(__WIN32__)
+#include <sys/resource.h>
+#endif
+
+
+#define MAX_VALUES 16
+#define MAX_RESULTS 4096
+#define NAME_SIZE 128
+#define PI 3.14159265358979323846
+#define MFCC_MAX_FRAMES 100000  // 1000 s of audio, larger sizes are not run for mfcc_compute_pcm16()
+
+typedef struct {
+    double values[MAX_VALUES];
+    size_t count;
+} ValueList;
+
+typedef struct {
+    ValueList sizes;
+    ValueList dims;
+    ValueList radii;
+    ValueList skip_penalties;
+    int repeat;
+    FILE *output;
+} BenchmarkConfig;
+
+typedef struct {
+    double seconds;         // best of the repeats
+    double mean_seconds;
+    size_t cells;           // work items of one run
+    size_t peak_workspace;  // FastDTWBD() only
+} Timing;
+
+
+// Peak RSS of the whole process since it started, it cannot be reset between results
+static size_t process_peak_rss_bytes(void) {
+#if !defined(_WIN32) && !defined(__WIN32__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return (size_t)usage.ru_maxrss;
+#else
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+
+// xorshift64* and Box-Muller, so that every build benchmarks the same sequences
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static double uniform(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double normal(void) {
+    double u = uniform(), v = uniform();
+    return sqrt(-2 * log(u + 1e-300)) * cos(2 * PI * v);
+}
+
+// MFCC-like frames: every coefficient is a slowly varying AR(1) process and lower coefficients vary more.
+// Matching frames are about 0.1 apart and unrelated ones about 1.5, so the skip penalties of afaligner
+// give paths through the whole sequences.
+static void generate_text(double *s, size_t n, size_t dim) {
+    for (size_t d = 0; d < dim; d++) {
+        double value = 0, scale = 1.0 / (1 + d);
+        for (size_t i = 0; i < n; i++) {
+            value = 0.9 * value + 0.45 * normal();
+            s[i * dim + d] = scale * value;
+        }
+    }
+}
+
+// The audio is the text read 1.5 times slower with noise
+static void generate_audio(double *t, size_t m, const double *s, size_t n, size_t dim) {
+    for (size_t j = 0; j < m; j++) {
+        size_t i = j * n / m;
+        for (size_t d = 0; d < dim; d++) {
+            t[j * dim + d] = s[i * dim + d] + 0.02 * normal();
+        }
+    }
+}
+
+// Diagonal path through the coarsed n / 2 x m / 2 matrix, as the recursion of FastDTWBD() would return
+static size_t diagonal_path(size_t *path, size_t n, size_t m) {
+    size_t len = n > m ? n : m;
+    for (size_t k = 0; k < len; k++) {
+        path[2 * k] = k * n / len;
+        path[2 * k + 1] = k * m / len;
+    }
+    return len;
+}
+
+
+static void record(Timing *timing, int run, double seconds) {
+    if (run == 0 || seconds < timing->seconds) {
+        timing->seconds = seconds;
+    }
+    timing->mean_seconds += seconds;
+}
+
+static void write_result(
+    const BenchmarkConfig *config, const char *function,
+    size_t n, size_t m, size_t dim, int radius, double skip_penalty,
+    const Timing *timing
+) {
+    double mean_seconds = timing->mean_seconds / config->repeat;
+    double ns_per_cell = timing->cells ? timing->seconds * 1e9 / timing->cells : 0;
+    double cells_per_second = timing->seconds > 0 ? timing->cells / timing->seconds : 0;
+
+    char name[NAME_SIZE];
+    snprintf(name, sizeof name, "%s/n=%zu/dim=%zu/radius=%d/skip=%g", function, n, dim, radius, skip_penalty);
+
+    fprintf(config->output,
+            "    {\"name\": \"%s\", \"function\": \"%s\", \"n\": %zu, \"m\": %zu, \"dim\": %zu, "
+            "\"radius\": %d, \"skip_penalty\": %g, \"cells\": %zu, \"seconds\": %.9f, \"mean_seconds\": %.9f, "
+            "\"ns_per_cell\": %.4f, \"cells_per_second\": %.1f, \"peak_workspace_bytes\": %zu, \"process_peak_rss_bytes\": %zu}",
+            name, function, n, m, dim, radius, skip_penalty, timing->cells, timing->seconds, mean_seconds,
+            ns_per_cell, cells_per_second, timing->peak_workspace, process_peak_rss_bytes());
+    fflush(config->output);
+
+    fprintf(stderr, "%-56s %12.3f ms %10.3f ns/cell\n", name, timing->seconds * 1e3, ns_per_cell);
+}
+
+static void write_separator(const BenchmarkConfig *config, bool *first) {
+    fprintf(config->output, *first ? "\n" : ",\n");
+    *first = false;
+}
+
+
+// Returns false if a function failed, the benchmark is then stopped
+static bool benchmark_sequences(const BenchmarkConfig *config, size_t n, size_t dim, bool *first) {
+    size_t m = n * 3 / 2;
+    double *s = malloc(n * dim * sizeof(double));
+    double *t = malloc(m * dim * sizeof(double));
+    size_t *path = malloc(2 * (n + m) * sizeof(size_t));
+    if (!s || !t || !path) {
+        fprintf(stderr, "Failed to allocate sequences of %zu and %zu frames of %zu MFCCs\n", n, m, dim);
+        free(s);
+        free(t);
+        free(path);
+        return false;
+    }
+
+    generate_text(s, n, dim);
+    generate_audio(t, m, s, n, dim);
+    bool ok = true;
+
+    // get_coarsed_sequence(): a cell is one MFCC of the input
+    Timing coarse = { .cells = n * dim };
+    for (int run = 0; run < config->repeat && ok; run++) {
+        double start = stats_clock();
+        double *coarsed = get_coarsed_sequence(s, n, dim);
+        record(&coarse, run, stats_clock() - start);
+        ok = coarsed != NULL;
+        free(coarsed);
+    }
+    if (ok) {
+        write_separator(config, first);
+        write_result(config, "get_coarsed_sequence", n, m, dim, 0, 0, &coarse);
+    }
+
+    for (size_t r = 0; r < config->radii.count && ok; r++) {
+        int radius = (int)config->radii.values[r];
+        size_t path_len = diagonal_path(path, n / 2, m / 2);
+
+        // get_window(): a cell is one cell of the window
+        Timing window_timing = {0};
+        size_t *window = NULL;
+        for (int run = 0; run < config->repeat && ok; run++) {
+            free(window);
+            double start = stats_clock();
+            window = get_window(n, m, path, path_len, radius);
+            record(&window_timing, run, stats_clock() - start);
+            ok = window != NULL;
+        }
+        if (!ok) {
+            break;
+        }
+        window_timing.cells = band_cells_count(n, m, window);
+        write_separator(config, first);
+        write_result(config, "get_window", n, m, dim, radius, 0, &window_timing);
+
+        for (size_t k = 0; k < config->skip_penalties.count && ok; k++) {
+            double skip_penalty = config->skip_penalties.values[k];
+            double path_distance;
+
+            // DTWBD() on the window of the finest level of FastDTWBD()
+            Timing dtwbd = { .cells = window_timing.cells };
+            for (int run = 0; run < config->repeat && ok; run++) {
+                double start = stats_clock();
+                ssize_t len = DTWBD(s, n, t, m, dim, skip_penalty, window, path, &path_distance, NULL);
+                record(&dtwbd, run, stats_clock() - start);
+                ok = len >= 0;
+            }
+            if (ok) {
+                write_separator(config, first);
+                write_result(config, "DTWBD", n, m, dim, radius, skip_penalty, &dtwbd);
+            }
+
+            // FastDTWBD(): cells of all the levels
+            Timing fast = {0};
+            for (int run = 0; run < config->repeat && ok; run++) {
+                DTWBDStats stats;
+                double start = stats_clock();
+                ssize_t len = FastDTWBD(s, t, n, m, dim, skip_penalty, radius, &path_distance, path, NULL, &stats);
+                record(&fast, run, stats_clock() - start);
+                ok = len >= 0;
+
+                fast.cells = 0;
+                for (size_t level = 0; level < stats.levels_count; level++) {
+                    fast.cells += stats.levels[level].cells_evaluated;
+                }
+                fast.peak_workspace = stats.workspace_peak;
+            }
+            if (ok) {
+                write_separator(config, first);
+                write_result(config, "FastDTWBD", n, m, dim, radius, skip_penalty, &fast);
+            }
+
+            // DTWBD() overwrote the coarse path
+            path_len = diagonal_path(path, n / 2, m / 2);
+        }
+
+        free(window);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "A benchmarked function failed for n=%zu dim=%zu\n", n, dim);
+    }
+
+    free(s);
+    free(t);
+    free(path);
+    return ok;
+}
+
+// mfcc_compute_pcm16() on one thread: a cell is one frame
+static bool benchmark_mfcc(const BenchmarkConfig *config, size_t frames, bool *first) {
+    MFCCPlan *plan = mfcc_plan_create(NULL);
+    size_t samples_count = frames * (plan ? mfcc_plan_shift(plan) : 0);
+    int16_t *samples = malloc(samples_count * sizeof(int16_t));
+    double *out = plan ? malloc(mfcc_frames_count(plan, samples_count) * mfcc_plan_dim(plan) * sizeof(double)) : NULL;
+    if (!plan || !samples || !out) {
+        fprintf(stderr, "Failed to allocate %zu frames of audio\n", frames);
+        mfcc_plan_destroy(plan);
+        free(samples);
+        free(out);
+        return false;
+    }
+
+    // Correlated noise under a slowly gliding tone, loud enough to stay above the filter clipping
+    double noise = 0;
+    for (size_t k = 0; k < samples_count; k++) {
+        noise = 0.9 * noise + 0.1 * normal();
+        double tone = sin(2 * PI * (200 + 100 * sin(k * 1e-4)) * k / 16000.0);
+        samples[k] = (int16_t)(8000 * tone + 4000 * noise);
+    }
+
+    bool ok = true;
+    Timing timing = { .cells = mfcc_frames_count(plan, samples_count) };
+    for (int run = 0; run < config->repeat && ok; run++) {
+        double start = stats_clock();
+        ssize_t count = mfcc_compute_pcm16(plan, samples, samples_count, 1, out);
+        record(&timing, run, stats_clock() - start);
+        ok = count >= 0;
+    }
+    if (ok) {
+        write_separator(config, first);
+        write_result(config, "mfcc_compute_pcm16", frames, samples_count, mfcc_plan_dim(plan), 0, 0, &timing);
+    } else {
+        fprintf(stderr, "mfcc_compute_pcm16() failed for %zu frames\n", frames);
+    }
+
+    mfcc_plan_destroy(plan);
+    free(samples);
+    free(out);
+    return ok;
+}
+
+static int run_benchmark(const BenchmarkConfig *config) {
+    fprintf(config->output, "{\n  \"suite\": \"dtwbd\",\n  \"repeat\": %d,\n  \"results\": [", config->repeat);
+
+    bool first = true, ok = true;
+    for (size_t a = 0; a < config->sizes.count && ok; a++) {
+        for (size_t b = 0; b < config->dims.count && ok; b++) {
+            ok = benchmark_sequences(config, (size_t)config->sizes.values[a], (size_t)config->dims.values[b], &first);
+        }
+        size_t frames = (size_t)config->sizes.values[a];
+        if (ok && frames <= MFCC_MAX_FRAMES) {
+            ok = benchmark_mfcc(config, frames, &first);
+        }
+    }
+
+    fprintf(config->output, "\n  ]\n}\n");
+    return ok ? 0 : 1;
+}
+
+
+// Results of a JSON file written by run_benchmark(), one result per line
+typedef struct {
+    char name[NAME_SIZE];
+    double ns_per_cell;
+} SavedResult;
+
+static size_t read_results(const char *path, SavedResult *results, size_t max_results) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 0;
+    }
+
+    size_t count = 0;
+    char line[2048];
+    while (count < max_results && fgets(line, sizeof line, file)) {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *ns = strstr(line, "\"ns_per_cell\": ");
+        if (!name || !ns) {
+            continue;
+        }
+
+        name += strlen("\"name\": \"");
+        const char *end = strchr(name, '"');
+        size_t len = end ? (size_t)(end - name) : 0;
+        if (len == 0 || len >= NAME_SIZE) {
+            continue;
+        }
+        memcpy(results[count].name, name, len);
+        results[count].name[len] = '\0';
+        results[count].ns_per_cell = strtod(ns + strlen("\"ns_per_cell\": "), NULL);
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+static int compare_results(const char *baseline_path, const char *candidate_path, double threshold) {
+    static SavedResult baseline[MAX_RESULTS], candidate[MAX_RESULTS];
+    size_t baseline_count = read_results(baseline_path, baseline, MAX_RESULTS);
+    size_t candidate_count = read_results(candidate_path, candidate, MAX_RESULTS);
+    if (baseline_count == 0 || candidate_count == 0) {
+        fprintf(stderr, "No results to compare\n");
+        return 2;
+    }
+
+    size_t regressions = 0, compared = 0;
+    printf("%-56s %12s %12s %9s\n", "name", "baseline", "candidate", "change");
+    for (size_t c = 0; c < candidate_count; c++) {
+        for (size_t b = 0; b < baseline_count; b++) {
+            if (strcmp(candidate[c].name, baseline[b].name) != 0 || baseline[b].ns_per_cell <= 0) {
+                continue;
+            }
+
+            double change = candidate[c].ns_per_cell / baseline[b].ns_per_cell - 1;
+            bool regression = change > threshold;
+            printf("%-56s %12.4f %12.4f %+8.1f%%%s\n", candidate[c].name, baseline[b].ns_per_cell,
+                   candidate[c].ns_per_cell, change * 100, regression ? "  REGRESSION" : "");
+            regressions += regression;
+            compared++;
+            break;
+        }
+    }
+
+    printf("%zu results compared, %zu slower by more than %.1f%%\n", compared, regressions, threshold * 100);
+    return regressions > 0 ? 1 : 0;
+}
+
+
+static bool parse_values(const char *text, ValueList *list) {
+    list->count = 0;
+    while (*text && list->count < MAX_VALUES) {
+        char *end;
+        double value = strtod(text, &end);
+        if (end == text) {
+            return false;
+        }
+        list->values[list->count++] = value;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return list->count > 0 && *text == '\0';
+}
+
+static int usage(void) {
+    fprintf(stderr,
+            "Usage: dtwbd_benchmark [--quick] [--sizes N,...] [--dims L,...] [--radii R,...]\n"
+            "                       [--skip-penalties P,...] [--repeat K] [--output FILE]\n"
+            "       dtwbd_benchmark --compare BASELINE.json CANDIDATE.json [--threshold FRACTION]\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    BenchmarkConfig config = {
+        .sizes = { {1000, 10000, 100000, 1000000}, 4 },
+        .dims = { {12, 26}, 2 },
+        .radii = { {10, 100}, 2 },
+        .skip_penalties = { {0.75, 5}, 2 },
+        .repeat = 3,
+        .output = stdout,
+    };
+    const char *compare[2] = {NULL, NULL};
+    double threshold = 0.05;
+
+    for (int k = 1; k < argc; k++) {
+        const char *arg = argv[k];
+        const char *value = k + 1 < argc ? argv[k + 1] : NULL;
+        bool parsed = true;
+
+        if (strcmp(arg, "--quick") == 0) {
+            parse_values("1000,10000", &config.sizes);
+            parse_values("12", &config.dims);
+            parse_values("10,100", &config.radii);
+            parse_values("0.75", &config.skip_penalties);
+            continue;
+        } else if (!value) {
+            return usage();
+        } else if (strcmp(arg, "--sizes") == 0) {
+            parsed = parse_values(value, &config.sizes);
+        } else if (strcmp(arg, "--dims") == 0) {
+            parsed = parse_values(value, &config.dims);
+        } else if (strcmp(arg, "--radii") == 0) {
+            parsed = parse_values(value, &config.radii);
+        } else if (strcmp(arg, "--skip-penalties") == 0) {
+            parsed = parse_values(value, &config.skip_penalties);
+        } else if (strcmp(arg, "--repeat") == 0) {
+            config.repeat = atoi(value);
+            parsed = config.repeat > 0;
+        } else if (strcmp(arg, "--threshold") == 0) {
+            threshold = strtod(value, NULL);
+        } else if (strcmp(arg, "--output") == 0) {
+            config.output = fopen(value, "w");
+            parsed = config.output != NULL;
+        } else if (strcmp(arg, "--compare") == 0 && k + 2 < argc) {
+            compare[0] = argv[k + 1];
+            compare[1] = argv[k + 2];
+            k++;
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed) {
+            return usage();
+        }
+        k++;
+    }
+
+    if (compare[0]) {
+        return compare_results(compare[0], compare[1], threshold);
+    }
+
+    int status = run_benchmark(&config);
+    if (config.output != stdout) {
+        fclose(config.output);
+    }
+    return status;
+}
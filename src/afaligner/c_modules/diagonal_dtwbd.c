@@ -0,0 +1,331 @@
+#include "diagonal_dtwbd.h"
+#include "logger.h"
+#include <float.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIAGONAL_X86 1
+#include <immintrin.h>
+#endif
+
+
+// Cells of a diagonal updated at once, the SIMD width of the step
+#define DIAGONAL_STEP 4
+
+
+static size_t costs_len(size_t n) {
+    return n + 1 + DIAGONAL_PADDING;
+}
+
+static size_t s_stride(size_t n) {
+    return n + DIAGONAL_PADDING;
+}
+
+static size_t t_stride(size_t m) {
+    return m + 2 * DIAGONAL_PADDING;
+}
+
+size_t diagonals_workspace_size(size_t n, size_t m, size_t dim) {
+    return 3 * workspace_block_size(costs_len(n) * sizeof(double)) +
+           workspace_block_size((n + DIAGONAL_PADDING) * sizeof(double)) +
+           3 * workspace_block_size((n + m) * sizeof(size_t)) +
+           2 * workspace_block_size((n + DIAGONAL_PADDING) * sizeof(int64_t)) +
+           workspace_block_size(n * sizeof(size_t)) +
+           workspace_block_size(dim * s_stride(n) * sizeof(double)) +
+           workspace_block_size(dim * t_stride(m) * sizeof(double));
+}
+
+
+// Returns the first diagonal at or after k that is not assigned yet, compressing the path
+static size_t next_unassigned(size_t *next, size_t k) {
+    size_t root = k;
+    while (next[root] != root) {
+        root = next[root];
+    }
+    while (next[k] != root) {
+        size_t up = next[k];
+        next[k] = root;
+        k = up;
+    }
+
+    return root;
+}
+
+// Sets rows[k] to the first (or the last) row whose window crosses the diagonal k.
+// Each diagonal is assigned once by skipping over the assigned ones,
+// so windows of any shape take O(n + m) time.
+static void assign_rows(const Diagonals *dg, size_t *rows, size_t *next, bool first) {
+    size_t n = dg->n, diagonals_count = dg->n + dg->m - 1;
+
+    for (size_t k = 0; k <= diagonals_count; k++) {
+        next[k] = k;
+    }
+
+    for (size_t r = 0; r < n; r++) {
+        size_t i = first ? r : n - 1 - r;
+        size_t begin = (size_t)dg->row_begin[i], end = (size_t)dg->row_end[i];
+        for (size_t k = next_unassigned(next, begin); k < end; k = next_unassigned(next, k)) {
+            rows[k] = i;
+            next[k] = k + 1;
+        }
+    }
+}
+
+bool init_diagonals(Diagonals *dg, const BandMatrix *D, double *s, double *t, size_t dim, Workspace *ws) {
+    size_t n = D->n, m = D->m;
+    size_t diagonals_count = n + m - 1;
+
+    dg->n = n;
+    dg->m = m;
+    dg->dim = dim;
+    for (int b = 0; b < 3; b++) {
+        dg->costs[b] = workspace_alloc(ws, costs_len(n) * sizeof(double));
+        dg->written[b][0] = dg->written[b][1] = 0;
+    }
+    dg->directions = workspace_alloc(ws, (n + DIAGONAL_PADDING) * sizeof(double));
+    dg->first_row = workspace_alloc(ws, (n + m) * sizeof(size_t));
+    dg->last_row = workspace_alloc(ws, (n + m) * sizeof(size_t));
+    dg->row_begin = workspace_alloc(ws, (n + DIAGONAL_PADDING) * sizeof(int64_t));
+    dg->row_end = workspace_alloc(ws, (n + DIAGONAL_PADDING) * sizeof(int64_t));
+    dg->row_cells = workspace_alloc(ws, n * sizeof(size_t));
+    dg->s_columns = workspace_alloc(ws, dim * s_stride(n) * sizeof(double));
+    dg->t_columns = workspace_alloc(ws, dim * t_stride(m) * sizeof(double));
+
+    size_t ws_mark = workspace_mark(ws);
+    size_t *next = workspace_alloc(ws, (n + m) * sizeof(size_t));
+    if (!dg->costs[0] || !dg->costs[1] || !dg->costs[2] || !dg->directions || !dg->first_row || !dg->last_row ||
+        !dg->row_begin || !dg->row_end || !dg->row_cells || !dg->s_columns || !dg->t_columns || !next) {
+        log_error("[Diagonals] Failed to allocate memory for %zu diagonals.", diagonals_count);
+        return false;
+    }
+
+    for (int b = 0; b < 3; b++) {
+        for (size_t x = 0; x < costs_len(n); x++) {
+            dg->costs[b][x] = INFINITY;
+        }
+    }
+
+    // Padding rows cross no diagonal, empty rows are [m, m)
+    for (size_t i = 0; i < n + DIAGONAL_PADDING; i++) {
+        if (i < n) {
+            size_t lo = band_lo(D, i), hi = band_hi(D, i);
+            dg->row_begin[i] = (int64_t)(lo + i);
+            dg->row_end[i] = (int64_t)(hi + i);
+            dg->row_cells[i] = band_index(D, i, lo) - lo - i;
+        } else {
+            dg->row_begin[i] = INT64_MAX;
+            dg->row_end[i] = 0;
+        }
+    }
+
+    // Frames are transposed so that the same MFCC of consecutive cells of a diagonal is contiguous.
+    // Along a diagonal j decreases, padding keeps the frames of the padding cells in bounds.
+    for (size_t d = 0; d < dim; d++) {
+        double *s_column = &dg->s_columns[d * s_stride(n)];
+        double *t_column = &dg->t_columns[d * t_stride(m)];
+        for (size_t i = 0; i < s_stride(n); i++) {
+            s_column[i] = i < n ? s[i * dim + d] : 0;
+        }
+        for (size_t j = 0; j < t_stride(m); j++) {
+            t_column[j] = j >= DIAGONAL_PADDING && j < m + DIAGONAL_PADDING ? t[(j - DIAGONAL_PADDING) * dim + d] : 0;
+        }
+    }
+
+    for (size_t k = 0; k < diagonals_count; k++) {
+        dg->first_row[k] = n;
+        dg->last_row[k] = n;
+    }
+    assign_rows(dg, dg->first_row, next, true);
+    assign_rows(dg, dg->last_row, next, false);
+
+    workspace_release(ws, ws_mark);
+
+    return true;
+}
+
+
+// Computes count cells of the diagonal k starting from the row i0.
+// up[r] and up[r + 1] are the cells above and to the left of the cell r, diag[r] is the diagonal one.
+// Distances are summed in the order of the scalar distance kernel and comparisons
+// are made in the order of the row by row fill, so the results are bit for bit the same.
+typedef void (*DiagonalStep)(
+    const Diagonals *dg, size_t k, size_t i0, size_t count,
+    const double *up, const double *diag,
+    double *costs, double *directions
+);
+
+static void diagonal_step_scalar(
+    const Diagonals *dg, size_t k, size_t i0, size_t count,
+    const double *up, const double *diag,
+    double *costs, double *directions
+) {
+    for (size_t r = 0; r < count; r++) {
+        size_t i = i0 + r;
+        int64_t diagonal = (int64_t)k;
+        if (diagonal < dg->row_begin[i] || diagonal >= dg->row_end[i]) {
+            costs[r] = INFINITY;
+            directions[r] = -1;
+            continue;
+        }
+
+        const double *x = &dg->s_columns[i];
+        const double *y = &dg->t_columns[DIAGONAL_PADDING + k - i];
+        double sum = 0;
+        for (size_t d = 0; d < dg->dim; d++) {
+            double v = x[d * s_stride(dg->n)] - y[d * t_stride(dg->m)];
+            sum += v * v;
+        }
+
+        double min_prev_distance = DBL_MAX;
+        double direction = DIRECTION_NONE;
+
+        if (up[r] < min_prev_distance) {
+            min_prev_distance = up[r];
+            direction = DIRECTION_UP;
+        }
+        if (up[r + 1] < min_prev_distance) {
+            min_prev_distance = up[r + 1];
+            direction = DIRECTION_LEFT;
+        }
+        if (diag[r] < min_prev_distance) {
+            min_prev_distance = diag[r];
+            direction = DIRECTION_DIAG;
+        }
+
+        costs[r] = sqrt(sum) + (min_prev_distance == DBL_MAX ? 0 : min_prev_distance);
+        directions[r] = direction;
+    }
+}
+
+#ifdef DIAGONAL_X86
+
+// Four cells at a time, the branches of the recurrence become blends.
+// Separate multiplications and additions keep the rounding of the scalar kernel.
+__attribute__((target("avx2")))
+static void diagonal_step_avx2(
+    const Diagonals *dg, size_t k, size_t i0, size_t count,
+    const double *up, const double *diag,
+    double *costs, double *directions
+) {
+    const __m256d none = _mm256_set1_pd(DBL_MAX);
+    const __m256i diagonal = _mm256_set1_epi64x((long long)k);
+    size_t x_stride = s_stride(dg->n), y_stride = t_stride(dg->m);
+
+    for (size_t r = 0; r < count; r += 4) {
+        size_t i = i0 + r;
+
+        // Frames of t of the four cells are j, j - 1, j - 2 and j - 3, loaded in reverse
+        const double *x = &dg->s_columns[i];
+        const double *y = &dg->t_columns[DIAGONAL_PADDING + k - i - 3];
+        __m256d sum = _mm256_setzero_pd();
+        for (size_t d = 0; d < dg->dim; d++) {
+            __m256d y_frames = _mm256_permute4x64_pd(_mm256_loadu_pd(&y[d * y_stride]), 0x1B);
+            __m256d v = _mm256_sub_pd(_mm256_loadu_pd(&x[d * x_stride]), y_frames);
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(v, v));
+        }
+
+        __m256i begin = _mm256_loadu_si256((const __m256i *)&dg->row_begin[i]);
+        __m256i end = _mm256_loadu_si256((const __m256i *)&dg->row_end[i]);
+        __m256d inside = _mm256_castsi256_pd(_mm256_andnot_si256(_mm256_cmpgt_epi64(begin, diagonal),
+                                                                 _mm256_cmpgt_epi64(end, diagonal)));
+        __m256d distance = _mm256_blendv_pd(_mm256_set1_pd(INFINITY), _mm256_sqrt_pd(sum), inside);
+
+        __m256d min_prev_distance = none;
+        __m256d direction = _mm256_set1_pd(DIRECTION_NONE);
+        __m256d prev, less;
+
+        prev = _mm256_loadu_pd(&up[r]);
+        less = _mm256_cmp_pd(prev, min_prev_distance, _CMP_LT_OQ);
+        min_prev_distance = _mm256_blendv_pd(min_prev_distance, prev, less);
+        direction = _mm256_blendv_pd(direction, _mm256_set1_pd(DIRECTION_UP), less);
+
+        prev = _mm256_loadu_pd(&up[r + 1]);
+        less = _mm256_cmp_pd(prev, min_prev_distance, _CMP_LT_OQ);
+        min_prev_distance = _mm256_blendv_pd(min_prev_distance, prev, less);
+        direction = _mm256_blendv_pd(direction, _mm256_set1_pd(DIRECTION_LEFT), less);
+
+        prev = _mm256_loadu_pd(&diag[r]);
+        less = _mm256_cmp_pd(prev, min_prev_distance, _CMP_LT_OQ);
+        min_prev_distance = _mm256_blendv_pd(min_prev_distance, prev, less);
+        direction = _mm256_blendv_pd(direction, _mm256_set1_pd(DIRECTION_DIAG), less);
+
+        // Cells without predecessors add +0.0
+        __m256d found = _mm256_cmp_pd(min_prev_distance, none, _CMP_NEQ_OQ);
+        _mm256_storeu_pd(&costs[r], _mm256_add_pd(distance, _mm256_and_pd(min_prev_distance, found)));
+        _mm256_storeu_pd(&directions[r], _mm256_blendv_pd(_mm256_set1_pd(-1), direction, inside));
+    }
+}
+
+#endif // DIAGONAL_X86
+
+
+static DiagonalStep get_diagonal_step(void) {
+#ifdef DIAGONAL_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return diagonal_step_avx2;
+    }
+#endif
+    return diagonal_step_scalar;
+}
+
+
+bool fill_diagonals(
+    BandMatrix *D,
+    Diagonals *dg,
+    double skip_penalty,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j
+) {
+    size_t n = D->n, m = D->m;
+    size_t diagonals_count = n + m - 1;
+    DiagonalStep step = get_diagonal_step();
+    bool match = false;
+
+    for (size_t k = 0; k < diagonals_count; k++) {
+        double *costs = dg->costs[k % 3];
+        const double *up = dg->costs[(k + 2) % 3];     // diagonal k - 1
+        const double *diag = dg->costs[(k + 1) % 3];   // diagonal k - 2
+
+        // The buffer held the diagonal k - 3
+        size_t *written = dg->written[k % 3];
+        for (size_t x = written[0]; x < written[1]; x++) {
+            costs[x] = INFINITY;
+        }
+        written[0] = written[1] = 0;
+
+        size_t i0 = dg->first_row[k];
+        if (i0 >= n) {
+            continue;
+        }
+        size_t count = dg->last_row[k] - i0 + 1;
+        size_t padded_count = (count + DIAGONAL_STEP - 1) / DIAGONAL_STEP * DIAGONAL_STEP;
+
+        step(dg, k, i0, padded_count, &up[i0], &diag[i0], &costs[i0 + 1], dg->directions);
+        written[0] = i0 + 1;
+        written[1] = i0 + 1 + padded_count;
+
+        // n - i + m - j - 2 is the same for the whole diagonal
+        double skip_distance = skip_penalty * (n + m - 2 - k);
+        for (size_t r = 0; r < count; r++) {
+            // Rows between the first and the last one miss the diagonal if the window is not convex
+            if (dg->directions[r] < 0) {
+                continue;
+            }
+
+            size_t i = i0 + r, j = k - i;
+            band_set_direction(D, dg->row_cells[i] + k, (unsigned)dg->directions[r]);
+
+            // Ties go to the cell that comes first row by row
+            double cur_path_distance = costs[i + 1] + skip_distance;
+            if (cur_path_distance < *min_path_distance ||
+                (match && cur_path_distance == *min_path_distance && (i < *end_i || (i == *end_i && j < *end_j)))) {
+                *min_path_distance = cur_path_distance;
+                *end_i = i;
+                *end_j = j;
+                match = true;
+            }
+        }
+    }
+
+    return match;
+}
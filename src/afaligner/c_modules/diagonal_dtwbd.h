@@ -0,0 +1,50 @@
+#ifndef DIAGONAL_DTWBD_H
+#define DIAGONAL_DTWBD_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "band_matrix.h"
+#include "workspace.h"
+
+
+// Cells past the ends of a diagonal and of the sequences touched by one SIMD step
+#define DIAGONAL_PADDING 8
+
+
+// Buffers of the anti-diagonal fill order (DTWBD_ORDER_DIAGONALS).
+// The cells (i, k - i) of the diagonal k depend only on the diagonals k - 1 and k - 2,
+// so distances and minimums over the predecessors are computed for several cells at once.
+// Accumulated distances of the last three diagonals are indexed by row, cells outside
+// the window are INFINITY, which never wins the strict comparisons of the recurrence.
+typedef struct {
+    size_t n;
+    size_t m;
+    size_t dim;
+    double *costs[3];       // n + 1 + DIAGONAL_PADDING accumulated distances, row i is at i + 1
+    size_t written[3][2];   // [lo, hi) range of costs[] that is not INFINITY
+    double *directions;     // n + DIAGONAL_PADDING backpointers of the current diagonal, -1 outside the window
+    size_t *first_row;      // n + m - 1 first rows of the window on every diagonal, n if there are none
+    size_t *last_row;       // n + m - 1 last rows of the window on every diagonal
+    int64_t *row_begin;     // n + DIAGONAL_PADDING first diagonals of the rows, lo(i) + i
+    int64_t *row_end;       // n + DIAGONAL_PADDING end diagonals of the rows, hi(i) + i
+    size_t *row_cells;      // n band indices of the cells (i, -i), so the index of (i, j) is row_cells[i] + i + j
+    double *s_columns;      // dim x (n + DIAGONAL_PADDING) frames of s, one MFCC after another
+    double *t_columns;      // dim x (DIAGONAL_PADDING + m + DIAGONAL_PADDING) frames of t, same
+} Diagonals;
+
+
+size_t diagonals_workspace_size(size_t n, size_t m, size_t dim);
+bool init_diagonals(Diagonals *dg, const BandMatrix *D, double *s, double *t, size_t dim, Workspace *ws);
+
+// Fills the packed backpointers of D diagonal by diagonal, returns whether a path end is found.
+// Gives the same backpointers and path end as the row by row fill with the scalar distance kernel.
+bool fill_diagonals(
+    BandMatrix *D,
+    Diagonals *dg,
+    double skip_penalty,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j
+);
+
+#endif
@@ -0,0 +1,465 @@
+#include "distance.h"
+#include "logger.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISTANCE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define DISTANCE_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+// Every kernel except the scalar one keeps several partial sums,
+// so results may differ from the scalar kernel in the last bits.
+
+static double euclid_distance_scalar(const double *x, const double *y, size_t l) {
+    double sum = 0;
+    for (size_t i = 0; i < l; i++) {
+        double v = x[i] - y[i];
+        sum += v * v;
+    }
+
+    return sqrt(sum);
+}
+
+
+static float euclid_distance_f32_scalar(const float *x, const float *y, size_t l) {
+    float sum = 0;
+    for (size_t i = 0; i < l; i++) {
+        float v = x[i] - y[i];
+        sum += v * v;
+    }
+
+    return sqrtf(sum);
+}
+
+
+static inline double tile_distance(double x_norm, double y_norm, double dot) {
+    double squared_distance = x_norm + y_norm - 2 * dot;
+    // Rounding can make the squared distance of close frames slightly negative
+    return squared_distance > 0 ? sqrt(squared_distance) : 0;
+}
+
+static void distance_tile_scalar(
+    const double *x, const double *x_norms, size_t rows,
+    const double *y, const double *y_norms, size_t cols,
+    size_t l, double *out, size_t out_stride
+) {
+    for (size_t c = 0; c < cols; c++) {
+        const double *yc = &y[c * l];
+        for (size_t r = 0; r < rows; r++) {
+            const double *xr = &x[r * l];
+            double dot = 0;
+            for (size_t k = 0; k < l; k++) {
+                dot += xr[k] * yc[k];
+            }
+            out[r * out_stride + c] = tile_distance(x_norms[r], y_norms[c], dot);
+        }
+    }
+}
+
+
+#ifdef DISTANCE_X86
+
+// 12 MFCCs are three iterations of the main loop
+__attribute__((target("sse2")))
+static double euclid_distance_sse2(const double *x, const double *y, size_t l) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= l; i += 4) {
+        __m128d v0 = _mm_sub_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&y[i]));
+        __m128d v1 = _mm_sub_pd(_mm_loadu_pd(&x[i + 2]), _mm_loadu_pd(&y[i + 2]));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(v0, v0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(v1, v1));
+    }
+    if (i + 2 <= l) {
+        __m128d v0 = _mm_sub_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&y[i]));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(v0, v0));
+        i += 2;
+    }
+
+    acc0 = _mm_add_pd(acc0, acc1);
+    double sum = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+    if (i < l) {
+        double v = x[i] - y[i];
+        sum += v * v;
+    }
+
+    return sqrt(sum);
+}
+
+// 12 MFCCs are one iteration of the main loop and one of the 4-wide loop
+__attribute__((target("avx2,fma")))
+static double euclid_distance_avx2(const double *x, const double *y, size_t l) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= l; i += 8) {
+        __m256d v0 = _mm256_sub_pd(_mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i]));
+        __m256d v1 = _mm256_sub_pd(_mm256_loadu_pd(&x[i + 4]), _mm256_loadu_pd(&y[i + 4]));
+        acc0 = _mm256_fmadd_pd(v0, v0, acc0);
+        acc1 = _mm256_fmadd_pd(v1, v1, acc1);
+    }
+    if (i + 4 <= l) {
+        __m256d v0 = _mm256_sub_pd(_mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&y[i]));
+        acc0 = _mm256_fmadd_pd(v0, v0, acc0);
+        i += 4;
+    }
+    if (i < l) {
+        // Masked loads read zeros past the end of the frame
+        __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)(l - i)), _mm256_setr_epi64x(0, 1, 2, 3));
+        __m256d v0 = _mm256_sub_pd(_mm256_maskload_pd(&x[i], mask), _mm256_maskload_pd(&y[i], mask));
+        acc1 = _mm256_fmadd_pd(v0, v0, acc1);
+    }
+
+    acc0 = _mm256_add_pd(acc0, acc1);
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+    sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+
+    return sqrt(_mm_cvtsd_f64(sum));
+}
+
+// 12 MFCCs are one full and one masked iteration
+__attribute__((target("avx512f")))
+static double euclid_distance_avx512(const double *x, const double *y, size_t l) {
+    __m512d acc = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= l; i += 8) {
+        __m512d v = _mm512_sub_pd(_mm512_loadu_pd(&x[i]), _mm512_loadu_pd(&y[i]));
+        acc = _mm512_fmadd_pd(v, v, acc);
+    }
+    if (i < l) {
+        __mmask8 mask = (__mmask8)((1u << (l - i)) - 1);
+        __m512d v = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, &x[i]), _mm512_maskz_loadu_pd(mask, &y[i]));
+        acc = _mm512_fmadd_pd(v, v, acc);
+    }
+
+    return sqrt(_mm512_reduce_add_pd(acc));
+}
+
+// 12 MFCCs are three iterations of the main loop
+__attribute__((target("sse2")))
+static float euclid_distance_f32_sse2(const float *x, const float *y, size_t l) {
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= l; i += 4) {
+        __m128 v = _mm_sub_ps(_mm_loadu_ps(&x[i]), _mm_loadu_ps(&y[i]));
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+    }
+
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    float sum = _mm_cvtss_f32(acc);
+    for (; i < l; i++) {
+        float v = x[i] - y[i];
+        sum += v * v;
+    }
+
+    return sqrtf(sum);
+}
+
+// 12 MFCCs are one full and one masked iteration
+__attribute__((target("avx2,fma")))
+static float euclid_distance_f32_avx2(const float *x, const float *y, size_t l) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= l; i += 8) {
+        __m256 v = _mm256_sub_ps(_mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&y[i]));
+        acc = _mm256_fmadd_ps(v, v, acc);
+    }
+    if (i < l) {
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(l - i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 v = _mm256_sub_ps(_mm256_maskload_ps(&x[i], mask), _mm256_maskload_ps(&y[i], mask));
+        acc = _mm256_fmadd_ps(v, v, acc);
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return sqrtf(_mm_cvtss_f32(sum));
+}
+
+// 12 MFCCs are a single masked iteration
+__attribute__((target("avx512f")))
+static float euclid_distance_f32_avx512(const float *x, const float *y, size_t l) {
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= l; i += 16) {
+        __m512 v = _mm512_sub_ps(_mm512_loadu_ps(&x[i]), _mm512_loadu_ps(&y[i]));
+        acc = _mm512_fmadd_ps(v, v, acc);
+    }
+    if (i < l) {
+        __mmask16 mask = (__mmask16)((1u << (l - i)) - 1);
+        __m512 v = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, &x[i]), _mm512_maskz_loadu_ps(mask, &y[i]));
+        acc = _mm512_fmadd_ps(v, v, acc);
+    }
+
+    return sqrtf(_mm512_reduce_add_ps(acc));
+}
+
+// Every frame of y is loaded once for four rows, the four dot products
+// are reduced together and turned into distances in one vector
+__attribute__((target("avx2,fma")))
+static void distance_tile_avx2(
+    const double *x, const double *x_norms, size_t rows,
+    const double *y, const double *y_norms, size_t cols,
+    size_t l, double *out, size_t out_stride
+) {
+    // Missing rows repeat the last one, their distances are not stored
+    const double *x0 = x;
+    const double *x1 = &x[(rows > 1 ? 1 : 0) * l];
+    const double *x2 = &x[(rows > 2 ? 2 : rows - 1) * l];
+    const double *x3 = &x[(rows > 3 ? 3 : rows - 1) * l];
+    __m256d xn = _mm256_setr_pd(x_norms[0], x_norms[rows > 1 ? 1 : 0],
+                                x_norms[rows > 2 ? 2 : rows - 1], x_norms[rows > 3 ? 3 : rows - 1]);
+
+    size_t full = l & ~(size_t)3;
+    __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)(l - full)), _mm256_setr_epi64x(0, 1, 2, 3));
+
+    for (size_t c = 0; c < cols; c++) {
+        const double *yc = &y[c * l];
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd();
+        __m256d acc3 = _mm256_setzero_pd();
+        for (size_t k = 0; k < full; k += 4) {
+            __m256d yv = _mm256_loadu_pd(&yc[k]);
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(&x0[k]), yv, acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(&x1[k]), yv, acc1);
+            acc2 = _mm256_fmadd_pd(_mm256_loadu_pd(&x2[k]), yv, acc2);
+            acc3 = _mm256_fmadd_pd(_mm256_loadu_pd(&x3[k]), yv, acc3);
+        }
+        if (full < l) {
+            __m256d yv = _mm256_maskload_pd(&yc[full], mask);
+            acc0 = _mm256_fmadd_pd(_mm256_maskload_pd(&x0[full], mask), yv, acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_maskload_pd(&x1[full], mask), yv, acc1);
+            acc2 = _mm256_fmadd_pd(_mm256_maskload_pd(&x2[full], mask), yv, acc2);
+            acc3 = _mm256_fmadd_pd(_mm256_maskload_pd(&x3[full], mask), yv, acc3);
+        }
+
+        __m256d h01 = _mm256_hadd_pd(acc0, acc1);
+        __m256d h23 = _mm256_hadd_pd(acc2, acc3);
+        __m256d dot = _mm256_add_pd(_mm256_permute2f128_pd(h01, h23, 0x20),
+                                    _mm256_permute2f128_pd(h01, h23, 0x31));
+
+        __m256d squared_distance = _mm256_fnmadd_pd(_mm256_set1_pd(2.0), dot,
+                                                    _mm256_add_pd(xn, _mm256_set1_pd(y_norms[c])));
+        squared_distance = _mm256_max_pd(squared_distance, _mm256_setzero_pd());
+
+        double distances[4];
+        _mm256_storeu_pd(distances, _mm256_sqrt_pd(squared_distance));
+        for (size_t r = 0; r < rows; r++) {
+            out[r * out_stride + c] = distances[r];
+        }
+    }
+}
+
+static int sse2_supported(void) { return __builtin_cpu_supports("sse2"); }
+static int avx2_supported(void) { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"); }
+static int avx512_supported(void) { return __builtin_cpu_supports("avx512f") && avx2_supported(); }
+
+#endif // DISTANCE_X86
+
+
+#ifdef DISTANCE_NEON
+
+// 12 MFCCs are three iterations of the main loop
+static double euclid_distance_neon(const double *x, const double *y, size_t l) {
+    float64x2_t acc0 = vdupq_n_f64(0);
+    float64x2_t acc1 = vdupq_n_f64(0);
+    size_t i = 0;
+    for (; i + 4 <= l; i += 4) {
+        float64x2_t v0 = vsubq_f64(vld1q_f64(&x[i]), vld1q_f64(&y[i]));
+        float64x2_t v1 = vsubq_f64(vld1q_f64(&x[i + 2]), vld1q_f64(&y[i + 2]));
+        acc0 = vfmaq_f64(acc0, v0, v0);
+        acc1 = vfmaq_f64(acc1, v1, v1);
+    }
+    if (i + 2 <= l) {
+        float64x2_t v0 = vsubq_f64(vld1q_f64(&x[i]), vld1q_f64(&y[i]));
+        acc0 = vfmaq_f64(acc0, v0, v0);
+        i += 2;
+    }
+
+    double sum = vaddvq_f64(vaddq_f64(acc0, acc1));
+    if (i < l) {
+        double v = x[i] - y[i];
+        sum += v * v;
+    }
+
+    return sqrt(sum);
+}
+
+// 12 MFCCs are three iterations of the main loop
+static float euclid_distance_f32_neon(const float *x, const float *y, size_t l) {
+    float32x4_t acc = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= l; i += 4) {
+        float32x4_t v = vsubq_f32(vld1q_f32(&x[i]), vld1q_f32(&y[i]));
+        acc = vfmaq_f32(acc, v, v);
+    }
+
+    float sum = vaddvq_f32(acc);
+    for (; i < l; i++) {
+        float v = x[i] - y[i];
+        sum += v * v;
+    }
+
+    return sqrtf(sum);
+}
+
+static int neon_supported(void) { return 1; }
+
+#endif // DISTANCE_NEON
+
+
+static int scalar_supported(void) { return 1; }
+
+typedef struct {
+    const char *name;
+    DistanceKernel kernel;
+    DistanceTileKernel tile_kernel;
+    DistanceKernelF32 f32_kernel;
+    int (*supported)(void);
+} DistanceKernelEntry;
+
+// From the slowest to the fastest
+static const DistanceKernelEntry kernels[] = {
+    {"scalar", euclid_distance_scalar, distance_tile_scalar, euclid_distance_f32_scalar, scalar_supported},
+#ifdef DISTANCE_X86
+    {"sse2", euclid_distance_sse2, distance_tile_scalar, euclid_distance_f32_sse2, sse2_supported},
+    {"avx2", euclid_distance_avx2, distance_tile_avx2, euclid_distance_f32_avx2, avx2_supported},
+    {"avx512", euclid_distance_avx512, distance_tile_avx2, euclid_distance_f32_avx512, avx512_supported},
+#endif
+#ifdef DISTANCE_NEON
+    {"neon", euclid_distance_neon, distance_tile_scalar, euclid_distance_f32_neon, neon_supported},
+#endif
+};
+
+#define KERNELS_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+DistanceKernel euclid_distance_kernel = euclid_distance_scalar;
+DistanceTileKernel distance_tile_kernel = distance_tile_scalar;
+DistanceKernelF32 euclid_distance_f32_kernel = euclid_distance_f32_scalar;
+static const char *kernel_name = "scalar";
+
+
+static void select_kernel(const DistanceKernelEntry *entry) {
+    euclid_distance_kernel = entry->kernel;
+    distance_tile_kernel = entry->tile_kernel;
+    euclid_distance_f32_kernel = entry->f32_kernel;
+    kernel_name = entry->name;
+}
+
+
+int set_distance_kernel(const char *name) {
+    for (size_t k = 0; k < KERNELS_COUNT; k++) {
+        if (strcmp(kernels[k].name, name) == 0) {
+            if (!kernels[k].supported()) {
+                log_error("[Distance] Kernel %s is not supported by the CPU.", name);
+                return -1;
+            }
+            select_kernel(&kernels[k]);
+            return 0;
+        }
+    }
+
+    log_error("[Distance] Unknown kernel %s.", name);
+    return -1;
+}
+
+const char *get_distance_kernel(void) {
+    return kernel_name;
+}
+
+
+#if defined(__GNUC__)
+__attribute__((constructor))
+#endif
+static void init_distance_kernel(void) {
+#ifdef DISTANCE_X86
+    // Must be called before __builtin_cpu_supports() in constructors
+    __builtin_cpu_init();
+#endif
+
+    for (size_t k = KERNELS_COUNT; k > 0; k--) {
+        if (kernels[k - 1].supported()) {
+            select_kernel(&kernels[k - 1]);
+            break;
+        }
+    }
+
+    const char *name = getenv("AFALIGNER_DISTANCE_KERNEL");
+    if (name && *name) {
+        set_distance_kernel(name);
+    }
+}
+
+
+double euclid_distance(double *x, double *y, size_t l) {
+    return euclid_distance_kernel(x, y, l);
+}
+
+
+size_t distance_tile_workspace_size(size_t n, size_t m) {
+    return workspace_block_size(n * sizeof(double)) +
+           workspace_block_size(m * sizeof(double)) +
+           workspace_block_size(DISTANCE_TILE_ROWS * m * sizeof(double));
+}
+
+static void squared_norms(const double *x, size_t n, size_t l, double *norms) {
+    for (size_t i = 0; i < n; i++) {
+        double sum = 0;
+        for (size_t k = 0; k < l; k++) {
+            sum += x[i * l + k] * x[i * l + k];
+        }
+        norms[i] = sum;
+    }
+}
+
+bool init_distance_tile(DistanceTile *tile, const double *s, size_t n, const double *t, size_t m, size_t dim, Workspace *ws) {
+    tile->m = m;
+    tile->evaluations = 0;
+    tile->s_norms = workspace_alloc(ws, n * sizeof(double));
+    tile->t_norms = workspace_alloc(ws, m * sizeof(double));
+    tile->values = workspace_alloc(ws, DISTANCE_TILE_ROWS * m * sizeof(double));
+    if (!tile->s_norms || !tile->t_norms || !tile->values) {
+        log_error("[Distance] Failed to allocate memory for the distance tile.");
+        return false;
+    }
+
+    squared_norms(s, n, dim, tile->s_norms);
+    squared_norms(t, m, dim, tile->t_norms);
+
+    return true;
+}
+
+void fill_distance_tile(
+    DistanceTile *tile,
+    const double *s, const double *t, size_t dim,
+    size_t i0, size_t rows,
+    size_t c0, size_t c1
+) {
+    DistanceTileKernel kernel = distance_tile_kernel;
+    tile->evaluations += rows * (c1 - c0);
+
+    // A block of columns stays in cache while all rows of the tile are computed against it
+    for (size_t cb = c0; cb < c1; cb += DISTANCE_TILE_COLUMNS) {
+        size_t cols = c1 - cb < DISTANCE_TILE_COLUMNS ? c1 - cb : DISTANCE_TILE_COLUMNS;
+        for (size_t r = 0; r < rows; r += DISTANCE_TILE_KERNEL_ROWS) {
+            size_t i = i0 + r;
+            size_t kernel_rows = rows - r < DISTANCE_TILE_KERNEL_ROWS ? rows - r : DISTANCE_TILE_KERNEL_ROWS;
+            kernel(&s[i * dim], &tile->s_norms[i], kernel_rows,
+                   &t[cb * dim], &tile->t_norms[cb], cols,
+                   dim, &tile->values[(i % DISTANCE_TILE_ROWS) * tile->m + cb], tile->m);
+        }
+    }
+}
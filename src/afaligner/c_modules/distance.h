@@ -0,0 +1,76 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "dtwbd.h" // for EXPORT
+#include "workspace.h"
+
+
+// Euclidean distance between two frames of l MFCCs
+typedef double (*DistanceKernel)(const double *x, const double *y, size_t l);
+
+// Same for frames of float32 MFCCs
+typedef float (*DistanceKernelF32)(const float *x, const float *y, size_t l);
+
+// Distances between up to DISTANCE_TILE_KERNEL_ROWS consecutive frames x and the frames y[0, cols)
+// computed as sqrt(||x||^2 + ||y||^2 - 2 x.y) from the squared norms of the frames.
+// The distance of x[r] and y[c] is written to out[r * out_stride + c].
+typedef void (*DistanceTileKernel)(
+    const double *x, const double *x_norms, size_t rows,
+    const double *y, const double *y_norms, size_t cols,
+    size_t l, double *out, size_t out_stride
+);
+
+#define DISTANCE_TILE_KERNEL_ROWS 4
+
+// Kernel used by euclid_distance() and the DTWBD fill loops.
+// The best kernel supported by the CPU is chosen when the library is loaded,
+// the AFALIGNER_DISTANCE_KERNEL environment variable overrides the choice.
+extern DistanceKernel euclid_distance_kernel;
+// Kernel of DTWBD_DISTANCE_TILE, selected together with euclid_distance_kernel
+extern DistanceTileKernel distance_tile_kernel;
+// Kernel of the float32 entry points, selected together with euclid_distance_kernel
+extern DistanceKernelF32 euclid_distance_f32_kernel;
+
+
+// Selects the kernel by name: "scalar", "sse2", "avx2", "avx512" or "neon".
+// Returns 0 on success and -1 if the kernel is unknown or not supported by the CPU.
+EXPORT int set_distance_kernel(const char *name);
+
+// Returns the name of the kernel in use
+EXPORT const char *get_distance_kernel(void);
+
+
+// Distances of a block of DISTANCE_TILE_ROWS rows of the DTWBD matrix (DTWBD_DISTANCE_TILE).
+// Squared norms of all frames are computed once, then the distances of a block of rows
+// are computed together, reusing every frame of t for all rows of the block.
+#define DISTANCE_TILE_ROWS 8
+#define DISTANCE_TILE_COLUMNS 128  // columns per cache block, 12 KB of frames of 12 MFCCs
+
+typedef struct {
+    size_t m;
+    double *s_norms;    // n squared norms of the frames of s
+    double *t_norms;    // m squared norms of the frames of t
+    double *values;     // DISTANCE_TILE_ROWS x m distances, row i is at (i % DISTANCE_TILE_ROWS) * m
+    size_t evaluations; // distances computed so far
+} DistanceTile;
+
+size_t distance_tile_workspace_size(size_t n, size_t m);
+bool init_distance_tile(DistanceTile *tile, const double *s, size_t n, const double *t, size_t m, size_t dim, Workspace *ws);
+
+// Computes the distances of the rows [i0, i0 + rows) for the columns [c0, c1),
+// i0 must be a multiple of DISTANCE_TILE_ROWS and rows at most DISTANCE_TILE_ROWS
+void fill_distance_tile(
+    DistanceTile *tile,
+    const double *s, const double *t, size_t dim,
+    size_t i0, size_t rows,
+    size_t c0, size_t c1
+);
+
+// Returns the distances of row i, valid for the columns passed to fill_distance_tile()
+static inline const double *distance_tile_row(const DistanceTile *tile, size_t i) {
+    return &tile->values[(i % DISTANCE_TILE_ROWS) * tile->m];
+}
+
+#endif
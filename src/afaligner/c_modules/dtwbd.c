@@ -2,10 +2,16 @@
 #include <math.h>
 #include <float.h>
 #include "dtwbd.h"
-#include "sparse_matrix.h"
-#include "uthash.h"
+#include "band_matrix.h"
+#include "workspace.h"
+#include "linear_dtwbd.h"
+#include "distance.h"
+#include "diagonal_dtwbd.h"
+#include "wavefront_dtwbd.h"
+#include "dtwbd_stats.h"
 #include <stdbool.h>
 #include "fastdtwbd.h"
+#include "dtwbd_pyramid.h"
 #include "logger.h"
 #include <stdlib.h>
 
@@ -16,6 +22,126 @@ typedef SSIZE_T ssize_t;
 #endif
 
 
+const DTWBDOptions DTWBD_DEFAULT_OPTIONS = {
+    .storage = DTWBD_STORAGE_ROLLING,
+    .distance = DTWBD_DISTANCE_DIRECT,
+    .accumulator = DTWBD_ACCUMULATOR_SAMPLE,
+    .order = DTWBD_ORDER_ROWS,
+    .threads = 1,
+    .prune = DTWBD_PRUNE_NONE,
+    .window = DTWBD_WINDOW_FIXED,
+    .window_budget = 0,
+};
+
+
+static ssize_t dtwbd_in_workspace(
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *window,
+    size_t *path_buffer,
+    double *path_distance,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDLevelStats *level,
+    double bound
+);
+
+static void fill_window_radii(size_t *window, size_t n, size_t m, size_t *path_buffer, size_t path_len,
+                              int radius, const int *radii);
+static void get_adaptive_radii(
+    int *radii,
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    size_t *path_buffer, size_t path_len,
+    int radius
+);
+static void fill_adaptive_window(
+    size_t *window, size_t n, size_t m,
+    size_t *path_buffer, size_t path_len,
+    int *radii, int radius,
+    size_t budget
+);
+
+// Prebuilt coarsed levels of the parts of s and t being aligned, a NULL pyramid is coarsened on the fly
+typedef struct {
+    const DTWBDPyramid *s;
+    const DTWBDPyramid *t;
+    size_t s_offset;
+    size_t t_offset;
+} PyramidParts;
+
+static ssize_t fast_dtwbd_run_parts(
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats,
+    const PyramidParts *pyramids
+);
+
+static ssize_t fast_dtwbd_in_workspace(
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats,
+    const PyramidParts *pyramids,
+    size_t depth
+);
+
+
+// Whether the matrix is filled by anti-diagonals, which needs the backpointers of the rolling storage
+static bool uses_diagonals(size_t n, size_t m, const DTWBDOptions *options) {
+    return options->order == DTWBD_ORDER_DIAGONALS && options->storage != DTWBD_STORAGE_BAND && n > 0 && m > 0;
+}
+
+// Whether the matrix is filled by several threads, small matrices are not worth starting them
+static bool uses_wavefront(size_t n, size_t cells_count, const DTWBDOptions *options) {
+    return options->threads > 1 && options->storage != DTWBD_STORAGE_BAND && wavefront_supported() &&
+           n > WAVEFRONT_STRIP_ROWS && cells_count >= WAVEFRONT_MIN_CELLS;
+}
+
+// Whether the cells are pruned, which takes the rolling storage filled by rows by a single thread
+static bool uses_pruning(size_t n, size_t m, size_t cells_count, const DTWBDOptions *options) {
+    return options->prune == DTWBD_PRUNE_BOUNDS && options->storage != DTWBD_STORAGE_BAND &&
+           !uses_diagonals(n, m, options) && !uses_wavefront(n, cells_count, options);
+}
+
+// Returns the workspace size needed by DTWBD with the given number of window cells
+static size_t dtwbd_workspace_size(size_t n, size_t m, size_t dim, size_t cells_count, bool unwindowed, const DTWBDOptions *options) {
+    if (unwindowed && options->storage == DTWBD_STORAGE_LINEAR) {
+        return linear_dtwbd_workspace_size(n, m);
+    }
+
+    size_t size = band_matrix_workspace_size(n, m, cells_count, options->storage);
+    if (uses_diagonals(n, m, options)) {
+        size += diagonals_workspace_size(n, m, dim);
+    } else if (uses_pruning(n, m, cells_count, options)) {
+        size += workspace_block_size(m * sizeof(double));
+    } else if (options->distance == DTWBD_DISTANCE_TILE) {
+        size += distance_tile_workspace_size(n, m);
+    }
+    if (uses_wavefront(n, cells_count, options)) {
+        size += wavefront_workspace_size(n, m, options->threads);
+    }
+
+    return size;
+}
+
+
 ssize_t DTWBD(
     double *s, size_t n,
     double *t, size_t m,
@@ -23,112 +149,482 @@ ssize_t DTWBD(
     double skip_penalty,
     size_t *window,
     size_t *path_buffer,
-    double *path_distance
+    double *path_distance,
+    const DTWBDOptions *options
 ) {
-    SparseMatrix *D_sparse = create_sparse_matrix();
-    double d;
+    if (!options) {
+        options = &DTWBD_DEFAULT_OPTIONS;
+    }
 
-    // Logging start of DTWBD function
-    log_info("Starting DTWBD function");
+    Workspace ws;
+    size_t ws_size = dtwbd_workspace_size(n, m, dim, window ? band_cells_count(n, m, window) : n * m, window == NULL, options);
+    if (!workspace_init(&ws, ws_size)) {
+        return -1;
+    }
 
-    // Fill the distance matrix D_sparse
-    for (size_t i = 0; i < n; i++) {
-        for (size_t j = 0; j < m; j++) {
-            if (window && (j < window[2 * i] || j >= window[2 * i + 1])) {
-                continue;
+    ssize_t path_len = dtwbd_in_workspace(s, n, t, m, dim, skip_penalty, window, path_buffer, path_distance, options, &ws, NULL, INFINITY);
+
+    workspace_free(&ws);
+
+    return path_len;
+}
+
+
+// Returns the precomputed distances of row i or NULL without a tile,
+// the distances of a block of rows are computed when its first row is reached
+static const double *tile_distances(DistanceTile *tile, const BandMatrix *D, double *s, double *t, size_t dim, size_t i) {
+    if (!tile) {
+        return NULL;
+    }
+
+    if (i % DISTANCE_TILE_ROWS == 0) {
+        size_t rows = D->n - i < DISTANCE_TILE_ROWS ? D->n - i : DISTANCE_TILE_ROWS;
+
+        // The block is computed over the union of the windows of its rows
+        size_t c0 = D->m, c1 = 0;
+        for (size_t r = i; r < i + rows; r++) {
+            size_t lo = band_lo(D, r), hi = band_hi(D, r);
+            if (lo < hi) {
+                if (lo < c0) c0 = lo;
+                if (hi > c1) c1 = hi;
             }
+        }
+        if (c0 < c1) {
+            fill_distance_tile(tile, s, t, dim, i, rows, c0, c1);
+        }
+    }
+
+    return distance_tile_row(tile, i);
+}
+
+
+// Fills the matrix of D_matrix_element, returns whether a path end is found
+static bool fill_band(
+    BandMatrix *D,
+    DistanceTile *tile,
+    double *s, double *t, size_t dim,
+    double skip_penalty,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j
+) {
+    size_t n = D->n, m = D->m;
+    DistanceKernel distance = euclid_distance_kernel;
+    bool match = false;
+
+    // Fill the distance matrix D row by row.
+    // Predecessors of (i, j) are (i - 1, j), (i, j - 1) and (i - 1, j - 1),
+    // a predecessor exists only if it lies inside the window.
+    for (size_t i = 0; i < n; i++) {
+        size_t lo = band_lo(D, i), hi = band_hi(D, i);
+        const double *distances = tile_distances(tile, D, s, t, dim, i);
+        D_matrix_element *row = band_row(D, i);
+
+        size_t up_lo = 0, up_hi = 0;
+        D_matrix_element *up_row = NULL;
+        if (i > 0) {
+            up_lo = band_lo(D, i - 1);
+            up_hi = band_hi(D, i - 1);
+            up_row = band_row(D, i - 1);
+        }
 
-            d = euclid_distance(&s[i * dim], &t[j * dim], dim);
+        for (size_t j = lo; j < hi; j++) {
+            double d = distances ? distances[j] : distance(&s[i * dim], &t[j * dim], dim);
 
             double min_prev_distance = DBL_MAX;
             ssize_t prev_i = -1, prev_j = -1;
 
             // Check previous elements in the matrix
             D_matrix_element *e;
-            e = get_element(D_sparse, i - 1, j);
-            if (e && e->distance < min_prev_distance) {
-                min_prev_distance = e->distance;
-                prev_i = i - 1;
-                prev_j = j;
+            if (j >= up_lo && j < up_hi) {
+                e = &up_row[j - up_lo];
+                if (e->distance < min_prev_distance) {
+                    min_prev_distance = e->distance;
+                    prev_i = i - 1;
+                    prev_j = j;
+                }
             }
 
-            e = get_element(D_sparse, i, j - 1);
-            if (e && e->distance < min_prev_distance) {
-                min_prev_distance = e->distance;
-                prev_i = i;
-                prev_j = j - 1;
+            if (j > lo) {
+                e = &row[j - 1 - lo];
+                if (e->distance < min_prev_distance) {
+                    min_prev_distance = e->distance;
+                    prev_i = i;
+                    prev_j = j - 1;
+                }
             }
 
-            e = get_element(D_sparse, i - 1, j - 1);
-            if (e && e->distance < min_prev_distance) {
-                min_prev_distance = e->distance;
-                prev_i = i - 1;
-                prev_j = j - 1;
+            if (j > up_lo && j - 1 < up_hi) {
+                e = &up_row[j - 1 - up_lo];
+                if (e->distance < min_prev_distance) {
+                    min_prev_distance = e->distance;
+                    prev_i = i - 1;
+                    prev_j = j - 1;
+                }
             }
 
             // Update the current matrix element
-            D_matrix_element cur;
-            cur.distance = d + (min_prev_distance == DBL_MAX ? 0 : min_prev_distance);
-            cur.prev_i = prev_i;
-            cur.prev_j = prev_j;
+            D_matrix_element *cur = &row[j - lo];
+            cur->distance = d + (min_prev_distance == DBL_MAX ? 0 : min_prev_distance);
+            cur->prev_i = prev_i;
+            cur->prev_j = prev_j;
+
+            // The path may end at any cell, skipping the rest of both sequences
+            double cur_path_distance = cur->distance + skip_penalty * (n - i + m - j - 2);
+            if (cur_path_distance < *min_path_distance) {
+                *min_path_distance = cur_path_distance;
+                *end_i = i;
+                *end_j = j;
+                match = true;
+            }
+        }
+    }
+
+    return match;
+}
 
-            set_element(D_sparse, i, j, cur);
 
-            // Log the current values for debugging
-            log_debug("i: %zu, j: %zu, distance: %.4f, min_prev_distance: %.4f, prev_i: %zd, prev_j: %zd",
-                      i, j, cur.distance, min_prev_distance, cur.prev_i, cur.prev_j);
+// Fills the packed backpointers keeping only two rows of accumulated distances,
+// returns whether a path end is found
+static bool fill_rolling(
+    BandMatrix *D,
+    DistanceTile *tile,
+    double *s, double *t, size_t dim,
+    double skip_penalty,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j
+) {
+    size_t n = D->n, m = D->m;
+    double *rows = D->rows;
+    size_t row_len = m;
+    DistanceKernel distance = euclid_distance_kernel;
+    bool match = false;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t lo = band_lo(D, i), hi = band_hi(D, i);
+        const double *distances = tile_distances(tile, D, s, t, dim, i);
+        size_t cell = D->offsets[i];
+        double *row = &rows[(i % 2) * row_len];
+
+        size_t up_lo = 0, up_hi = 0;
+        double *up_row = &rows[((i + 1) % 2) * row_len];
+        if (i > 0) {
+            up_lo = band_lo(D, i - 1);
+            up_hi = band_hi(D, i - 1);
+        }
+
+        for (size_t j = lo; j < hi; j++, cell++) {
+            double d = distances ? distances[j] : distance(&s[i * dim], &t[j * dim], dim);
+
+            double min_prev_distance = DBL_MAX;
+            unsigned direction = DIRECTION_NONE;
+
+            // Same order of comparisons as in fill_band() to get the same ties
+            if (j >= up_lo && j < up_hi && up_row[j - up_lo] < min_prev_distance) {
+                min_prev_distance = up_row[j - up_lo];
+                direction = DIRECTION_UP;
+            }
+            if (j > lo && row[j - 1 - lo] < min_prev_distance) {
+                min_prev_distance = row[j - 1 - lo];
+                direction = DIRECTION_LEFT;
+            }
+            if (j > up_lo && j - 1 < up_hi && up_row[j - 1 - up_lo] < min_prev_distance) {
+                min_prev_distance = up_row[j - 1 - up_lo];
+                direction = DIRECTION_DIAG;
+            }
+
+            double cell_distance = d + (min_prev_distance == DBL_MAX ? 0 : min_prev_distance);
+            row[j - lo] = cell_distance;
+            band_set_direction(D, cell, direction);
+
+            double cur_path_distance = cell_distance + skip_penalty * (n - i + m - j - 2);
+            if (cur_path_distance < *min_path_distance) {
+                *min_path_distance = cur_path_distance;
+                *end_i = i;
+                *end_j = j;
+                match = true;
+            }
         }
     }
 
-    double min_path_distance = DBL_MAX;
-    size_t end_i = 0, end_j = 0;
+    return match;
+}
+
+
+// fill_rolling() skipping the cells whose accumulated distance exceeds bound, the cost of a complete path.
+// The cost of any path through such a cell is above the bound too, as distances are not negative,
+// so the optimal path, its ties included, and its end are the same as without pruning.
+// The bound drops to the cost of every better path end found. Pruned cells hold INFINITY and no backpointer.
+// Every row is shrunk to the cells reachable from the cells left in the previous row:
+// the distances of those are computed at once in the distances buffer of m values,
+// and the row ends at the first pruned cell past them. Returns whether a path end is found.
+static bool fill_rolling_pruned(
+    BandMatrix *D,
+    double *s, double *t, size_t dim,
+    double skip_penalty,
+    double bound,
+    double *distances,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j,
+    size_t *evaluated
+) {
+    size_t n = D->n, m = D->m;
+    double *rows = D->rows;
+    size_t row_len = m;
+    DistanceKernel distance = euclid_distance_kernel;
     bool match = false;
+    size_t cells = 0;
+    size_t alive_lo = 0, alive_hi = m;  // cells left in the previous row
 
-    // Find the minimum path distance
     for (size_t i = 0; i < n; i++) {
-        for (size_t j = 0; j < m; j++) {
-            D_matrix_element *e = get_element(D_sparse, i, j);
-            if (!e) continue;
+        size_t lo = band_lo(D, i), hi = band_hi(D, i);
+        size_t cell = D->offsets[i];
+        double *row = &rows[(i % 2) * row_len];
+
+        size_t up_lo = 0, up_hi = 0;
+        double *up_row = &rows[((i + 1) % 2) * row_len];
+        if (i > 0) {
+            up_lo = band_lo(D, i - 1);
+            up_hi = band_hi(D, i - 1);
+        }
+
+        // Cells before the first one left above have pruned predecessors only,
+        // unless the row starts with a cell without predecessors, where the path may start
+        bool lo_starts = !(lo >= up_lo && lo < up_hi) && !(lo > up_lo && lo - 1 < up_hi);
+        size_t first = lo_starts || alive_lo < lo ? lo : alive_lo;
+        size_t reachable = alive_hi + 1 < hi ? alive_hi + 1 : hi;
+        for (size_t j = lo; j < first && j < hi; j++) {
+            row[j - lo] = INFINITY;
+        }
+        for (size_t j = first; j < reachable; j++) {
+            distances[j] = distance(&s[i * dim], &t[j * dim], dim);
+        }
+        cells += reachable > first ? reachable - first : 0;
+
+        alive_lo = hi;
+        alive_hi = lo;
+        size_t j = first;
+        for (cell += first - lo; j < hi; j++, cell++) {
+            double min_prev_distance = DBL_MAX;
+            unsigned direction = DIRECTION_NONE;
+
+            // Same order of comparisons as in fill_rolling(), pruned cells are never the minimum
+            if (j >= up_lo && j < up_hi && up_row[j - up_lo] < min_prev_distance) {
+                min_prev_distance = up_row[j - up_lo];
+                direction = DIRECTION_UP;
+            }
+            if (j > lo && row[j - 1 - lo] < min_prev_distance) {
+                min_prev_distance = row[j - 1 - lo];
+                direction = DIRECTION_LEFT;
+            }
+            if (j > up_lo && j - 1 < up_hi && up_row[j - 1 - up_lo] < min_prev_distance) {
+                min_prev_distance = up_row[j - 1 - up_lo];
+                direction = DIRECTION_DIAG;
+            }
 
-            double cur_path_distance = e->distance + skip_penalty * (n - i + m - j - 2);
+            double distance_value = INFINITY;
+            if (direction != DIRECTION_NONE || (j == lo && lo_starts)) {
+                double d;
+                if (j < reachable) {
+                    d = distances[j];
+                } else {
+                    // Past the reachable cells only the left neighbour is left
+                    d = distance(&s[i * dim], &t[j * dim], dim);
+                    cells++;
+                }
+                distance_value = d + (direction == DIRECTION_NONE ? 0 : min_prev_distance);
+            }
+
+            if (!(distance_value <= bound)) {
+                row[j - lo] = INFINITY;
+                if (j + 1 >= reachable) {
+                    j++;
+                    break;
+                }
+                continue;
+            }
 
-            // Log each comparison for path distance
-            log_debug("Comparing path distance at i: %zu, j: %zu, cur_path_distance: %.4f",
-                      i, j, cur_path_distance);
+            row[j - lo] = distance_value;
+            band_set_direction(D, cell, direction);
+            if (j < alive_lo) {
+                alive_lo = j;
+            }
+            alive_hi = j + 1;
 
-            if (cur_path_distance < min_path_distance) {
-                min_path_distance = cur_path_distance;
-                end_i = i;
-                end_j = j;
+            double cur_path_distance = distance_value + skip_penalty * (n - i + m - j - 2);
+            if (cur_path_distance < *min_path_distance) {
+                *min_path_distance = cur_path_distance;
+                *end_i = i;
+                *end_j = j;
                 match = true;
+                if (cur_path_distance < bound) {
+                    bound = cur_path_distance;
+                }
+            }
+        }
+
+        for (; j < hi; j++) {
+            row[j - lo] = INFINITY;
+        }
+    }
+
+    *evaluated = cells;
+    return match;
+}
+
+
+// Returns the cost of a path of the n x m level that follows the path of the coarser level,
+// ending where it is the cheapest. It is inside the window projected from the coarse path
+// (every coarse cell covers its 2 x 2 block), so it bounds the cost of the optimal path of the window.
+// Distances are accumulated in the same order as by the fills, so the bound is exact in floating point.
+static double projected_path_bound(
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *coarse_path, size_t coarse_path_len
+) {
+    DistanceKernel distance = euclid_distance_kernel;
+    double bound = INFINITY;
+    double cost = 0;
+    size_t i = 0, j = 0;
+    bool started = false;
+
+    // The path must start where the fills do
+    if (coarse_path_len == 0 || coarse_path[0] != 0 || coarse_path[1] != 0) {
+        return INFINITY;
+    }
+
+    for (size_t k = 0; k < coarse_path_len; k++) {
+        // Move to the last cell of the block of the coarse cell, diagonally first
+        size_t target_i = 2 * coarse_path[2 * k] + 1, target_j = 2 * coarse_path[2 * k + 1] + 1;
+        if (target_i >= n || target_j >= m) {
+            break;
+        }
+        while (!started || i < target_i || j < target_j) {
+            if (started) {
+                if (i < target_i) i++;
+                if (j < target_j) j++;
+            }
+            started = true;
+            cost = distance(&s[i * dim], &t[j * dim], dim) + cost;
+
+            double path_distance = cost + skip_penalty * (n - i + m - j - 2);
+            if (path_distance < bound) {
+                bound = path_distance;
             }
         }
     }
 
+    return bound;
+}
+
+
+static ssize_t dtwbd_in_workspace(
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *window,
+    size_t *path_buffer,
+    double *path_distance,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDLevelStats *level,
+    double bound
+) {
+    if (!window && options->storage == DTWBD_STORAGE_LINEAR) {
+        log_info("Starting linear memory DTWBD function");
+        size_t cells = 0;
+        ssize_t path_len = linear_dtwbd(s, n, t, m, dim, skip_penalty, path_buffer, path_distance, &cells, ws);
+        stats_window(level, n, m, NULL);
+        if (level) {
+            level->cells_evaluated += cells;
+            level->distance_evaluations += cells;
+        }
+        return path_len;
+    }
+
+    size_t ws_mark = workspace_mark(ws);
+    BandMatrix band;
+    BandMatrix *D = &band;
+    if (!init_band_matrix(D, n, m, window, options->storage, ws)) {
+        log_error("Failed to allocate the DTWBD matrix.");
+        workspace_release(ws, ws_mark);
+        return -1;
+    }
+    stats_window(level, n, m, D->offsets);
+
+    // Logging start of DTWBD function
+    log_info("Starting DTWBD function");
+
+    double min_path_distance = DBL_MAX;
+    size_t end_i = 0, end_j = 0;
+    bool match;
+
+    bool wavefront = uses_wavefront(n, D->offsets[n], options);
+    bool prune = uses_pruning(n, m, D->offsets[n], options);
+    size_t cells_evaluated = D->offsets[n];
+    DistanceTile distance_tile;
+    DistanceTile *tile = NULL;
+    if (options->distance == DTWBD_DISTANCE_TILE && !uses_diagonals(n, m, options) && !wavefront && !prune) {
+        if (!init_distance_tile(&distance_tile, s, n, t, m, dim, ws)) {
+            workspace_release(ws, ws_mark);
+            return -1;
+        }
+        tile = &distance_tile;
+    }
+
+    if (wavefront) {
+        log_info("Filling the DTWBD matrix with %zu threads", wavefront_threads(n, options->threads));
+        match = fill_wavefront(D, s, t, dim, skip_penalty, options->threads, &min_path_distance, &end_i, &end_j, ws);
+    } else if (uses_diagonals(n, m, options)) {
+        Diagonals diagonals;
+        if (!init_diagonals(&diagonals, D, s, t, dim, ws)) {
+            workspace_release(ws, ws_mark);
+            return -1;
+        }
+        match = fill_diagonals(D, &diagonals, skip_penalty, &min_path_distance, &end_i, &end_j);
+    } else if (options->storage == DTWBD_STORAGE_BAND) {
+        match = fill_band(D, tile, s, t, dim, skip_penalty, &min_path_distance, &end_i, &end_j);
+    } else if (prune) {
+        double *distances = workspace_alloc(ws, m * sizeof(double));
+        if (!distances) {
+            workspace_release(ws, ws_mark);
+            return -1;
+        }
+        match = fill_rolling_pruned(D, s, t, dim, skip_penalty, bound, distances,
+                                    &min_path_distance, &end_i, &end_j, &cells_evaluated);
+        log_info("Pruning evaluated %zu of %zu cells", cells_evaluated, D->offsets[n]);
+    } else {
+        match = fill_rolling(D, tile, s, t, dim, skip_penalty, &min_path_distance, &end_i, &end_j);
+    }
+
+    if (level) {
+        level->cells_evaluated += cells_evaluated;
+        level->distance_evaluations += tile ? tile->evaluations : cells_evaluated;
+    }
+
     ssize_t path_len = 0;
 
     if (match) {
-        D_matrix_element *e;
         *path_distance = min_path_distance;
 
         // Log the minimum path distance and end points
         log_info("Found match. Min path distance: %.4f, end_i: %zu, end_j: %zu",
                  min_path_distance, end_i, end_j);
 
-        for (ssize_t i = end_i, j = end_j; i != -1;) {
-            e = get_element(D_sparse, i, j);
-            if (!e) break;
-            path_buffer[2 * path_len] = i;
-            path_buffer[2 * path_len + 1] = j;
-            path_len++;
-
-            ssize_t next_i = e->prev_i;
-            ssize_t next_j = e->prev_j;
-            i = next_i;
-            j = next_j;
+        if (options->storage == DTWBD_STORAGE_BAND) {
+            for (ssize_t i = end_i, j = end_j; i != -1;) {
+                path_buffer[2 * path_len] = i;
+                path_buffer[2 * path_len + 1] = j;
+                path_len++;
 
-            // Log each step of the path reconstruction
-            log_debug("Reconstructing path: i: %zd, j: %zd", i, j);
+                D_matrix_element *e = band_element(D, i, j);
+                i = e->prev_i;
+                j = e->prev_j;
+            }
+        } else {
+            path_len = band_trace_path(D, end_i, end_j, path_buffer);
         }
 
         reverse_path(path_buffer, path_len);
@@ -139,36 +635,11 @@ ssize_t DTWBD(
         log_info("No matching path found");
     }
 
-    // Free the sparse matrix
-    free_sparse_matrix(D_sparse);
+    workspace_release(ws, ws_mark);
 
     return path_len;
 }
 
-double euclid_distance(double *x, double *y, size_t l) {
-    double sum = 0;
-
-    // Log the input vectors and their length
-    log_debug("Calculating Euclidean distance. Length: %zu", l);
-
-    for (size_t i = 0; i < l; i++) {
-        double v = x[i] - y[i];
-        double squared_diff = v * v;
-        sum += squared_diff;
-
-        // Log the difference and squared difference for each dimension
-        log_debug("i: %zu, x[i]: %.4f, y[i]: %.4f, v: %.4f, squared_diff: %.4f",
-                  i, x[i], y[i], v, squared_diff);
-    }
-
-    double distance = sqrt(sum);
-
-    // Log the final computed distance
-    log_info("Euclidean distance calculated: %.4f", distance);
-
-    return distance;
-}
-
 void reverse_path(size_t *path, ssize_t path_len) {
     // Log the original path
     log_debug("Reversing path. Path length: %zu", path_len);
@@ -210,63 +681,266 @@ ssize_t FastDTWBD(
     double skip_penalty,
     int radius,
     double *path_distance,
-    size_t *path_buffer
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    DTWBDStats *stats
+) {
+    // All the memory of the recursion is carved from a single workspace
+    Workspace ws;
+    if (!workspace_init(&ws, FastDTWBD_workspace_size(n, m, l, radius, options))) {
+        return -1;
+    }
+
+    ssize_t path_len = fast_dtwbd_run(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer, options, &ws, stats);
+    workspace_free(&ws);
+
+    return path_len;
+}
+
+
+ssize_t fast_dtwbd_run(
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats
+) {
+    return fast_dtwbd_run_parts(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer, options, ws, stats, NULL);
+}
+
+
+static ssize_t fast_dtwbd_run_parts(
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats,
+    const PyramidParts *pyramids
+) {
+    if (!options) {
+        options = &DTWBD_DEFAULT_OPTIONS;
+    }
+    double start = stats ? stats_clock() : 0;
+    if (stats) {
+        stats->levels_count = 0;
+    }
+
+    ssize_t path_len = fast_dtwbd_in_workspace(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer, options, ws, stats, pyramids, 0);
+
+    if (stats) {
+        stats->workspace_size = ws->size;
+        stats->workspace_peak = ws->peak;
+        stats->seconds = stats_clock() - start;
+    }
+
+    return path_len;
+}
+
+
+ssize_t FastDTWBD_pyramid(
+    const DTWBDPyramid *s, size_t s_offset, size_t n,
+    const DTWBDPyramid *t, size_t t_offset, size_t m,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    DTWBDStats *stats
+) {
+    Workspace ws;
+    if (!workspace_init(&ws, FastDTWBD_workspace_size(n, m, dtwbd_pyramid_dim(s), radius, options))) {
+        return -1;
+    }
+
+    ssize_t path_len = fast_dtwbd_pyramid_run(s, s_offset, n, t, t_offset, m, skip_penalty, radius,
+                                              path_distance, path_buffer, options, &ws, stats);
+    workspace_free(&ws);
+
+    return path_len;
+}
+
+
+ssize_t fast_dtwbd_pyramid_run(
+    const DTWBDPyramid *s, size_t s_offset, size_t n,
+    const DTWBDPyramid *t, size_t t_offset, size_t m,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats
+) {
+    size_t l = dtwbd_pyramid_dim(s);
+    if (dtwbd_pyramid_dim(t) != l ||
+        s_offset > dtwbd_pyramid_length(s) || n > dtwbd_pyramid_length(s) - s_offset ||
+        t_offset > dtwbd_pyramid_length(t) || m > dtwbd_pyramid_length(t) - t_offset) {
+        log_error("Parts [%zu, +%zu) and [%zu, +%zu) are out of the pyramids.", s_offset, n, t_offset, m);
+        return -1;
+    }
+
+    PyramidParts pyramids = {.s = s, .t = t, .s_offset = s_offset, .t_offset = t_offset};
+    return fast_dtwbd_run_parts(
+        (double *)dtwbd_pyramid_level(s, 0, s_offset), (double *)dtwbd_pyramid_level(t, 0, t_offset),
+        n, m, l, skip_penalty, radius, path_distance, path_buffer, options, ws, stats, &pyramids
+    );
+}
+
+
+static ssize_t fast_dtwbd_in_workspace(
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats,
+    const PyramidParts *pyramids,
+    size_t depth
 ) {
     ssize_t path_len;
     size_t min_sequence_len = 2 * (radius + 1) + 1;
+    DTWBDLevelStats *level = stats_level(stats, depth);
+    StatsMark mark;
 
     log_debug("Starting FastDTWBD with parameters: n=%zu, m=%zu, l=%zu, skip_penalty=%lf, radius=%d", n, m, l, skip_penalty, radius);
 
     // Base case
     if (n < min_sequence_len || m < min_sequence_len) {
         log_debug("Base case reached, calling DTWBD.");
-        return DTWBD(s, n, t, m, l, skip_penalty, NULL, path_buffer, path_distance);
+        stats_begin(level, ws, &mark);
+        path_len = dtwbd_in_workspace(s, n, t, m, l, skip_penalty, NULL, path_buffer, path_distance, options, ws, level, INFINITY);
+        stats_end(level, ws, &mark);
+        return path_len;
     }
 
-    // Create coarsed sequences
-    log_debug("Creating coarsed sequences for s and t.");
-    double *coarsed_s = get_coarsed_sequence(s, n, l);
-    if (!coarsed_s) {
-        log_error("Failed to allocate coarsed_s.");
-        return -1;  // Check allocation
+    size_t ws_mark = workspace_mark(ws);
+    stats_begin(level, ws, &mark);
+
+    // Radii of the cells of the coarse path, computed while the coarsed sequences are alive
+    int *radii = NULL;
+    if (options->window == DTWBD_WINDOW_ADAPTIVE && !(radii = workspace_alloc(ws, (n / 2 + m / 2) * sizeof(int)))) {
+        log_error("Failed to allocate adaptive window radii.");
+        stats_end(level, ws, &mark);
+        workspace_release(ws, ws_mark);
+        return -1;
     }
+    size_t sequences_mark = workspace_mark(ws);
 
-    double *coarsed_t = get_coarsed_sequence(t, m, l);
-    if (!coarsed_t) {
-        log_error("Failed to allocate coarsed_t.");
-        free(coarsed_s);
-        return -1;  // Check allocation
+    // Take coarsed sequences from the pyramids or create them
+    log_debug("Creating coarsed sequences for s and t.");
+    double *coarsed_s = pyramids ? (double *)dtwbd_pyramid_level(pyramids->s, depth + 1, pyramids->s_offset) : NULL;
+    double *coarsed_t = pyramids ? (double *)dtwbd_pyramid_level(pyramids->t, depth + 1, pyramids->t_offset) : NULL;
+    if (!coarsed_s && (coarsed_s = workspace_alloc(ws, n / 2 * l * sizeof(double)))) {
+        coarse_sequence(coarsed_s, s, n, l);
+    }
+    if (!coarsed_t && (coarsed_t = workspace_alloc(ws, m / 2 * l * sizeof(double)))) {
+        coarse_sequence(coarsed_t, t, m, l);
+    }
+    if (!coarsed_s || !coarsed_t) {
+        log_error("Failed to allocate coarsed sequences.");
+        stats_end(level, ws, &mark);
+        workspace_release(ws, ws_mark);
+        return -1;
     }
+    stats_end(level, ws, &mark);
 
     // Recursive call
     log_debug("Calling FastDTWBD recursively with coarsed sequences.");
-    path_len = FastDTWBD(coarsed_s, coarsed_t, n / 2, m / 2, l, skip_penalty, radius, path_distance, path_buffer);
+    path_len = fast_dtwbd_in_workspace(coarsed_s, coarsed_t, n / 2, m / 2, l, skip_penalty, radius, path_distance, path_buffer, options, ws, stats, pyramids, depth + 1);
+
+    if (radii && path_len > 0) {
+        stats_begin(level, ws, &mark);
+        get_adaptive_radii(radii, coarsed_s, n / 2, coarsed_t, m / 2, l, path_buffer, path_len, radius);
+        stats_end(level, ws, &mark);
+    }
+
+    // Coarsed sequences are not needed anymore, the window is built from the path and the radii only
+    workspace_release(ws, sequences_mark);
 
     if (path_len > 0) {
         log_debug("Path length from recursive call: %zd", path_len);
 
         // Create window and call DTWBD
-        size_t *window = get_window(n, m, path_buffer, path_len, radius);
+        stats_begin(level, ws, &mark);
+        size_t *window = workspace_alloc(ws, 2 * n * sizeof(size_t));
         if (window) {
+            if (radii) {
+                fill_adaptive_window(window, n, m, path_buffer, path_len, radii, radius,
+                                     options->window_budget > 0 ? (size_t)options->window_budget * n : 0);
+            } else {
+                fill_window(window, n, m, path_buffer, path_len, radius);
+            }
+            double bound = options->prune == DTWBD_PRUNE_BOUNDS
+                ? projected_path_bound(s, n, t, m, l, skip_penalty, path_buffer, path_len)
+                : INFINITY;
             log_debug("Window created, calling DTWBD with the window.");
-            path_len = DTWBD(s, n, t, m, l, skip_penalty, window, path_buffer, path_distance);
-            free(window);
+            path_len = dtwbd_in_workspace(s, n, t, m, l, skip_penalty, window, path_buffer, path_distance, options, ws, level, bound);
         } else {
             log_warn("Window creation failed.");
+            path_len = -1;
         }
+        stats_end(level, ws, &mark);
     } else {
         log_warn("Recursive call returned an invalid path length.");
     }
 
-    // Cleanup
-    log_debug("Cleaning up, freeing coarsed sequences.");
-    free(coarsed_s);
-    free(coarsed_t);
+    workspace_release(ws, ws_mark);
 
     return path_len;
 }
 
 
+size_t FastDTWBD_workspace_size(size_t n, size_t m, size_t l, int radius, const DTWBDOptions *options) {
+    if (!options) {
+        options = &DTWBD_DEFAULT_OPTIONS;
+    }
+
+    size_t min_sequence_len = 2 * (radius + 1) + 1;
+    size_t sequences_size = 0;  // coarsed sequences that are alive at the current level
+    size_t peak = 0;
+
+    for (;;) {
+        if (n < min_sequence_len || m < min_sequence_len) {
+            size_t level_size = dtwbd_workspace_size(n, m, l, n * m, true, options);
+            return sequences_size + level_size > peak ? sequences_size + level_size : peak;
+        }
+
+        // Radii of the adaptive window, alive from the coarsening to the end of the level
+        size_t radii_size = options->window == DTWBD_WINDOW_ADAPTIVE
+            ? workspace_block_size((n / 2 + m / 2) * sizeof(int))
+            : 0;
+
+        // Window and band of the current level, allocated after the coarser levels are done.
+        // Adaptive radii are at most the radius, so the window bound holds for them too.
+        size_t level_size = radii_size + workspace_block_size(2 * n * sizeof(size_t)) +
+                            dtwbd_workspace_size(n, m, l, get_max_window_cells(n, m, radius), false, options);
+        if (sequences_size + level_size > peak) {
+            peak = sequences_size + level_size;
+        }
+
+        sequences_size += radii_size +
+                          workspace_block_size(n / 2 * l * sizeof(double)) +
+                          workspace_block_size(m / 2 * l * sizeof(double));
+        n /= 2;
+        m /= 2;
+    }
+}
+
+
 double *get_coarsed_sequence(double *s, size_t n, size_t l) {
     size_t coarsed_sequence_len = n / 2;
 
@@ -280,17 +954,21 @@ double *get_coarsed_sequence(double *s, size_t n, size_t l) {
 
     log_debug("Memory allocation successful for coarsed sequence.");
 
+    coarse_sequence(coarsed_sequence, s, n, l);
+
+    return coarsed_sequence;
+}
+
+
+void coarse_sequence(double *coarsed_sequence, double *s, size_t n, size_t l) {
     // Create the coarsed sequence
     for (size_t i = 0; 2 * i + 1 < n; i++) {
-        //log_debug("Creating coarsed sequence element %zu", i);
-
         for (size_t j = 0; j < l; j++) {
             coarsed_sequence[l * i + j] = (s[l * (2 * i) + j] + s[l * (2 * i + 1) + j]) / 2;
         }
     }
 
     log_debug("Coarsed sequence creation complete.");
-    return coarsed_sequence;
 }
 
 
@@ -305,6 +983,20 @@ size_t *get_window(size_t n, size_t m, size_t *path_buffer, size_t path_len, int
 
     log_debug("Memory allocation successful for window.");
 
+    fill_window(window, n, m, path_buffer, path_len, radius);
+
+    return window;
+}
+
+
+void fill_window(size_t *window, size_t n, size_t m, size_t *path_buffer, size_t path_len, int radius) {
+    fill_window_radii(window, n, m, path_buffer, path_len, radius, NULL);
+}
+
+
+// fill_window() with the radius of every path cell taken from radii, unless it is NULL
+static void fill_window_radii(size_t *window, size_t n, size_t m, size_t *path_buffer, size_t path_len,
+                              int radius, const int *radii) {
     // Initialize window with max and min values
     for (size_t i = 0; i < n; i++) {
         window[2 * i] = m;    // maximum value for lower limit
@@ -320,6 +1012,9 @@ size_t *get_window(size_t n, size_t m, size_t *path_buffer, size_t path_len, int
 
         log_debug("Processing path element (%zu, %zu) at index %zu", i, j, k);
 
+        if (radii) {
+            radius = radii[k];
+        }
         for (ssize_t x = -radius; x < radius + 1; x++) {
             // update lower window limit
             update_window(window, n, m, 2 * (i + x), 2 * (j - radius));
@@ -331,9 +1026,106 @@ size_t *get_window(size_t n, size_t m, size_t *path_buffer, size_t path_len, int
         }
     }
 
-    log_debug("Window computation complete, returning window.");
+    log_debug("Window computation complete.");
+}
 
-    return window;
+
+// Radius of every cell of the coarse n x m path for the adaptive window, at most radius.
+// The rows and columns at offsets 1, 2, 4, ... from the cell are compared with it: those within ADAPTIVE_MARGIN
+// of the distance of the cell could be on the path as well, so the farthest of them is covered twice over.
+static void get_adaptive_radii(
+    int *radii,
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    size_t *path_buffer, size_t path_len,
+    int radius
+) {
+    DistanceKernel distance = euclid_distance_kernel;
+    // A negative radius would make the offset loop below endless
+    if (radius < 0) {
+        radius = 0;
+    }
+    int min_radius = radius < ADAPTIVE_MIN_RADIUS ? radius : ADAPTIVE_MIN_RADIUS;
+
+    for (size_t k = 0; k < path_len; k++) {
+        size_t i = path_buffer[2 * k];
+        size_t j = path_buffer[2 * k + 1];
+        double limit = (1 + ADAPTIVE_MARGIN) * distance(&s[i * dim], &t[j * dim], dim);
+        int r = min_radius;
+
+        // Offsets below half the smallest radius are covered anyway
+        for (size_t offset = 1; offset <= (size_t)radius; offset *= 2) {
+            if (2 * offset <= (size_t)min_radius) {
+                continue;
+            }
+            if ((j >= offset && distance(&s[i * dim], &t[(j - offset) * dim], dim) <= limit) ||
+                (j + offset < m && distance(&s[i * dim], &t[(j + offset) * dim], dim) <= limit) ||
+                (i >= offset && distance(&s[(i - offset) * dim], &t[j * dim], dim) <= limit) ||
+                (i + offset < n && distance(&s[(i + offset) * dim], &t[j * dim], dim) <= limit)) {
+                r = 2 * offset < (size_t)radius ? (int)(2 * offset) : radius;
+            }
+        }
+        radii[k] = r;
+    }
+}
+
+
+// Fills the window with the adaptive radii of the path cells. While the window has more than budget cells,
+// the radii are capped halfway between the cap and the smallest radius, which narrows the widest parts first.
+// A zero budget is no cap.
+static void fill_adaptive_window(
+    size_t *window, size_t n, size_t m,
+    size_t *path_buffer, size_t path_len,
+    int *radii, int radius,
+    size_t budget
+) {
+    if (radius < 0) {
+        radius = 0;
+    }
+    int min_radius = radius < ADAPTIVE_MIN_RADIUS ? radius : ADAPTIVE_MIN_RADIUS;
+    int cap = radius;
+
+    for (;;) {
+        fill_window_radii(window, n, m, path_buffer, path_len, radius, radii);
+        if (budget == 0) {
+            return;
+        }
+
+        size_t cells = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (window[2 * i + 1] > window[2 * i]) {
+                cells += window[2 * i + 1] - window[2 * i];
+            }
+        }
+        if (cells <= budget) {
+            return;
+        }
+        if (cap == min_radius) {
+            log_info("Adaptive window of %zu cells exceeds the budget of %zu cells at the smallest radius",
+                     cells, budget);
+            return;
+        }
+
+        cap = min_radius + (cap - min_radius) / 2;
+        for (size_t k = 0; k < path_len; k++) {
+            if (radii[k] > cap) {
+                radii[k] = cap;
+            }
+        }
+    }
+}
+
+
+size_t get_max_window_cells(size_t n, size_t m, int radius) {
+    // A row of the window spans 2 * (j_max - j_min) + 4 * radius + 4 cells at most,
+    // where j_min and j_max are the extreme columns of the coarse path within radius rows.
+    // Since the path is monotonic, each of its column increments is counted
+    // in at most 2 * (2 * radius + 1) rows, which gives the following bound:
+    size_t r = radius > 0 ? (size_t)radius : 0;
+    size_t bound = (4 * r + 4) * n + (4 * r + 2) * m;
+
+    return bound < n * m ? bound : n * m;
 }
 
 
@@ -5,7 +5,7 @@
 #include <float.h>
 #include <math.h>
 #include <stddef.h>
-#include "uthash.h"
+#include <sys/types.h>
 
 #if defined(_WIN32) || defined(__WIN32__)
     #ifdef BUILDING_FASTDTWBD
@@ -28,6 +28,88 @@ typedef struct {
     ssize_t prev_j;
 } D_matrix_element;
 
+// Layouts of the DTWBD matrix
+typedef enum {
+    DTWBD_STORAGE_ROLLING = 0,  // two rows of accumulated distances and a 2-bit backpointer per cell
+    DTWBD_STORAGE_BAND = 1,     // D_matrix_element per cell
+    DTWBD_STORAGE_LINEAR = 2,   // O(n + m) divide and conquer without a window, rolling with a window
+} DTWBDStorage;
+
+// Computation of the distances between frames
+typedef enum {
+    DTWBD_DISTANCE_DIRECT = 0,  // cell by cell as sqrt(sum (x - y)^2)
+    DTWBD_DISTANCE_TILE = 1,    // blocks of rows as sqrt(||x||^2 + ||y||^2 - 2 x.y), not with the linear storage
+} DTWBDDistance;
+
+// Order in which the cells of the matrix are filled
+typedef enum {
+    DTWBD_ORDER_ROWS = 0,       // row by row
+    DTWBD_ORDER_DIAGONALS = 1,  // anti-diagonal by anti-diagonal with SIMD, rolling storage only, distances are direct
+} DTWBDOrder;
+
+// Type of the accumulated distances of the float32 entry points, doubles always accumulate in double
+typedef enum {
+    DTWBD_ACCUMULATOR_SAMPLE = 0,   // same type as the MFCCs
+    DTWBD_ACCUMULATOR_DOUBLE = 1,   // double, for very long sequences
+} DTWBDAccumulator;
+
+// Skipping of the cells that cannot be on the optimal path
+typedef enum {
+    DTWBD_PRUNE_NONE = 0,
+    // Cells whose accumulated distance exceeds the cost of a complete path found so far are not extended.
+    // The bound starts at the cost of the coarse path projected on the window of the level.
+    // The path is the same as without pruning. Applies to the rolling and linear storages filled by rows
+    // by a single thread, with direct distances, other fills ignore it.
+    DTWBD_PRUNE_BOUNDS = 1,
+} DTWBDPrune;
+
+// Projection of the coarse path of FastDTWBD() onto the window of the next level
+typedef enum {
+    DTWBD_WINDOW_FIXED = 0,     // every path cell is widened by the radius
+    // Every path cell is widened by its own radius, at most the given one: wide where other rows or columns
+    // of the coarse level are about as close as the path cell, narrow where the path is clear.
+    // The double entry points only, the float32 ones use the fixed window.
+    DTWBD_WINDOW_ADAPTIVE = 1,
+} DTWBDWindow;
+
+// Optional parameters of DTWBD() and FastDTWBD(), NULL options stand for the defaults
+typedef struct {
+    int storage;    // DTWBDStorage
+    int distance;   // DTWBDDistance
+    int accumulator;    // DTWBDAccumulator
+    int order;      // DTWBDOrder
+    int threads;    // threads filling the rolling storage of large matrices, distances are direct and order is rows
+    int prune;      // DTWBDPrune
+    int window;     // DTWBDWindow
+    int window_budget;  // cells of the adaptive window per row on average at most, 0 for no cap
+} DTWBDOptions;
+
+EXPORT extern const DTWBDOptions DTWBD_DEFAULT_OPTIONS;
+
+#define DTWBD_STATS_MAX_LEVELS 64
+
+// Counters of one level of FastDTWBD, i.e. of one DTWBD matrix and the coarsening that precedes it
+typedef struct {
+    size_t n;                       // frames of the sequences
+    size_t m;
+    size_t window_cells;            // cells inside the window, n x m without a window
+    size_t min_row_cells;           // fewest and most window cells in a row
+    size_t max_row_cells;
+    size_t cells_evaluated;         // cells whose recurrence was computed, above window_cells with the linear storage
+    size_t distance_evaluations;    // distances between frames computed, above cells_evaluated with tile distances
+    double seconds;                 // wall time, without the coarser levels
+    size_t bytes_allocated;         // workspace bytes taken by the level
+    size_t peak_workspace;          // highest workspace usage during the level, including the finer levels' blocks
+} DTWBDLevelStats;
+
+// Optional output of FastDTWBD(), levels[0] is the finest level
+typedef struct {
+    size_t levels_count;
+    DTWBDLevelStats levels[DTWBD_STATS_MAX_LEVELS];
+    size_t workspace_size;          // bytes of the single workspace allocation
+    size_t workspace_peak;          // highest workspace usage
+    double seconds;                 // wall time of the whole alignment
+} DTWBDStats;
 
 
 // Main DTWBD function
@@ -38,18 +120,13 @@ EXPORT ssize_t DTWBD(
     double skip_penalty,
     size_t *window,
     size_t *path_buffer,
-    double *path_distance
+    double *path_distance,
+    const DTWBDOptions *options
 );
 
 // Helper functions
 double euclid_distance(double *x, double *y, size_t l);
 
-double get_distance(
-    void *matrix, size_t n, size_t m,
-    size_t *window, size_t i, size_t j,
-    int use_sparse
-);
-
 D_matrix_element get_best_candidate(D_matrix_element *candidates, size_t n);
 
 void reverse_path(size_t *path, ssize_t path_len);
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <float.h>
+#include <stdbool.h>
+#include "dtwbd_f32.h"
+#include "dtwbd.h"
+#include "fastdtwbd.h"
+#include "band_matrix.h"
+#include "workspace.h"
+#include "distance.h"
+#include "dtwbd_stats.h"
+#include "logger.h"
+
+
+#define FILL_ROLLING fill_rolling_f32
+#define COST float
+#define COST_MAX FLT_MAX
+#include "fill_rolling_f32.h"
+
+#define FILL_ROLLING fill_rolling_f32_double
+#define COST double
+#define COST_MAX DBL_MAX
+#include "fill_rolling_f32.h"
+
+
+static ssize_t dtwbd_f32_in_workspace(
+    float *s, size_t n,
+    float *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *window,
+    size_t *path_buffer,
+    double *path_distance,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDLevelStats *level
+) {
+    size_t ws_mark = workspace_mark(ws);
+    BandMatrix band;
+    BandMatrix *D = &band;
+    if (!init_band_matrix(D, n, m, window, DTWBD_STORAGE_ROLLING, ws)) {
+        log_error("Failed to allocate the float32 DTWBD matrix.");
+        workspace_release(ws, ws_mark);
+        return -1;
+    }
+    stats_window(level, n, m, D->offsets);
+
+    log_info("Starting float32 DTWBD function");
+
+    double min_path_distance = DBL_MAX;
+    size_t end_i = 0, end_j = 0;
+    bool match;
+
+    if (options->accumulator == DTWBD_ACCUMULATOR_DOUBLE) {
+        match = fill_rolling_f32_double(D, s, t, dim, skip_penalty, &min_path_distance, &end_i, &end_j);
+    } else {
+        match = fill_rolling_f32(D, s, t, dim, skip_penalty, &min_path_distance, &end_i, &end_j);
+    }
+
+    if (level) {
+        level->cells_evaluated += D->offsets[n];
+        level->distance_evaluations += D->offsets[n];
+    }
+
+    ssize_t path_len = 0;
+
+    if (match) {
+        *path_distance = min_path_distance;
+        log_info("Found match. Min path distance: %.4f, end_i: %zu, end_j: %zu",
+                 min_path_distance, end_i, end_j);
+
+        path_len = band_trace_path(D, end_i, end_j, path_buffer);
+        reverse_path(path_buffer, path_len);
+    } else {
+        log_info("No matching path found");
+    }
+
+    workspace_release(ws, ws_mark);
+
+    return path_len;
+}
+
+
+ssize_t DTWBD_f32(
+    float *s, size_t n,
+    float *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *window,
+    size_t *path_buffer,
+    double *path_distance,
+    const DTWBDOptions *options
+) {
+    if (!options) {
+        options = &DTWBD_DEFAULT_OPTIONS;
+    }
+
+    Workspace ws;
+    size_t cells_count = window ? band_cells_count(n, m, window) : n * m;
+    if (!workspace_init(&ws, band_matrix_workspace_size(n, m, cells_count, DTWBD_STORAGE_ROLLING))) {
+        return -1;
+    }
+
+    ssize_t path_len = dtwbd_f32_in_workspace(s, n, t, m, dim, skip_penalty, window, path_buffer, path_distance, options, &ws, NULL);
+
+    workspace_free(&ws);
+
+    return path_len;
+}
+
+
+static ssize_t fast_dtwbd_f32_in_workspace(
+    float *s, float *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats,
+    size_t depth
+) {
+    ssize_t path_len;
+    size_t min_sequence_len = 2 * (radius + 1) + 1;
+    DTWBDLevelStats *level = stats_level(stats, depth);
+    StatsMark mark;
+
+    if (n < min_sequence_len || m < min_sequence_len) {
+        stats_begin(level, ws, &mark);
+        path_len = dtwbd_f32_in_workspace(s, n, t, m, l, skip_penalty, NULL, path_buffer, path_distance, options, ws, level);
+        stats_end(level, ws, &mark);
+        return path_len;
+    }
+
+    size_t ws_mark = workspace_mark(ws);
+    stats_begin(level, ws, &mark);
+
+    float *coarsed_s = workspace_alloc(ws, n / 2 * l * sizeof(float));
+    float *coarsed_t = workspace_alloc(ws, m / 2 * l * sizeof(float));
+    if (!coarsed_s || !coarsed_t) {
+        log_error("Failed to allocate float32 coarsed sequences.");
+        stats_end(level, ws, &mark);
+        workspace_release(ws, ws_mark);
+        return -1;
+    }
+
+    coarse_sequence_f32(coarsed_s, s, n, l);
+    coarse_sequence_f32(coarsed_t, t, m, l);
+    stats_end(level, ws, &mark);
+
+    path_len = fast_dtwbd_f32_in_workspace(coarsed_s, coarsed_t, n / 2, m / 2, l, skip_penalty, radius, path_distance, path_buffer, options, ws, stats, depth + 1);
+
+    workspace_release(ws, ws_mark);
+
+    if (path_len > 0) {
+        stats_begin(level, ws, &mark);
+        size_t *window = workspace_alloc(ws, 2 * n * sizeof(size_t));
+        if (window) {
+            fill_window(window, n, m, path_buffer, path_len, radius);
+            path_len = dtwbd_f32_in_workspace(s, n, t, m, l, skip_penalty, window, path_buffer, path_distance, options, ws, level);
+        } else {
+            log_warn("Window creation failed.");
+            path_len = -1;
+        }
+        stats_end(level, ws, &mark);
+    } else {
+        log_warn("Recursive call returned an invalid path length.");
+    }
+
+    workspace_release(ws, ws_mark);
+
+    return path_len;
+}
+
+
+ssize_t FastDTWBD_f32(
+    float *s, float *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    DTWBDStats *stats
+) {
+    Workspace ws;
+    if (!workspace_init(&ws, FastDTWBD_f32_workspace_size(n, m, l, radius, options))) {
+        return -1;
+    }
+
+    ssize_t path_len = fast_dtwbd_f32_run(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer, options, &ws, stats);
+    workspace_free(&ws);
+
+    return path_len;
+}
+
+
+ssize_t fast_dtwbd_f32_run(
+    float *s, float *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats
+) {
+    if (!options) {
+        options = &DTWBD_DEFAULT_OPTIONS;
+    }
+    double start = stats ? stats_clock() : 0;
+    if (stats) {
+        stats->levels_count = 0;
+    }
+
+    ssize_t path_len = fast_dtwbd_f32_in_workspace(s, t, n, m, l, skip_penalty, radius, path_distance, path_buffer, options, ws, stats, 0);
+
+    if (stats) {
+        stats->workspace_size = ws->size;
+        stats->workspace_peak = ws->peak;
+        stats->seconds = stats_clock() - start;
+    }
+
+    return path_len;
+}
+
+
+// Same recursion as FastDTWBD_workspace_size() with float sequences and the rolling matrix
+size_t FastDTWBD_f32_workspace_size(size_t n, size_t m, size_t l, int radius, const DTWBDOptions *options) {
+    (void)options;
+
+    size_t min_sequence_len = 2 * (radius + 1) + 1;
+    size_t sequences_size = 0;
+    size_t peak = 0;
+
+    for (;;) {
+        if (n < min_sequence_len || m < min_sequence_len) {
+            size_t level_size = band_matrix_workspace_size(n, m, n * m, DTWBD_STORAGE_ROLLING);
+            return sequences_size + level_size > peak ? sequences_size + level_size : peak;
+        }
+
+        size_t level_size = workspace_block_size(2 * n * sizeof(size_t)) +
+                            band_matrix_workspace_size(n, m, get_max_window_cells(n, m, radius), DTWBD_STORAGE_ROLLING);
+        if (sequences_size + level_size > peak) {
+            peak = sequences_size + level_size;
+        }
+
+        sequences_size += workspace_block_size(n / 2 * l * sizeof(float)) +
+                          workspace_block_size(m / 2 * l * sizeof(float));
+        n /= 2;
+        m /= 2;
+    }
+}
+
+
+void coarse_sequence_f32(float *coarsed_sequence, float *s, size_t n, size_t l) {
+    for (size_t i = 0; 2 * i + 1 < n; i++) {
+        for (size_t j = 0; j < l; j++) {
+            coarsed_sequence[l * i + j] = (s[l * (2 * i) + j] + s[l * (2 * i + 1) + j]) / 2;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef DTWBD_F32_H
+#define DTWBD_F32_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "dtwbd.h"  // for EXPORT and DTWBDOptions
+#include "workspace.h"
+
+
+// Float32 versions of DTWBD() and FastDTWBD().
+// MFCCs, coarsed sequences and distances are float, accumulated distances are float
+// or double with options->accumulator = DTWBD_ACCUMULATOR_DOUBLE.
+// The matrix is always kept as in DTWBD_STORAGE_ROLLING and distances are computed directly,
+// other values of options->storage and options->distance are ignored.
+
+EXPORT ssize_t DTWBD_f32(
+    float *x, size_t n,
+    float *y, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *window,
+    size_t *path_buffer,
+    double *path_distance,
+    const DTWBDOptions *options
+);
+
+EXPORT ssize_t FastDTWBD_f32(
+    float *s,   // first sequence of MFCC frames – n x l contiguous array
+    float *t,   // second sequence of MFCC frames – m x l contiguous array
+    size_t n,   // number of frames in first sequence
+    size_t m,   // number of frames in second sequence
+    size_t l,   // number of MFCCs per frame
+    double skip_penalty,    // penalty for skipping one frame
+    int radius,             // radius of path projection
+    double *path_distance,  // place to store warping path distance
+    size_t *path_buffer,    // buffer to store resulting warping path – (n+m) x 2 contiguous array
+    const DTWBDOptions *options,    // optional parameters or NULL for the defaults
+    DTWBDStats *stats               // optional per-level counters filled during the run or NULL
+);
+
+// Number of bytes of the workspace FastDTWBD_f32() allocates for the given input
+EXPORT size_t FastDTWBD_f32_workspace_size(size_t n, size_t m, size_t l, int radius, const DTWBDOptions *options);
+
+// FastDTWBD_f32() in an empty workspace of at least FastDTWBD_f32_workspace_size() bytes owned by the caller
+ssize_t fast_dtwbd_f32_run(
+    float *s, float *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats
+);
+
+void coarse_sequence_f32(float *coarsed_sequence, float *s, size_t n, size_t l);
+
+#endif // DTWBD_F32_H
@@ -0,0 +1,1122 @@
+// CPython extension module exposing the C functions to c_dtwbd_wrapper.py.
+//
+// The MFCC sequences are taken through the buffer protocol without copying,
+// the GIL is released for the whole alignment and the path is returned
+// in a bytearray of its exact size, which the wrapper views as an (k, 2) uintp array.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+#include "dtwbd.h"
+#include "fastdtwbd.h"
+#include "dtwbd_f32.h"
+#include "aligner.h"
+#include "streaming_dtwbd.h"
+#include "distance.h"
+#include "mfcc.h"
+#include "logger.h"
+
+
+// Returns 'd' or 'f' for C-contiguous buffers of native doubles or floats, 0 otherwise
+static char sample_type(const Py_buffer *view) {
+    const char *format = view->format ? view->format : "B";
+    if (format[0] == '@' || format[0] == '=') {
+        format++;
+    }
+    if (strcmp(format, "d") == 0 && view->itemsize == sizeof(double)) {
+        return 'd';
+    }
+    if (strcmp(format, "f") == 0 && view->itemsize == sizeof(float)) {
+        return 'f';
+    }
+    return 0;
+}
+
+
+static int get_sequence(PyObject *obj, Py_buffer *view, const char *name) {
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        return -1;
+    }
+    if (view->ndim != 2) {
+        PyErr_Format(PyExc_ValueError, "%s must be a 2D array of frames, got %d dimensions", name, view->ndim);
+        PyBuffer_Release(view);
+        return -1;
+    }
+    if (!sample_type(view)) {
+        PyErr_Format(PyExc_TypeError, "%s must be an array of float64 or float32, got format '%s'",
+                     name, view->format ? view->format : "B");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+
+static PyObject *stats_to_dict(const DTWBDStats *stats) {
+    PyObject *levels = PyList_New(0);
+    if (!levels) {
+        return NULL;
+    }
+
+    for (size_t k = 0; k < stats->levels_count; k++) {
+        const DTWBDLevelStats *level = &stats->levels[k];
+        PyObject *item = Py_BuildValue(
+            "{s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:d,s:n,s:n}",
+            "n", (Py_ssize_t)level->n,
+            "m", (Py_ssize_t)level->m,
+            "window_cells", (Py_ssize_t)level->window_cells,
+            "min_row_cells", (Py_ssize_t)level->min_row_cells,
+            "max_row_cells", (Py_ssize_t)level->max_row_cells,
+            "cells_evaluated", (Py_ssize_t)level->cells_evaluated,
+            "distance_evaluations", (Py_ssize_t)level->distance_evaluations,
+            "seconds", level->seconds,
+            "bytes_allocated", (Py_ssize_t)level->bytes_allocated,
+            "peak_workspace", (Py_ssize_t)level->peak_workspace
+        );
+        if (!item || PyList_Append(levels, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(levels);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+
+    return Py_BuildValue(
+        "{s:N,s:n,s:n,s:d}",
+        "levels", levels,
+        "workspace_size", (Py_ssize_t)stats->workspace_size,
+        "workspace_peak", (Py_ssize_t)stats->workspace_peak,
+        "seconds", stats->seconds
+    );
+}
+
+
+// Aligns s and t with FastDTWBD() or FastDTWBD_f32() depending on their dtype, in the context if not NULL.
+// A dtype other than expected_type ('d' or 'f', 0 for either) raises TypeError.
+// Returns (path_distance, path, stats or None), path is None if the C function failed.
+static PyObject *align_sequences(
+    PyObject *s_obj, PyObject *t_obj,
+    char expected_type,
+    double skip_penalty, int radius,
+    const DTWBDOptions *options,
+    int return_stats,
+    Aligner *aligner
+) {
+    if (radius < 0) {
+        PyErr_SetString(PyExc_ValueError, "radius must not be negative");
+        return NULL;
+    }
+
+    Py_buffer s, t;
+    if (get_sequence(s_obj, &s, "s") < 0) {
+        return NULL;
+    }
+    if (get_sequence(t_obj, &t, "t") < 0) {
+        PyBuffer_Release(&s);
+        return NULL;
+    }
+
+    PyObject *path = NULL;
+    PyObject *stats_dict = NULL;
+    DTWBDStats *stats = NULL;
+    char type = sample_type(&s);
+    size_t n = (size_t)s.shape[0], m = (size_t)t.shape[0], l = (size_t)s.shape[1];
+
+    if (sample_type(&t) != type) {
+        PyErr_SetString(PyExc_TypeError, "s and t must have the same dtype");
+        goto done;
+    }
+    if (expected_type && type != expected_type) {
+        PyErr_Format(PyExc_TypeError, "s and t must be %s arrays, got %s",
+                     expected_type == 'd' ? "float64" : "float32", type == 'd' ? "float64" : "float32");
+        goto done;
+    }
+    if ((size_t)t.shape[1] != l) {
+        PyErr_Format(PyExc_ValueError, "s and t must have the same number of MFCCs, got %zd and %zd",
+                     s.shape[1], t.shape[1]);
+        goto done;
+    }
+
+    path = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)((n + m) * 2 * sizeof(size_t)));
+    if (!path) {
+        goto done;
+    }
+    if (return_stats && !aligner && !(stats = PyMem_Calloc(1, sizeof(DTWBDStats)))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    // Nobody else can see the bytearray yet, so it is filled without the GIL
+    size_t *path_buffer = (size_t *)PyByteArray_AS_STRING(path);
+    double path_distance = 0;
+    ssize_t path_len;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (aligner) {
+        path_len = type == 'd'
+            ? aligner_align(aligner, s.buf, t.buf, n, m, l, skip_penalty, radius, &path_distance, path_buffer)
+            : aligner_align_f32(aligner, s.buf, t.buf, n, m, l, skip_penalty, radius, &path_distance, path_buffer);
+    } else {
+        path_len = type == 'd'
+            ? FastDTWBD(s.buf, t.buf, n, m, l, skip_penalty, radius, &path_distance, path_buffer, options, stats)
+            : FastDTWBD_f32(s.buf, t.buf, n, m, l, skip_penalty, radius, &path_distance, path_buffer, options, stats);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (path_len < 0) {
+        Py_CLEAR(path);
+        Py_INCREF(Py_None);
+        path = Py_None;
+    } else if (PyByteArray_Resize(path, (Py_ssize_t)((size_t)path_len * 2 * sizeof(size_t))) < 0) {
+        goto done;
+    }
+
+    if (return_stats && path_len >= 0) {
+        stats_dict = stats_to_dict(aligner ? aligner_stats(aligner) : stats);
+        if (!stats_dict) {
+            goto done;
+        }
+    } else {
+        Py_INCREF(Py_None);
+        stats_dict = Py_None;
+    }
+
+    PyObject *result = Py_BuildValue("dNN", path_distance, path, stats_dict);
+    PyMem_Free(stats);
+    PyBuffer_Release(&s);
+    PyBuffer_Release(&t);
+    return result;
+
+done:
+    Py_XDECREF(path);
+    PyMem_Free(stats);
+    PyBuffer_Release(&s);
+    PyBuffer_Release(&t);
+    return NULL;
+}
+
+
+// fast_dtwbd(s, t, dtype, skip_penalty, radius,
+//            (storage, distance, accumulator, order, threads, prune, window, window_budget), return_stats)
+// dtype is 'd' for FastDTWBD() or 'f' for FastDTWBD_f32(), s and t must have it
+static PyObject *fast_dtwbd(PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *s_obj, *t_obj;
+    int dtype;  // format "C" stores the character as an int
+    double skip_penalty;
+    int radius;
+    DTWBDOptions options;
+    int return_stats;
+
+    if (!PyArg_ParseTuple(args, "OOCdi(iiiiiiii)p:fast_dtwbd", &s_obj, &t_obj, &dtype, &skip_penalty, &radius,
+                          &options.storage, &options.distance, &options.accumulator, &options.order,
+                          &options.threads, &options.prune, &options.window, &options.window_budget, &return_stats)) {
+        return NULL;
+    }
+    if (dtype != 'd' && dtype != 'f') {
+        PyErr_SetString(PyExc_ValueError, "dtype must be 'd' or 'f'");
+        return NULL;
+    }
+
+    return align_sequences(s_obj, t_obj, (char)dtype, skip_penalty, radius, &options, return_stats, NULL);
+}
+
+
+// Pyramid(s, radius) owns the coarsed levels of the float64 sequence s and keeps its buffer alive,
+// open_pyramid(path) maps a pyramid file. The frames of the sequence are exported as a read-only buffer.
+typedef struct {
+    PyObject_HEAD
+    DTWBDPyramid *pyramid;
+    Py_buffer s;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} PyramidObject;
+
+static void pyramid_set_shape(PyramidObject *self) {
+    self->shape[0] = (Py_ssize_t)dtwbd_pyramid_length(self->pyramid);
+    self->shape[1] = (Py_ssize_t)dtwbd_pyramid_dim(self->pyramid);
+    self->strides[0] = self->shape[1] * (Py_ssize_t)sizeof(double);
+    self->strides[1] = sizeof(double);
+}
+
+static PyObject *pyramid_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    PyObject *s_obj;
+    int radius;
+    static char *keywords[] = {"s", "radius", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi:Pyramid", keywords, &s_obj, &radius)) {
+        return NULL;
+    }
+    if (radius < 0) {
+        PyErr_SetString(PyExc_ValueError, "radius must not be negative");
+        return NULL;
+    }
+
+    PyramidObject *self = (PyramidObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        return NULL;
+    }
+    if (get_sequence(s_obj, &self->s, "s") < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    if (sample_type(&self->s) != 'd') {
+        PyErr_SetString(PyExc_TypeError, "s must be a float64 array");
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    self->pyramid = dtwbd_pyramid_create(self->s.buf, (size_t)self->s.shape[0], (size_t)self->s.shape[1], radius);
+    if (!self->pyramid) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    pyramid_set_shape(self);
+
+    return (PyObject *)self;
+}
+
+static void pyramid_dealloc(PyramidObject *self) {
+    dtwbd_pyramid_destroy(self->pyramid);
+    if (self->s.obj) {
+        PyBuffer_Release(&self->s);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// save(path) returns 0 on success and -1 on error
+static PyObject *pyramid_save(PyramidObject *self, PyObject *args) {
+    PyObject *path;
+    if (!PyArg_ParseTuple(args, "O&:save", PyUnicode_FSConverter, &path)) {
+        return NULL;
+    }
+
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = dtwbd_pyramid_save(self->pyramid, PyBytes_AS_STRING(path));
+    Py_END_ALLOW_THREADS
+    Py_DECREF(path);
+
+    return PyLong_FromLong(result);
+}
+
+static int pyramid_getbuffer(PyramidObject *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "the frames of a pyramid are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->buf = (void *)dtwbd_pyramid_level(self->pyramid, 0, 0);
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->len = self->shape[0] * self->strides[0];
+    view->readonly = 1;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) ? "d" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs pyramid_buffer = {
+    .bf_getbuffer = (getbufferproc)pyramid_getbuffer,
+};
+
+static PyObject *pyramid_length(PyramidObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(dtwbd_pyramid_length(self->pyramid));
+}
+
+static PyObject *pyramid_levels(PyramidObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(dtwbd_pyramid_levels(self->pyramid));
+}
+
+static PyObject *pyramid_memory(PyramidObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(dtwbd_pyramid_memory(self->pyramid));
+}
+
+static PyObject *pyramid_radius(PyramidObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromLong(dtwbd_pyramid_radius(self->pyramid));
+}
+
+static PyObject *pyramid_mapped(PyramidObject *self, void *closure) {
+    (void)closure;
+    return PyBool_FromLong(dtwbd_pyramid_is_mapped(self->pyramid));
+}
+
+static PyMethodDef pyramid_methods[] = {
+    {"save", (PyCFunction)pyramid_save, METH_VARARGS, "Runs dtwbd_pyramid_save()."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef pyramid_getset[] = {
+    {"length", (getter)pyramid_length, NULL, "Frames of the sequence.", NULL},
+    {"levels", (getter)pyramid_levels, NULL, "Levels of the pyramid including the sequence.", NULL},
+    {"radius", (getter)pyramid_radius, NULL, "Radius the levels are built for.", NULL},
+    {"memory", (getter)pyramid_memory, NULL, "Bytes of the coarsed levels.", NULL},
+    {"mapped", (getter)pyramid_mapped, NULL, "Whether the levels are mapped from a file.", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject PyramidType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "afaligner.c_modules.dtwbd.Pyramid",
+    .tp_doc = "Coarsed levels of an MFCC sequence shared by the alignments of its parts.",
+    .tp_basicsize = sizeof(PyramidObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = pyramid_new,
+    .tp_dealloc = (destructor)pyramid_dealloc,
+    .tp_as_buffer = &pyramid_buffer,
+    .tp_methods = pyramid_methods,
+    .tp_getset = pyramid_getset,
+};
+
+
+// open_pyramid(path) returns a Pyramid mapped from the file, None if it cannot be opened
+static PyObject *open_pyramid(PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *path;
+    if (!PyArg_ParseTuple(args, "O&:open_pyramid", PyUnicode_FSConverter, &path)) {
+        return NULL;
+    }
+
+    DTWBDPyramid *pyramid;
+    Py_BEGIN_ALLOW_THREADS
+    pyramid = dtwbd_pyramid_open(PyBytes_AS_STRING(path));
+    Py_END_ALLOW_THREADS
+    Py_DECREF(path);
+    if (!pyramid) {
+        Py_RETURN_NONE;
+    }
+
+    PyramidObject *result = (PyramidObject *)PyramidType.tp_alloc(&PyramidType, 0);
+    if (!result) {
+        dtwbd_pyramid_destroy(pyramid);
+        return NULL;
+    }
+    result->pyramid = pyramid;
+    pyramid_set_shape(result);
+
+    return (PyObject *)result;
+}
+
+
+// Aligner((storage, distance, accumulator, order, threads, prune, window, window_budget)) owns an aligner context,
+// its alignments release the GIL, so the object refuses calls while one is running
+typedef struct {
+    PyObject_HEAD
+    Aligner *aligner;
+    int busy;
+} AlignerObject;
+
+static PyObject *aligner_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    DTWBDOptions options;
+    static char *keywords[] = {"options", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "(iiiiiiii):Aligner", keywords,
+                                     &options.storage, &options.distance, &options.accumulator, &options.order,
+                                     &options.threads, &options.prune, &options.window, &options.window_budget)) {
+        return NULL;
+    }
+
+    AlignerObject *self = (AlignerObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        return NULL;
+    }
+    self->aligner = aligner_create(&options);
+    if (!self->aligner) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+
+    return (PyObject *)self;
+}
+
+static void aligner_dealloc(AlignerObject *self) {
+    aligner_destroy(self->aligner);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int aligner_check_idle(AlignerObject *self) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the aligner is used by another thread");
+        return -1;
+    }
+    return 0;
+}
+
+// align(s, t, skip_penalty, radius, return_stats)
+static PyObject *aligner_object_align(AlignerObject *self, PyObject *args) {
+    PyObject *s_obj, *t_obj;
+    double skip_penalty;
+    int radius;
+    int return_stats;
+
+    if (!PyArg_ParseTuple(args, "OOdip:align", &s_obj, &t_obj, &skip_penalty, &radius, &return_stats)) {
+        return NULL;
+    }
+    if (aligner_check_idle(self) < 0) {
+        return NULL;
+    }
+
+    self->busy = 1;
+    PyObject *result = align_sequences(s_obj, t_obj, 0, skip_penalty, radius, NULL, return_stats, self->aligner);
+    self->busy = 0;
+
+    return result;
+}
+
+// align_pyramid(s, s_offset, n, t, t_offset, m, skip_penalty, radius, return_stats) aligns parts of two Pyramid objects
+static PyObject *aligner_object_align_pyramid(AlignerObject *self, PyObject *args) {
+    PyramidObject *s, *t;
+    Py_ssize_t s_offset, n, t_offset, m;
+    double skip_penalty;
+    int radius;
+    int return_stats;
+
+    if (!PyArg_ParseTuple(args, "O!nnO!nndip:align_pyramid", &PyramidType, &s, &s_offset, &n,
+                          &PyramidType, &t, &t_offset, &m, &skip_penalty, &radius, &return_stats)) {
+        return NULL;
+    }
+    if (s_offset < 0 || n < 0 || t_offset < 0 || m < 0 ||
+        (size_t)s_offset + (size_t)n > dtwbd_pyramid_length(s->pyramid) ||
+        (size_t)t_offset + (size_t)m > dtwbd_pyramid_length(t->pyramid)) {
+        PyErr_SetString(PyExc_ValueError, "the parts are out of the pyramids");
+        return NULL;
+    }
+    if (radius < 0) {
+        PyErr_SetString(PyExc_ValueError, "radius must not be negative");
+        return NULL;
+    }
+    if (dtwbd_pyramid_dim(s->pyramid) != dtwbd_pyramid_dim(t->pyramid)) {
+        PyErr_SetString(PyExc_ValueError, "s and t must have the same number of MFCCs");
+        return NULL;
+    }
+    if (aligner_check_idle(self) < 0) {
+        return NULL;
+    }
+
+    PyObject *path = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)((size_t)(n + m) * 2 * sizeof(size_t)));
+    if (!path) {
+        return NULL;
+    }
+    size_t *path_buffer = (size_t *)PyByteArray_AS_STRING(path);
+    double path_distance = 0;
+    ssize_t path_len;
+
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    path_len = aligner_align_pyramid(self->aligner, s->pyramid, (size_t)s_offset, (size_t)n,
+                                     t->pyramid, (size_t)t_offset, (size_t)m,
+                                     skip_penalty, radius, &path_distance, path_buffer);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    if (path_len < 0) {
+        Py_DECREF(path);
+        return Py_BuildValue("dOO", path_distance, Py_None, Py_None);
+    }
+    if (PyByteArray_Resize(path, (Py_ssize_t)((size_t)path_len * 2 * sizeof(size_t))) < 0) {
+        Py_DECREF(path);
+        return NULL;
+    }
+
+    PyObject *stats_dict = Py_None;
+    if (return_stats) {
+        stats_dict = stats_to_dict(aligner_stats(self->aligner));
+        if (!stats_dict) {
+            Py_DECREF(path);
+            return NULL;
+        }
+    } else {
+        Py_INCREF(Py_None);
+    }
+
+    return Py_BuildValue("dNN", path_distance, path, stats_dict);
+}
+
+static PyObject *aligner_object_reset(AlignerObject *self, PyObject *args) {
+    (void)args;
+    if (aligner_check_idle(self) < 0) {
+        return NULL;
+    }
+    aligner_reset(self->aligner);
+    Py_RETURN_NONE;
+}
+
+static PyObject *aligner_object_set_log_level(AlignerObject *self, PyObject *args) {
+    int level;
+    if (!PyArg_ParseTuple(args, "i:set_log_level", &level)) {
+        return NULL;
+    }
+    if (aligner_check_idle(self) < 0) {
+        return NULL;
+    }
+    return PyLong_FromLong(aligner_set_log_level(self->aligner, level));
+}
+
+static PyObject *aligner_object_workspace_size(AlignerObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(aligner_workspace_size(self->aligner));
+}
+
+static PyMethodDef aligner_methods[] = {
+    {"align", (PyCFunction)aligner_object_align, METH_VARARGS, "Runs aligner_align() or aligner_align_f32() depending on the dtype."},
+    {"align_pyramid", (PyCFunction)aligner_object_align_pyramid, METH_VARARGS, "Runs aligner_align_pyramid()."},
+    {"reset", (PyCFunction)aligner_object_reset, METH_NOARGS, "Frees the workspace of the context."},
+    {"set_log_level", (PyCFunction)aligner_object_set_log_level, METH_VARARGS, "Sets the log level of the context, returns -1 if invalid."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef aligner_getset[] = {
+    {"workspace_size", (getter)aligner_object_workspace_size, NULL, "Bytes of the workspace held by the context.", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject AlignerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "afaligner.c_modules.dtwbd.Aligner",
+    .tp_doc = "Reusable context of FastDTWBD() alignments.",
+    .tp_basicsize = sizeof(AlignerObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = aligner_new,
+    .tp_dealloc = (destructor)aligner_dealloc,
+    .tp_methods = aligner_methods,
+    .tp_getset = aligner_getset,
+};
+
+
+// Stream(s, skip_penalty, radius, window) owns a streaming DTWBD engine for the float64 text sequence s
+typedef struct {
+    PyObject_HEAD
+    StreamingDTWBD *sd;
+    size_t l;
+    int busy;
+} StreamObject;
+
+static PyObject *stream_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    PyObject *s_obj;
+    double skip_penalty;
+    int radius;
+    Py_ssize_t window;
+    static char *keywords[] = {"s", "skip_penalty", "radius", "window", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Odin:Stream", keywords, &s_obj, &skip_penalty, &radius, &window)) {
+        return NULL;
+    }
+    if (radius < 0 || window <= 0) {
+        PyErr_SetString(PyExc_ValueError, "radius must not be negative and window must be positive");
+        return NULL;
+    }
+
+    Py_buffer s;
+    if (get_sequence(s_obj, &s, "s") < 0) {
+        return NULL;
+    }
+    if (sample_type(&s) != 'd' || s.shape[0] == 0) {
+        PyErr_SetString(PyExc_ValueError, "s must be a non-empty float64 array");
+        PyBuffer_Release(&s);
+        return NULL;
+    }
+
+    StreamObject *self = (StreamObject *)type->tp_alloc(type, 0);
+    if (self) {
+        self->l = (size_t)s.shape[1];
+        self->sd = streaming_dtwbd_create(s.buf, (size_t)s.shape[0], self->l, skip_penalty, radius, (size_t)window);
+        if (!self->sd) {
+            Py_CLEAR(self);
+            PyErr_NoMemory();
+        }
+    }
+    PyBuffer_Release(&s);
+
+    return (PyObject *)self;
+}
+
+static void stream_dealloc(StreamObject *self) {
+    streaming_dtwbd_destroy(self->sd);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// Returns a bytearray of cells for the next push of count frames, NULL if the stream is in use
+static PyObject *stream_path_buffer(StreamObject *self, size_t count) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the stream is used by another thread");
+        return NULL;
+    }
+    size_t cells = streaming_dtwbd_max_output(self->sd, count);
+    return PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)(cells * 2 * sizeof(size_t)));
+}
+
+// push(frames) returns the newly committed cells, None on error
+static PyObject *stream_push(StreamObject *self, PyObject *args) {
+    PyObject *frames_obj;
+    if (!PyArg_ParseTuple(args, "O:push", &frames_obj)) {
+        return NULL;
+    }
+
+    Py_buffer frames;
+    if (get_sequence(frames_obj, &frames, "frames") < 0) {
+        return NULL;
+    }
+    if (sample_type(&frames) != 'd' || (size_t)frames.shape[1] != self->l) {
+        PyErr_Format(PyExc_ValueError, "frames must be a float64 array of %zu MFCCs", self->l);
+        PyBuffer_Release(&frames);
+        return NULL;
+    }
+
+    size_t count = (size_t)frames.shape[0];
+    PyObject *path = stream_path_buffer(self, count);
+    if (!path) {
+        PyBuffer_Release(&frames);
+        return NULL;
+    }
+    size_t *path_buffer = (size_t *)PyByteArray_AS_STRING(path);
+    ssize_t path_len;
+
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    path_len = streaming_dtwbd_push(self->sd, frames.buf, count, path_buffer);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    PyBuffer_Release(&frames);
+
+    if (path_len < 0) {
+        Py_DECREF(path);
+        Py_RETURN_NONE;
+    }
+    if (PyByteArray_Resize(path, (Py_ssize_t)((size_t)path_len * 2 * sizeof(size_t))) < 0) {
+        Py_DECREF(path);
+        return NULL;
+    }
+
+    return path;
+}
+
+// finish() returns (path_distance, the rest of the path), the path is None on error
+static PyObject *stream_finish(StreamObject *self, PyObject *args) {
+    (void)args;
+    PyObject *path = stream_path_buffer(self, 0);
+    if (!path) {
+        return NULL;
+    }
+    double path_distance = 0;
+    ssize_t path_len = streaming_dtwbd_finish(self->sd, (size_t *)PyByteArray_AS_STRING(path), &path_distance);
+
+    if (path_len < 0) {
+        Py_DECREF(path);
+        Py_INCREF(Py_None);
+        path = Py_None;
+    } else if (PyByteArray_Resize(path, (Py_ssize_t)((size_t)path_len * 2 * sizeof(size_t))) < 0) {
+        Py_DECREF(path);
+        return NULL;
+    }
+
+    return Py_BuildValue("dN", path_distance, path);
+}
+
+static PyObject *stream_frames(StreamObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(streaming_dtwbd_frames(self->sd));
+}
+
+static PyObject *stream_memory(StreamObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(streaming_dtwbd_memory(self->sd));
+}
+
+static PyMethodDef stream_methods[] = {
+    {"push", (PyCFunction)stream_push, METH_VARARGS, "Runs streaming_dtwbd_push()."},
+    {"finish", (PyCFunction)stream_finish, METH_NOARGS, "Runs streaming_dtwbd_finish()."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef stream_getset[] = {
+    {"frames", (getter)stream_frames, NULL, "Audio frames pushed so far.", NULL},
+    {"memory", (getter)stream_memory, NULL, "Bytes held by the engine.", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject StreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "afaligner.c_modules.dtwbd.Stream",
+    .tp_doc = "Streaming DTWBD of a text sequence against audio frames pushed in chunks.",
+    .tp_basicsize = sizeof(StreamObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = stream_new,
+    .tp_dealloc = (destructor)stream_dealloc,
+    .tp_methods = stream_methods,
+    .tp_getset = stream_getset,
+};
+
+
+// MFCCStream(sample_rate, threads) computes the MFCC frames of int16 PCM pushed in chunks
+typedef struct {
+    PyObject_HEAD
+    MFCCStream *stream;
+    int busy;
+} MFCCStreamObject;
+
+static PyObject *mfcc_stream_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    Py_ssize_t sample_rate;
+    int threads;
+    static char *keywords[] = {"sample_rate", "threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ni:MFCCStream", keywords, &sample_rate, &threads)) {
+        return NULL;
+    }
+    if (sample_rate <= 0) {
+        PyErr_SetString(PyExc_ValueError, "sample_rate must be positive");
+        return NULL;
+    }
+
+    MFCCOptions options = MFCC_DEFAULT_OPTIONS;
+    options.sample_rate = (size_t)sample_rate;
+    MFCCStreamObject *self = (MFCCStreamObject *)type->tp_alloc(type, 0);
+    if (self && !(self->stream = mfcc_stream_create(&options, threads))) {
+        Py_CLEAR(self);
+        PyErr_SetString(PyExc_ValueError, "invalid MFCC options, see stderr for more details");
+    }
+
+    return (PyObject *)self;
+}
+
+static void mfcc_stream_dealloc(MFCCStreamObject *self) {
+    mfcc_stream_destroy(self->stream);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// Runs push (samples != NULL) or finish, returns the frames in a bytearray or None on error
+static PyObject *mfcc_stream_run(MFCCStreamObject *self, const int16_t *samples, size_t count) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "the stream is used by another thread");
+        return NULL;
+    }
+    size_t values = mfcc_stream_max_frames(self->stream, count) * mfcc_stream_dim(self->stream);
+    PyObject *frames = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)(values * sizeof(double)));
+    if (!frames) {
+        return NULL;
+    }
+    double *frames_buffer = (double *)PyByteArray_AS_STRING(frames);
+    ssize_t frames_count;
+
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    frames_count = samples
+        ? mfcc_stream_push_pcm16(self->stream, samples, count, frames_buffer)
+        : mfcc_stream_finish(self->stream, frames_buffer);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    if (frames_count < 0) {
+        Py_DECREF(frames);
+        Py_RETURN_NONE;
+    }
+    size_t size = (size_t)frames_count * mfcc_stream_dim(self->stream) * sizeof(double);
+    if (PyByteArray_Resize(frames, (Py_ssize_t)size) < 0) {
+        Py_DECREF(frames);
+        return NULL;
+    }
+    return frames;
+}
+
+// push(samples) takes a 1D buffer of int16
+static PyObject *mfcc_stream_push(MFCCStreamObject *self, PyObject *args) {
+    PyObject *samples_obj;
+    if (!PyArg_ParseTuple(args, "O:push", &samples_obj)) {
+        return NULL;
+    }
+
+    Py_buffer samples;
+    if (PyObject_GetBuffer(samples_obj, &samples, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        return NULL;
+    }
+    const char *format = samples.format ? samples.format : "B";
+    if (format[0] == '@' || format[0] == '=') {
+        format++;
+    }
+    if (samples.ndim != 1 || strcmp(format, "h") != 0 || samples.itemsize != sizeof(int16_t)) {
+        PyErr_SetString(PyExc_TypeError, "samples must be a 1D array of int16");
+        PyBuffer_Release(&samples);
+        return NULL;
+    }
+
+    PyObject *frames = mfcc_stream_run(self, samples.buf, (size_t)samples.shape[0]);
+    PyBuffer_Release(&samples);
+    return frames;
+}
+
+static PyObject *mfcc_stream_finish_method(MFCCStreamObject *self, PyObject *args) {
+    (void)args;
+    return mfcc_stream_run(self, NULL, 0);
+}
+
+static PyObject *mfcc_stream_memory_getter(MFCCStreamObject *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(mfcc_stream_memory(self->stream));
+}
+
+static PyMethodDef mfcc_stream_methods[] = {
+    {"push", (PyCFunction)mfcc_stream_push, METH_VARARGS, "Runs mfcc_stream_push_pcm16()."},
+    {"finish", (PyCFunction)mfcc_stream_finish_method, METH_NOARGS, "Runs mfcc_stream_finish()."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef mfcc_stream_getset[] = {
+    {"memory", (getter)mfcc_stream_memory_getter, NULL, "Bytes of the buffer of pending samples.", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject MFCCStreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "afaligner.c_modules.dtwbd.MFCCStream",
+    .tp_doc = "Incremental MFCC computation of int16 PCM pushed in chunks.",
+    .tp_basicsize = sizeof(MFCCStreamObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = mfcc_stream_new,
+    .tp_dealloc = (destructor)mfcc_stream_dealloc,
+    .tp_methods = mfcc_stream_methods,
+    .tp_getset = mfcc_stream_getset,
+};
+
+
+// workspace_size(n, m, l, radius,
+//                (storage, distance, accumulator, order, threads, prune, window, window_budget), float32)
+static PyObject *workspace_size(PyObject *self, PyObject *args) {
+    (void)self;
+    Py_ssize_t n, m, l;
+    int radius;
+    DTWBDOptions options;
+    int float32;
+
+    if (!PyArg_ParseTuple(args, "nnni(iiiiiiii)p:workspace_size", &n, &m, &l, &radius,
+                          &options.storage, &options.distance, &options.accumulator, &options.order,
+                          &options.threads, &options.prune, &options.window, &options.window_budget, &float32)) {
+        return NULL;
+    }
+    if (n < 0 || m < 0 || l < 0) {
+        PyErr_SetString(PyExc_ValueError, "sizes must not be negative");
+        return NULL;
+    }
+
+    size_t size = float32
+        ? FastDTWBD_f32_workspace_size((size_t)n, (size_t)m, (size_t)l, radius, &options)
+        : FastDTWBD_workspace_size((size_t)n, (size_t)m, (size_t)l, radius, &options);
+
+    return PyLong_FromSize_t(size);
+}
+
+
+// mfcc(samples, sample_rate, threads) returns the MFCC frames of mono float64 or int16 samples in a bytearray,
+// None if the C function failed
+static PyObject *py_mfcc(PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *samples_obj;
+    Py_ssize_t sample_rate;
+    int threads;
+
+    if (!PyArg_ParseTuple(args, "Oni:mfcc", &samples_obj, &sample_rate, &threads)) {
+        return NULL;
+    }
+    if (sample_rate <= 0) {
+        PyErr_SetString(PyExc_ValueError, "sample_rate must be positive");
+        return NULL;
+    }
+
+    Py_buffer samples;
+    if (PyObject_GetBuffer(samples_obj, &samples, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        return NULL;
+    }
+    const char *format = samples.format ? samples.format : "B";
+    if (format[0] == '@' || format[0] == '=') {
+        format++;
+    }
+    bool pcm16 = strcmp(format, "h") == 0 && samples.itemsize == sizeof(int16_t);
+    if (samples.ndim != 1 || (!pcm16 && !(strcmp(format, "d") == 0 && samples.itemsize == sizeof(double)))) {
+        PyErr_SetString(PyExc_TypeError, "samples must be a 1D array of float64 or int16");
+        PyBuffer_Release(&samples);
+        return NULL;
+    }
+
+    MFCCOptions options = MFCC_DEFAULT_OPTIONS;
+    options.sample_rate = (size_t)sample_rate;
+    MFCCPlan *plan = mfcc_plan_create(&options);
+    if (!plan) {
+        PyBuffer_Release(&samples);
+        Py_RETURN_NONE;
+    }
+
+    size_t samples_count = (size_t)samples.shape[0];
+    size_t values = mfcc_frames_count(plan, samples_count) * mfcc_plan_dim(plan);
+    PyObject *frames = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)(values * sizeof(double)));
+    if (!frames) {
+        mfcc_plan_destroy(plan);
+        PyBuffer_Release(&samples);
+        return NULL;
+    }
+
+    ssize_t frames_count;
+    double *frames_buffer = (double *)PyByteArray_AS_STRING(frames);
+    Py_BEGIN_ALLOW_THREADS
+    frames_count = pcm16
+        ? mfcc_compute_pcm16(plan, samples.buf, samples_count, threads, frames_buffer)
+        : mfcc_compute(plan, samples.buf, samples_count, threads, frames_buffer);
+    Py_END_ALLOW_THREADS
+    mfcc_plan_destroy(plan);
+    PyBuffer_Release(&samples);
+
+    if (frames_count < 0) {
+        Py_DECREF(frames);
+        Py_RETURN_NONE;
+    }
+    return frames;
+}
+
+
+static PyObject *py_set_distance_kernel(PyObject *self, PyObject *args) {
+    (void)self;
+    const char *name;
+    if (!PyArg_ParseTuple(args, "s:set_distance_kernel", &name)) {
+        return NULL;
+    }
+    return PyLong_FromLong(set_distance_kernel(name));
+}
+
+static PyObject *py_get_distance_kernel(PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    return PyUnicode_FromString(get_distance_kernel());
+}
+
+
+static PyObject *py_log_set_level(PyObject *self, PyObject *args) {
+    (void)self;
+    int level;
+    if (!PyArg_ParseTuple(args, "i:log_set_level", &level)) {
+        return NULL;
+    }
+    return PyLong_FromLong(log_set_level(level));
+}
+
+static PyObject *py_log_get_level(PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    return PyLong_FromLong(log_get_level());
+}
+
+// log_set_file(path or None)
+static PyObject *py_log_set_file(PyObject *self, PyObject *args) {
+    (void)self;
+    PyObject *path_obj;
+    if (!PyArg_ParseTuple(args, "O:log_set_file", &path_obj)) {
+        return NULL;
+    }
+
+    PyObject *path = NULL;
+    if (path_obj != Py_None && !PyUnicode_FSConverter(path_obj, &path)) {
+        return NULL;
+    }
+    const char *c_path = path ? PyBytes_AS_STRING(path) : NULL;
+    int status;
+
+    Py_BEGIN_ALLOW_THREADS
+    status = log_set_file(c_path);
+    Py_END_ALLOW_THREADS
+
+    Py_XDECREF(path);
+    return PyLong_FromLong(status);
+}
+
+static PyObject *py_log_get_file(PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    const char *path = log_get_file();
+    if (!path[0]) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_DecodeFSDefault(path);
+}
+
+static PyObject *py_log_flush(PyObject *self, PyObject *args) {
+    (void)self;
+    (void)args;
+    Py_BEGIN_ALLOW_THREADS
+    log_flush();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef dtwbd_methods[] = {
+    {"fast_dtwbd", fast_dtwbd, METH_VARARGS, "Runs FastDTWBD() or FastDTWBD_f32() depending on the dtype."},
+    {"workspace_size", workspace_size, METH_VARARGS, "Returns the workspace size of FastDTWBD() or FastDTWBD_f32()."},
+    {"open_pyramid", open_pyramid, METH_VARARGS, "Maps a pyramid file, returns None if it cannot be opened."},
+    {"mfcc", py_mfcc, METH_VARARGS, "Runs mfcc_compute() or mfcc_compute_pcm16() depending on the dtype."},
+    {"set_distance_kernel", py_set_distance_kernel, METH_VARARGS, "Selects the distance kernel, returns -1 if unknown."},
+    {"get_distance_kernel", py_get_distance_kernel, METH_NOARGS, "Returns the name of the distance kernel."},
+    {"log_set_level", py_log_set_level, METH_VARARGS, "Sets the runtime log level, returns -1 if invalid."},
+    {"log_get_level", py_log_get_level, METH_NOARGS, "Returns the runtime log level."},
+    {"log_set_file", py_log_set_file, METH_VARARGS, "Sets the log file, None discards messages."},
+    {"log_get_file", py_log_get_file, METH_NOARGS, "Returns the log file or None."},
+    {"log_flush", py_log_flush, METH_NOARGS, "Writes the queued log messages."},
+    {NULL, NULL, 0, NULL},
+};
+
+static struct PyModuleDef dtwbd_module = {
+    PyModuleDef_HEAD_INIT,
+    "dtwbd",
+    "C implementation of DTWBD and FastDTWBD.",
+    -1,
+    dtwbd_methods,
+    NULL, NULL, NULL, NULL,
+};
+
+PyMODINIT_FUNC PyInit_dtwbd(void) {
+    if (PyType_Ready(&PyramidType) < 0 || PyType_Ready(&AlignerType) < 0 || PyType_Ready(&StreamType) < 0 ||
+        PyType_Ready(&MFCCStreamType) < 0) {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&dtwbd_module);
+    if (!module) {
+        return NULL;
+    }
+
+    Py_INCREF(&PyramidType);
+    if (PyModule_AddObject(module, "Pyramid", (PyObject *)&PyramidType) < 0) {
+        Py_DECREF(&PyramidType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    Py_INCREF(&AlignerType);
+    if (PyModule_AddObject(module, "Aligner", (PyObject *)&AlignerType) < 0) {
+        Py_DECREF(&AlignerType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    Py_INCREF(&StreamType);
+    if (PyModule_AddObject(module, "Stream", (PyObject *)&StreamType) < 0) {
+        Py_DECREF(&StreamType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    Py_INCREF(&MFCCStreamType);
+    if (PyModule_AddObject(module, "MFCCStream", (PyObject *)&MFCCStreamType) < 0) {
+        Py_DECREF(&MFCCStreamType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    return module;
+}
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dtwbd_pyramid.h"
+#include "fastdtwbd.h"
+#include "logger.h"
+
+#if !defined(_WIN32) && !defined(__WIN32__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PYRAMID_USE_MMAP
+#endif
+
+
+#define PYRAMID_MAX_LEVELS 64
+#define PYRAMID_FILE_MAGIC "AFPYRAMD"
+#define PYRAMID_FILE_BYTE_ORDER 0x01020304u
+#define PYRAMID_FILE_FLOAT64 1u
+
+
+struct DTWBDPyramid {
+    size_t n;
+    size_t l;
+    int radius;
+    size_t levels_count;
+    const double *levels[PYRAMID_MAX_LEVELS];
+    double *coarsed;    // all the levels but the first one when built in memory
+    void *mapping;      // the whole file when opened
+    size_t mapping_size;
+    size_t memory;
+};
+
+
+// Header of a pyramid file, followed by the levels at the given offsets
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t dtype;
+    uint32_t levels_count;
+    uint64_t n;
+    uint64_t l;
+    int64_t radius;
+    uint64_t file_size;
+    uint64_t level_offsets[PYRAMID_MAX_LEVELS];
+} PyramidFileHeader;
+
+
+static size_t align_up(size_t size) {
+    return (size + DTWBD_PYRAMID_FILE_ALIGNMENT - 1) / DTWBD_PYRAMID_FILE_ALIGNMENT * DTWBD_PYRAMID_FILE_ALIGNMENT;
+}
+
+
+DTWBDPyramid *dtwbd_pyramid_create(const double *s, size_t n, size_t l, int radius) {
+    size_t min_sequence_len = 2 * (radius + 1) + 1;
+
+    // Same condition as the recursion of FastDTWBD(): a level is coarsened if it is not a base case
+    size_t levels_count = 1, frames = 0;
+    for (size_t len = n; len >= min_sequence_len && levels_count < PYRAMID_MAX_LEVELS; len /= 2) {
+        frames += len / 2;
+        levels_count++;
+    }
+
+    DTWBDPyramid *pyramid = calloc(1, sizeof(DTWBDPyramid));
+    double *coarsed = frames ? malloc(frames * l * sizeof(double)) : NULL;
+    if (!pyramid || (frames && !coarsed)) {
+        log_error("[DTWBDPyramid] Failed to allocate %zu coarsed frames.", frames);
+        free(pyramid);
+        free(coarsed);
+        return NULL;
+    }
+
+    pyramid->n = n;
+    pyramid->l = l;
+    pyramid->radius = radius;
+    pyramid->levels_count = levels_count;
+    pyramid->levels[0] = s;
+    pyramid->coarsed = coarsed;
+    pyramid->memory = frames * l * sizeof(double);
+
+    double *level = coarsed;
+    for (size_t k = 1, len = n; k < levels_count; k++, len /= 2) {
+        coarse_sequence(level, (double *)pyramid->levels[k - 1], len, l);
+        pyramid->levels[k] = level;
+        level += len / 2 * l;
+    }
+
+    log_debug("[DTWBDPyramid] Built %zu levels of %zu frames.", levels_count, n);
+    return pyramid;
+}
+
+void dtwbd_pyramid_destroy(DTWBDPyramid *pyramid) {
+    if (!pyramid) {
+        return;
+    }
+#ifdef PYRAMID_USE_MMAP
+    if (pyramid->mapping) {
+        munmap(pyramid->mapping, pyramid->mapping_size);
+    }
+#else
+    free(pyramid->mapping);
+#endif
+    free(pyramid->coarsed);
+    free(pyramid);
+}
+
+
+int dtwbd_pyramid_save(const DTWBDPyramid *pyramid, const char *path) {
+    PyramidFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PYRAMID_FILE_MAGIC, sizeof(header.magic));
+    header.version = DTWBD_PYRAMID_FILE_VERSION;
+    header.byte_order = PYRAMID_FILE_BYTE_ORDER;
+    header.dtype = PYRAMID_FILE_FLOAT64;
+    header.levels_count = (uint32_t)pyramid->levels_count;
+    header.n = pyramid->n;
+    header.l = pyramid->l;
+    header.radius = pyramid->radius;
+
+    size_t offset = align_up(sizeof(header));
+    for (size_t k = 0; k < pyramid->levels_count; k++) {
+        header.level_offsets[k] = offset;
+        offset = align_up(offset + (pyramid->n >> k) * pyramid->l * sizeof(double));
+    }
+    header.file_size = offset;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        log_error("[DTWBDPyramid] Failed to open %s for writing.", path);
+        return -1;
+    }
+
+    static const char padding[DTWBD_PYRAMID_FILE_ALIGNMENT];
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    size_t written = sizeof(header);
+    for (size_t k = 0; ok && k < pyramid->levels_count; k++) {
+        size_t level_size = (pyramid->n >> k) * pyramid->l * sizeof(double);
+        ok = fwrite(padding, 1, header.level_offsets[k] - written, file) == header.level_offsets[k] - written &&
+             fwrite(pyramid->levels[k], 1, level_size, file) == level_size;
+        written = header.level_offsets[k] + level_size;
+    }
+    ok = ok && fwrite(padding, 1, header.file_size - written, file) == header.file_size - written;
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok) {
+        log_error("[DTWBDPyramid] Failed to write %s.", path);
+        remove(path);
+        return -1;
+    }
+
+    log_debug("[DTWBDPyramid] Saved %zu levels of %zu frames to %s.", pyramid->levels_count, pyramid->n, path);
+    return 0;
+}
+
+
+// Maps or reads the whole file, returns NULL on error
+static void *load_file(const char *path, size_t *size) {
+#ifdef PYRAMID_USE_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *mapping = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = (size_t)st.st_size;
+        mapping = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = NULL;
+        }
+    }
+    close(fd);
+    return mapping;
+#else
+    // No mmap, the file is read into memory
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    void *data = NULL;
+    long file_size;
+    if (fseek(file, 0, SEEK_END) == 0 && (file_size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        *size = (size_t)file_size;
+        data = malloc(*size);
+        if (data && fread(data, 1, *size, file) != *size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+#endif
+}
+
+static bool valid_header(const PyramidFileHeader *header, size_t size) {
+    if (size < sizeof(PyramidFileHeader) ||
+        memcmp(header->magic, PYRAMID_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        log_error("[DTWBDPyramid] Not a pyramid file.");
+        return false;
+    }
+    if (header->version != DTWBD_PYRAMID_FILE_VERSION || header->byte_order != PYRAMID_FILE_BYTE_ORDER ||
+        header->dtype != PYRAMID_FILE_FLOAT64) {
+        log_error("[DTWBDPyramid] Unsupported pyramid file version %u, byte order or dtype.", header->version);
+        return false;
+    }
+    if (header->file_size != size || header->levels_count == 0 || header->levels_count > PYRAMID_MAX_LEVELS ||
+        header->l == 0 || header->n > size / sizeof(double) / header->l) {
+        log_error("[DTWBDPyramid] Corrupted pyramid file header.");
+        return false;
+    }
+    for (size_t k = 0; k < header->levels_count; k++) {
+        uint64_t offset = header->level_offsets[k];
+        if (offset % DTWBD_PYRAMID_FILE_ALIGNMENT || offset < sizeof(PyramidFileHeader) || offset > size ||
+            (header->n >> k) * header->l * sizeof(double) > size - offset) {
+            log_error("[DTWBDPyramid] Level %zu is out of the pyramid file.", k);
+            return false;
+        }
+    }
+    return true;
+}
+
+DTWBDPyramid *dtwbd_pyramid_open(const char *path) {
+    size_t size = 0;
+    void *mapping = load_file(path, &size);
+    if (!mapping) {
+        log_error("[DTWBDPyramid] Failed to open %s.", path);
+        return NULL;
+    }
+
+    const PyramidFileHeader *header = mapping;
+    DTWBDPyramid *pyramid = NULL;
+    if (!valid_header(header, size) || !(pyramid = calloc(1, sizeof(DTWBDPyramid)))) {
+#ifdef PYRAMID_USE_MMAP
+        munmap(mapping, size);
+#else
+        free(mapping);
+#endif
+        return NULL;
+    }
+
+    pyramid->n = header->n;
+    pyramid->l = header->l;
+    pyramid->radius = (int)header->radius;
+    pyramid->levels_count = header->levels_count;
+    pyramid->mapping = mapping;
+    pyramid->mapping_size = size;
+    for (size_t k = 0; k < pyramid->levels_count; k++) {
+        pyramid->levels[k] = (const double *)((const char *)mapping + header->level_offsets[k]);
+        if (k > 0) {
+            pyramid->memory += (pyramid->n >> k) * pyramid->l * sizeof(double);
+        }
+    }
+
+    log_debug("[DTWBDPyramid] Opened %zu levels of %zu frames from %s.", pyramid->levels_count, pyramid->n, path);
+    return pyramid;
+}
+
+
+size_t dtwbd_pyramid_length(const DTWBDPyramid *pyramid) {
+    return pyramid->n;
+}
+
+size_t dtwbd_pyramid_dim(const DTWBDPyramid *pyramid) {
+    return pyramid->l;
+}
+
+size_t dtwbd_pyramid_levels(const DTWBDPyramid *pyramid) {
+    return pyramid->levels_count;
+}
+
+int dtwbd_pyramid_radius(const DTWBDPyramid *pyramid) {
+    return pyramid->radius;
+}
+
+size_t dtwbd_pyramid_memory(const DTWBDPyramid *pyramid) {
+    return pyramid->memory;
+}
+
+bool dtwbd_pyramid_is_mapped(const DTWBDPyramid *pyramid) {
+    return pyramid->mapping != NULL;
+}
+
+const double *dtwbd_pyramid_level(const DTWBDPyramid *pyramid, size_t k, size_t offset) {
+    if (!pyramid || k >= pyramid->levels_count) {
+        return NULL;
+    }
+    return pyramid->levels[k] + (offset >> k) * pyramid->l;
+}
@@ -0,0 +1,51 @@
+#ifndef DTWBD_PYRAMID_H
+#define DTWBD_PYRAMID_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "dtwbd.h"  // for EXPORT, DTWBDOptions and DTWBDStats
+
+
+// Coarsened levels of an MFCC sequence built once and shared by the FastDTWBD() calls on its parts.
+// Level 0 is the sequence itself, which is not copied and must outlive the pyramid unless it is opened from a file,
+// level k + 1 averages the pairs of frames of level k as coarse_sequence() does.
+// Levels are built while the previous one is long enough for the recursion of FastDTWBD() with radius.
+typedef struct DTWBDPyramid DTWBDPyramid;
+
+// Pyramid files hold a header and all the levels of a pyramid, each level is a contiguous n >> k x l
+// array of native float64 starting at a multiple of DTWBD_PYRAMID_FILE_ALIGNMENT bytes.
+// The header stores the version, the byte order, the dtype, n, l, the radius and the offsets of the levels,
+// files of another version, byte order or dtype are rejected.
+#define DTWBD_PYRAMID_FILE_VERSION 1
+#define DTWBD_PYRAMID_FILE_ALIGNMENT 64
+
+// Returns NULL if out of memory
+EXPORT DTWBDPyramid *dtwbd_pyramid_create(const double *s, size_t n, size_t l, int radius);
+
+// Maps a pyramid file read-only, the levels are read from the page cache without copying.
+// Returns NULL if the file cannot be mapped or is not a valid pyramid file.
+EXPORT DTWBDPyramid *dtwbd_pyramid_open(const char *path);
+
+// Writes all the levels to a pyramid file, returns 0 on success and -1 on error
+EXPORT int dtwbd_pyramid_save(const DTWBDPyramid *pyramid, const char *path);
+
+EXPORT void dtwbd_pyramid_destroy(DTWBDPyramid *pyramid);
+
+EXPORT size_t dtwbd_pyramid_length(const DTWBDPyramid *pyramid);
+EXPORT size_t dtwbd_pyramid_dim(const DTWBDPyramid *pyramid);
+EXPORT size_t dtwbd_pyramid_levels(const DTWBDPyramid *pyramid);
+EXPORT int dtwbd_pyramid_radius(const DTWBDPyramid *pyramid);
+
+// Bytes of the coarsened levels
+EXPORT size_t dtwbd_pyramid_memory(const DTWBDPyramid *pyramid);
+
+// Whether the levels are mapped from a file
+EXPORT bool dtwbd_pyramid_is_mapped(const DTWBDPyramid *pyramid);
+
+// Frames of the part of the pyramid starting at offset at level k, NULL if the level is not built.
+// Offsets are halved at every level, so for an odd offset the first coarse frame also averages the frame before it.
+const double *dtwbd_pyramid_level(const DTWBDPyramid *pyramid, size_t k, size_t offset);
+
+#endif // DTWBD_PYRAMID_H
@@ -0,0 +1,78 @@
+#include "dtwbd_stats.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+
+double stats_clock(void) {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+DTWBDLevelStats *stats_level(DTWBDStats *stats, size_t depth) {
+    if (!stats || depth >= DTWBD_STATS_MAX_LEVELS) {
+        return NULL;
+    }
+
+    if (depth >= stats->levels_count) {
+        memset(&stats->levels[depth], 0, sizeof(DTWBDLevelStats));
+        stats->levels_count = depth + 1;
+    }
+
+    return &stats->levels[depth];
+}
+
+void stats_begin(const DTWBDLevelStats *level, Workspace *ws, StatsMark *mark) {
+    if (!level) {
+        return;
+    }
+
+    mark->start = stats_clock();
+    mark->allocated = ws->allocated;
+    // The peak of the level is measured from the current usage and merged back in stats_end()
+    mark->peak = ws->peak;
+    ws->peak = ws->used;
+}
+
+void stats_end(DTWBDLevelStats *level, Workspace *ws, const StatsMark *mark) {
+    if (!level) {
+        return;
+    }
+
+    level->seconds += stats_clock() - mark->start;
+    level->bytes_allocated += ws->allocated - mark->allocated;
+    if (ws->peak > level->peak_workspace) {
+        level->peak_workspace = ws->peak;
+    }
+    if (mark->peak > ws->peak) {
+        ws->peak = mark->peak;
+    }
+}
+
+void stats_window(DTWBDLevelStats *level, size_t n, size_t m, const size_t *offsets) {
+    if (!level) {
+        return;
+    }
+
+    level->n = n;
+    level->m = m;
+    if (!offsets) {
+        level->window_cells = n * m;
+        level->min_row_cells = level->max_row_cells = n > 0 ? m : 0;
+        return;
+    }
+
+    level->window_cells = offsets[n];
+    level->min_row_cells = n > 0 ? SIZE_MAX : 0;
+    level->max_row_cells = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t row_cells = offsets[i + 1] - offsets[i];
+        if (row_cells < level->min_row_cells) level->min_row_cells = row_cells;
+        if (row_cells > level->max_row_cells) level->max_row_cells = row_cells;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef DTWBD_STATS_H
+#define DTWBD_STATS_H
+
+#include <stdlib.h>
+#include "dtwbd.h"
+#include "workspace.h"
+
+
+// State saved when a part of a level starts, the parts of a level are around its recursive call
+typedef struct {
+    double start;
+    size_t allocated;
+    size_t peak;
+} StatsMark;
+
+
+double stats_clock(void);
+
+// Returns the counters of the level at depth (0 is the finest) or NULL when stats are not collected
+DTWBDLevelStats *stats_level(DTWBDStats *stats, size_t depth);
+
+// Adds the time, allocations and workspace peak between the two calls to the level, which may be NULL
+void stats_begin(const DTWBDLevelStats *level, Workspace *ws, StatsMark *mark);
+void stats_end(DTWBDLevelStats *level, Workspace *ws, const StatsMark *mark);
+
+// Records the sizes of the sequences and of the window given by the row offsets of a band matrix, NULL for full rows
+void stats_window(DTWBDLevelStats *level, size_t n, size_t m, const size_t *offsets);
+
+#endif
@@ -6,6 +6,8 @@
 #include <math.h>
 #include <stddef.h>
 #include "dtwbd.h"  // Including dtwbd.h for shared structures and functions
+#include "workspace.h"
+#include "dtwbd_pyramid.h"
 
 #if defined(_WIN32) || defined(__WIN32__)
     #ifdef BUILDING_FASTDTWBD
@@ -22,6 +24,12 @@
 #endif
 
 
+// Smallest radius of the adaptive window, the radius if it is smaller
+#define ADAPTIVE_MIN_RADIUS 8
+
+// A row or a column of the coarse level whose distance to the path cell is within this fraction
+// of the distance of the path cell makes the cell ambiguous up to it
+#define ADAPTIVE_MARGIN 0.25
 
 // FastDTWBD function prototype (make sure it's marked with EXPORT)
 EXPORT ssize_t FastDTWBD(
@@ -33,12 +41,63 @@ EXPORT ssize_t FastDTWBD(
     double skip_penalty,    // penalty for skipping one frame
     int radius,             // radius of path projection
     double *path_distance,  // place to store warping path distance
-    size_t *path_buffer     // buffer to store resulting warping path – (n+m) x 2 contiguous array
+    size_t *path_buffer,    // buffer to store resulting warping path – (n+m) x 2 contiguous array
+    const DTWBDOptions *options,    // optional parameters or NULL for the defaults
+    DTWBDStats *stats               // optional per-level counters filled during the run or NULL
+);
+
+// Number of bytes of the workspace FastDTWBD() allocates for the given input, i.e. its peak memory usage
+EXPORT size_t FastDTWBD_workspace_size(size_t n, size_t m, size_t l, int radius, const DTWBDOptions *options);
+
+// FastDTWBD() in an empty workspace of at least FastDTWBD_workspace_size() bytes owned by the caller
+ssize_t fast_dtwbd_run(
+    double *s, double *t,
+    size_t n, size_t m,
+    size_t l,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats
+);
+
+// FastDTWBD() of the parts [s_offset, s_offset + n) and [t_offset, t_offset + m) of two pyramids.
+// The coarsed levels are taken from the pyramids instead of being built, so repeated calls on the tails
+// of the same sequences only pay for the windows. The finest level is exact, for odd offsets the coarser ones
+// may average one frame before the part, which only moves the projected windows.
+// Returns -1 if the parts are out of the pyramids or the pyramids have a different number of MFCCs.
+EXPORT ssize_t FastDTWBD_pyramid(
+    const DTWBDPyramid *s, size_t s_offset, size_t n,
+    const DTWBDPyramid *t, size_t t_offset, size_t m,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    DTWBDStats *stats
+);
+
+// FastDTWBD_pyramid() in a workspace of at least FastDTWBD_workspace_size() bytes owned by the caller
+ssize_t fast_dtwbd_pyramid_run(
+    const DTWBDPyramid *s, size_t s_offset, size_t n,
+    const DTWBDPyramid *t, size_t t_offset, size_t m,
+    double skip_penalty,
+    int radius,
+    double *path_distance,
+    size_t *path_buffer,
+    const DTWBDOptions *options,
+    Workspace *ws,
+    DTWBDStats *stats
 );
 
 // Additional helper function prototypes if needed for FastDTWBD implementation
 EXPORT double *get_coarsed_sequence(double *s, size_t n, size_t l);
 EXPORT size_t *get_window(size_t n, size_t m, size_t *path_buffer, size_t path_len, int radius);
+EXPORT size_t get_max_window_cells(size_t n, size_t m, int radius);
+void coarse_sequence(double *coarsed_sequence, double *s, size_t n, size_t l);
+void fill_window(size_t *window, size_t n, size_t m, size_t *path_buffer, size_t path_len, int radius);
 EXPORT void update_window(size_t *window, size_t n, size_t m, ssize_t i, ssize_t j);
 
 #endif // FASTDTWBD_H
@@ -0,0 +1,73 @@
+// Template of the float32 fill_rolling() of dtwbd_f32.c, included once per accumulator type.
+// Define FILL_ROLLING as the function name, COST as the type of accumulated distances
+// and COST_MAX as its largest value before including.
+
+// Fills the packed backpointers keeping only two rows of accumulated distances,
+// returns whether a path end is found
+static bool FILL_ROLLING(
+    BandMatrix *D,
+    float *s, float *t, size_t dim,
+    double skip_penalty,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j
+) {
+    size_t n = D->n, m = D->m;
+    // The two rows of doubles of the band matrix have room for any COST
+    COST *rows = (COST *)D->rows;
+    size_t row_len = m;
+    DistanceKernelF32 distance = euclid_distance_f32_kernel;
+    bool match = false;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t lo = band_lo(D, i), hi = band_hi(D, i);
+        size_t cell = D->offsets[i];
+        COST *row = &rows[(i % 2) * row_len];
+
+        size_t up_lo = 0, up_hi = 0;
+        COST *up_row = &rows[((i + 1) % 2) * row_len];
+        if (i > 0) {
+            up_lo = band_lo(D, i - 1);
+            up_hi = band_hi(D, i - 1);
+        }
+
+        for (size_t j = lo; j < hi; j++, cell++) {
+            COST d = distance(&s[i * dim], &t[j * dim], dim);
+
+            COST min_prev_distance = COST_MAX;
+            unsigned direction = DIRECTION_NONE;
+
+            // Same order of comparisons as in dtwbd.c to get the same ties
+            if (j >= up_lo && j < up_hi && up_row[j - up_lo] < min_prev_distance) {
+                min_prev_distance = up_row[j - up_lo];
+                direction = DIRECTION_UP;
+            }
+            if (j > lo && row[j - 1 - lo] < min_prev_distance) {
+                min_prev_distance = row[j - 1 - lo];
+                direction = DIRECTION_LEFT;
+            }
+            if (j > up_lo && j - 1 < up_hi && up_row[j - 1 - up_lo] < min_prev_distance) {
+                min_prev_distance = up_row[j - 1 - up_lo];
+                direction = DIRECTION_DIAG;
+            }
+
+            COST accumulated = d + (min_prev_distance == COST_MAX ? 0 : min_prev_distance);
+            row[j - lo] = accumulated;
+            band_set_direction(D, cell, direction);
+
+            // The skip penalty is added in double, it may be much larger than the distances
+            double cur_path_distance = accumulated + skip_penalty * (n - i + m - j - 2);
+            if (cur_path_distance < *min_path_distance) {
+                *min_path_distance = cur_path_distance;
+                *end_i = i;
+                *end_j = j;
+                match = true;
+            }
+        }
+    }
+
+    return match;
+}
+
+#undef FILL_ROLLING
+#undef COST
+#undef COST_MAX
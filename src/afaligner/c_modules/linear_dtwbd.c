@@ -0,0 +1,395 @@
+#include "linear_dtwbd.h"
+#include "band_matrix.h" // for DIRECTION_*
+#include "dtwbd.h"
+#include "distance.h"
+#include "logger.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Entries of the path into the split row are coded as 2 * k + is_diagonal, where k is
+// the relative column of the first path cell below the split row, or as one of these:
+#define ENTRY_NONE SIZE_MAX         // the path starts below the split row
+#define ENTRY_EXIT (SIZE_MAX - 1)   // the path leaves the rectangle through its left boundary
+
+
+// The matrix seen either directly or transposed: rows are frames of x and columns are frames of y.
+// The transposed view compares the left predecessor before the up one,
+// so that ties are broken exactly as in the original matrix.
+typedef struct {
+    double *x;
+    double *y;
+    size_t dim;
+    bool transposed;
+    size_t *cells;      // counter of the computed cells
+} LinearView;
+
+// Rectangle [r0, r1] x [c0, c1] of the view and the accumulated distances on its boundaries:
+// top[k] = D(r0 - 1, c0 - 1 + k) for k in [0, c1 - c0 + 1],
+// left[k] = D(r0 - 1 + k, c0 - 1) for k in [0, r1 - r0 + 1].
+// Cells outside of the matrix have INFINITY distance and are never chosen as predecessors.
+// The path always ends at (r1, c1).
+typedef struct {
+    size_t r0, r1;
+    size_t c0, c1;
+    double *top;
+    double *left;
+} LinearRect;
+
+typedef struct {
+    size_t *path_buffer;
+    ssize_t path_len;
+} LinearPath;
+
+
+static LinearView transpose_view(const LinearView *v) {
+    LinearView transposed = { v->y, v->x, v->dim, !v->transposed, v->cells };
+    return transposed;
+}
+
+static LinearRect transpose_rect(const LinearRect *rect) {
+    LinearRect transposed = { rect->c0, rect->c1, rect->r0, rect->r1, rect->left, rect->top };
+    return transposed;
+}
+
+static void emit_cell(LinearPath *path, const LinearView *v, size_t i, size_t j) {
+    path->path_buffer[2 * path->path_len] = v->transposed ? j : i;
+    path->path_buffer[2 * path->path_len + 1] = v->transposed ? i : j;
+    path->path_len++;
+}
+
+
+// Computes the row i of the view for the columns [c0, c0 + w).
+// up[k] and cur[k] hold the distances of the column c0 - 1 + k, cur[0] must be set beforehand.
+// directions[k - 1] receives the backpointer of cur[k].
+static void linear_row(
+    const LinearView *v, size_t i,
+    size_t c0, size_t w,
+    const double *up, double *cur,
+    uint8_t *directions
+) {
+    double *x = &v->x[i * v->dim];
+    DistanceKernel distance = euclid_distance_kernel;
+    *v->cells += w;
+
+    for (size_t k = 1; k <= w; k++) {
+        double d = distance(x, &v->y[(c0 + k - 1) * v->dim], v->dim);
+
+        double min_prev_distance = DBL_MAX;
+        uint8_t direction = DIRECTION_NONE;
+
+        if (!v->transposed) {
+            if (up[k] < min_prev_distance) {
+                min_prev_distance = up[k];
+                direction = DIRECTION_UP;
+            }
+            if (cur[k - 1] < min_prev_distance) {
+                min_prev_distance = cur[k - 1];
+                direction = DIRECTION_LEFT;
+            }
+        } else {
+            if (cur[k - 1] < min_prev_distance) {
+                min_prev_distance = cur[k - 1];
+                direction = DIRECTION_LEFT;
+            }
+            if (up[k] < min_prev_distance) {
+                min_prev_distance = up[k];
+                direction = DIRECTION_UP;
+            }
+        }
+        if (up[k - 1] < min_prev_distance) {
+            min_prev_distance = up[k - 1];
+            direction = DIRECTION_DIAG;
+        }
+
+        cur[k] = d + (min_prev_distance == DBL_MAX ? 0 : min_prev_distance);
+        directions[k - 1] = direction;
+    }
+}
+
+
+// Small rectangles keep all their backpointers
+static bool linear_base(const LinearView *v, const LinearRect *rect, LinearPath *path, Workspace *ws) {
+    size_t h = rect->r1 - rect->r0 + 1, w = rect->c1 - rect->c0 + 1;
+    size_t ws_mark = workspace_mark(ws);
+
+    double *prev = workspace_alloc(ws, (w + 1) * sizeof(double));
+    double *cur = workspace_alloc(ws, (w + 1) * sizeof(double));
+    uint8_t *directions = workspace_alloc(ws, h * w);
+    if (!prev || !cur || !directions) {
+        workspace_release(ws, ws_mark);
+        return false;
+    }
+
+    memcpy(prev, rect->top, (w + 1) * sizeof(double));
+    for (size_t i = rect->r0; i <= rect->r1; i++) {
+        cur[0] = rect->left[i - rect->r0 + 1];
+        linear_row(v, i, rect->c0, w, prev, cur, &directions[(i - rect->r0) * w]);
+
+        double *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    // Follow the backpointers until the path starts or leaves the rectangle
+    size_t i = rect->r1, j = rect->c1;
+    for (;;) {
+        emit_cell(path, v, i, j);
+
+        unsigned direction = directions[(i - rect->r0) * w + j - rect->c0];
+        if (direction == DIRECTION_NONE ||
+            (direction != DIRECTION_LEFT && i == rect->r0) ||
+            (direction != DIRECTION_UP && j == rect->c0)) {
+            break;
+        }
+        if (direction != DIRECTION_LEFT) i--;
+        if (direction != DIRECTION_UP) j--;
+    }
+
+    workspace_release(ws, ws_mark);
+
+    return true;
+}
+
+
+// Emits the cells of the path inside the rectangle starting from (r1, c1) in the reverse order
+static bool linear_solve(const LinearView *v, const LinearRect *rect, LinearPath *path, Workspace *ws) {
+    size_t r0 = rect->r0, r1 = rect->r1, c0 = rect->c0, c1 = rect->c1;
+    size_t h = r1 - r0 + 1, w = c1 - c0 + 1;
+
+    // Always split the longer side, so that the memory held by the recursion decreases geometrically
+    if (w > h) {
+        LinearView transposed_view = transpose_view(v);
+        LinearRect transposed_rect = transpose_rect(rect);
+        return linear_solve(&transposed_view, &transposed_rect, path, ws);
+    }
+
+    if (h <= 2 || h * w <= LINEAR_BASE_CELLS) {
+        return linear_base(v, rect, path, ws);
+    }
+
+    size_t mid = r0 + (h - 1) / 2;
+    size_t lower_h = r1 - mid;
+    size_t ws_mark = workspace_mark(ws);
+
+    double *mid_row = workspace_alloc(ws, (w + 1) * sizeof(double));
+    double *lower_left = workspace_alloc(ws, (lower_h + 1) * sizeof(double));
+    size_t rows_mark = workspace_mark(ws);
+    double *prev = workspace_alloc(ws, (w + 1) * sizeof(double));
+    double *cur = workspace_alloc(ws, (w + 1) * sizeof(double));
+    size_t *prev_entries = workspace_alloc(ws, (w + 1) * sizeof(size_t));
+    size_t *entries = workspace_alloc(ws, (w + 1) * sizeof(size_t));
+    uint8_t *directions = workspace_alloc(ws, w);
+    if (!mid_row || !lower_left || !prev || !cur || !prev_entries || !entries || !directions) {
+        workspace_release(ws, ws_mark);
+        return false;
+    }
+
+    // First pass: keep the split row and find where the path enters it from below
+    memcpy(prev, rect->top, (w + 1) * sizeof(double));
+    for (size_t i = r0; i <= r1; i++) {
+        cur[0] = rect->left[i - r0 + 1];
+        linear_row(v, i, c0, w, prev, cur, directions);
+
+        if (i == mid) {
+            memcpy(mid_row, cur, (w + 1) * sizeof(double));
+        } else if (i > mid) {
+            for (size_t k = 1; k <= w; k++) {
+                switch (directions[k - 1]) {
+                    case DIRECTION_UP:
+                        entries[k] = i == mid + 1 ? 2 * k : prev_entries[k];
+                        break;
+                    case DIRECTION_LEFT:
+                        entries[k] = k > 1 ? entries[k - 1] : ENTRY_EXIT;
+                        break;
+                    case DIRECTION_DIAG:
+                        entries[k] = k == 1 ? ENTRY_EXIT : (i == mid + 1 ? 2 * k + 1 : prev_entries[k - 1]);
+                        break;
+                    default:
+                        entries[k] = ENTRY_NONE;
+                        break;
+                }
+            }
+
+            size_t *tmp = prev_entries;
+            prev_entries = entries;
+            entries = tmp;
+        }
+
+        double *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    size_t entry = prev_entries[w];
+    bool crossed = entry != ENTRY_NONE && entry != ENTRY_EXIT;
+    size_t k_in = crossed ? entry / 2 : 1;
+
+    // The lower half starts at the column where the path enters it
+    LinearRect lower = { mid + 1, r1, c0 + k_in - 1, c1, &mid_row[k_in - 1], NULL };
+    if (k_in == 1) {
+        lower.left = &rect->left[mid - r0 + 1];
+    } else {
+        // Second pass: distances of the column left to the lower half
+        lower_left[0] = mid_row[k_in - 1];
+        memcpy(prev, mid_row, k_in * sizeof(double));
+        for (size_t i = mid + 1; i <= r1; i++) {
+            cur[0] = rect->left[i - r0 + 1];
+            linear_row(v, i, c0, k_in - 1, prev, cur, directions);
+            lower_left[i - mid] = cur[k_in - 1];
+
+            double *tmp = prev;
+            prev = cur;
+            cur = tmp;
+        }
+        lower.left = lower_left;
+    }
+
+    workspace_release(ws, rows_mark);
+
+    if (!linear_solve(v, &lower, path, ws)) {
+        workspace_release(ws, ws_mark);
+        return false;
+    }
+
+    workspace_release(ws, ws_mark);
+
+    if (crossed) {
+        // The upper half shares the boundaries with the whole rectangle
+        LinearRect upper = { r0, mid, c0, lower.c0 - (entry & 1), rect->top, rect->left };
+        return linear_solve(v, &upper, path, ws);
+    }
+
+    return true;
+}
+
+
+ssize_t linear_dtwbd(
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *path_buffer,
+    double *path_distance,
+    size_t *cells_evaluated,
+    Workspace *ws
+) {
+    size_t ws_mark = workspace_mark(ws);
+    size_t boundary_len = (n > m ? n : m) + 2;
+    size_t cells = 0;
+    LinearView view = { s, t, dim, false, &cells };
+
+    // The forward pass sweeps along the longer sequence to keep rows short
+    LinearView sweep = m > n ? transpose_view(&view) : view;
+    size_t rows_count = m > n ? m : n;
+    size_t row_len = m > n ? n : m;
+
+    double *boundary = workspace_alloc(ws, boundary_len * sizeof(double));
+    size_t rows_mark = workspace_mark(ws);
+    double *prev = workspace_alloc(ws, (row_len + 1) * sizeof(double));
+    double *cur = workspace_alloc(ws, (row_len + 1) * sizeof(double));
+    uint8_t *directions = workspace_alloc(ws, row_len);
+    if (!boundary || !prev || !cur || !directions) {
+        log_error("Failed to allocate the linear DTWBD rows.");
+        workspace_release(ws, ws_mark);
+        return -1;
+    }
+
+    for (size_t k = 0; k < boundary_len; k++) {
+        boundary[k] = INFINITY;
+    }
+
+    // Forward pass to find the end of the path.
+    // Ties are broken in favor of the first cell in the row-major order whatever the sweep is.
+    double min_path_distance = DBL_MAX;
+    size_t end_i = 0, end_j = 0;
+    bool match = false;
+
+    memcpy(prev, boundary, (row_len + 1) * sizeof(double));
+    for (size_t r = 0; r < rows_count; r++) {
+        cur[0] = INFINITY;
+        linear_row(&sweep, r, 0, row_len, prev, cur, directions);
+
+        for (size_t c = 0; c < row_len; c++) {
+            size_t i = sweep.transposed ? c : r;
+            size_t j = sweep.transposed ? r : c;
+            double cur_path_distance = cur[c + 1] + skip_penalty * (n - i + m - j - 2);
+            if (cur_path_distance < min_path_distance ||
+                (match && cur_path_distance == min_path_distance && (i < end_i || (i == end_i && j < end_j)))) {
+                min_path_distance = cur_path_distance;
+                end_i = i;
+                end_j = j;
+                match = true;
+            }
+        }
+
+        double *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    workspace_release(ws, rows_mark);
+
+    if (!match) {
+        log_info("No matching path found");
+        workspace_release(ws, ws_mark);
+        if (cells_evaluated) *cells_evaluated = cells;
+        return 0;
+    }
+
+    log_info("Found match. Min path distance: %.4f, end_i: %zu, end_j: %zu",
+             min_path_distance, end_i, end_j);
+
+    LinearRect rect = { 0, end_i, 0, end_j, boundary, boundary };
+    LinearPath path = { path_buffer, 0 };
+    bool solved = linear_solve(&view, &rect, &path, ws);
+    workspace_release(ws, ws_mark);
+    if (cells_evaluated) *cells_evaluated = cells;
+
+    if (!solved) {
+        log_error("Failed to recover the linear DTWBD path.");
+        return -1;
+    }
+
+    *path_distance = min_path_distance;
+    reverse_path(path_buffer, path.path_len);
+
+    log_info("Path reconstruction complete, length: %zd", path.path_len);
+
+    return path.path_len;
+}
+
+
+size_t linear_dtwbd_workspace_size(size_t n, size_t m) {
+    size_t long_len = n > m ? n : m;
+    size_t short_len = n > m ? m : n;
+    size_t boundary_size = workspace_block_size((long_len + 2) * sizeof(double));
+
+    size_t forward_size = 2 * workspace_block_size((short_len + 1) * sizeof(double)) + workspace_block_size(short_len);
+
+    // Every split holds a row of the shorter side and a column of the lower half
+    // while the lower half is solved. The shorter side of a rectangle never grows
+    // and halves are at most (h + 1) / 2 high.
+    size_t stack_size = 0;
+    for (size_t h = long_len, w = short_len; h > 2 && h * w > LINEAR_BASE_CELLS; ) {
+        size_t lower_h = (h + 1) / 2;
+        stack_size += workspace_block_size((w + 1) * sizeof(double)) +
+                      workspace_block_size((lower_h + 1) * sizeof(double));
+        h = lower_h > w ? lower_h : w;
+        w = lower_h > w ? w : lower_h;
+    }
+
+    // Rows of the deepest split or the base case
+    size_t base_cells = 2 * short_len > LINEAR_BASE_CELLS ? 2 * short_len : LINEAR_BASE_CELLS;
+    size_t leaf_size = 2 * workspace_block_size((short_len + 1) * sizeof(double)) +
+                       2 * workspace_block_size((short_len + 1) * sizeof(size_t)) +
+                       workspace_block_size(short_len) +
+                       workspace_block_size(base_cells);
+
+    size_t recursion_size = stack_size + leaf_size;
+
+    return boundary_size + (forward_size > recursion_size ? forward_size : recursion_size);
+}
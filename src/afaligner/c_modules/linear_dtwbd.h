@@ -0,0 +1,30 @@
+#ifndef LINEAR_DTWBD_H
+#define LINEAR_DTWBD_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "workspace.h"
+
+
+// Rectangles with at most this many cells are solved with a full matrix of backpointers
+#define LINEAR_BASE_CELLS 4096
+
+
+// DTWBD without a window in O(n + m) memory (DTWBD_STORAGE_LINEAR).
+// Finds the same path as the other storages by divide and conquer in the manner of Hirschberg:
+// the matrix is split in halves and each half is solved recursively knowing the distances
+// on its top and left boundaries, so backpointers are never stored for the whole matrix.
+ssize_t linear_dtwbd(
+    double *s, size_t n,
+    double *t, size_t m,
+    size_t dim,
+    double skip_penalty,
+    size_t *path_buffer,
+    double *path_distance,
+    size_t *cells_evaluated,    // cells computed by all the passes, may be NULL
+    Workspace *ws
+);
+
+size_t linear_dtwbd_workspace_size(size_t n, size_t m);
+
+#endif
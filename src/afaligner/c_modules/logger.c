@@ -1,77 +1,342 @@
 #include "logger.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(__STDC_NO_ATOMICS__)
+#define LOGGER_THREAD 1
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
 #define LOG_FILE_PATH "./output/afaligner.log"
 
-static void log_with_prefix(const char *prefix, const char *format, va_list args) {
-    FILE *log_file = fopen(LOG_FILE_PATH, "a");
-    if (!log_file) return;
+// Messages in flight, a power of two, longer messages are truncated
+#define LOG_RING_SLOTS 1024
+#define LOG_MESSAGE_SIZE 232
+
+
+volatile int log_runtime_level = LOG_COMPILE_LEVEL;
+LOG_THREAD_LOCAL int log_thread_level = -1;
+
+static const char *LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR"};
 
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
+// Sink of the messages, opened by the first write and kept open
+static char log_path[4096] = LOG_FILE_PATH;
+static FILE *log_file = NULL;
+static bool log_file_failed = false;
 
-    fprintf(log_file, "[%02d:%02d:%02d] [%s] ",
-            t->tm_hour, t->tm_min, t->tm_sec, prefix);
-    vfprintf(log_file, format, args);
-    fprintf(log_file, "\n");
 
-    fclose(log_file);
+int log_set_level(int level) {
+    if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_NONE) {
+        return -1;
+    }
+    log_runtime_level = level;
+    return 0;
 }
 
-void log_info(const char *format, ...) {
-#if LOG_INFO_ENABLED
-    va_list args;
-    va_start(args, format);
-    log_with_prefix("INFO", format, args);
-    va_end(args);
-#endif
+int log_get_level(void) {
+    return log_runtime_level;
 }
 
-void log_warn(const char *format, ...) {
-#if LOG_WARN_ENABLED
-    va_list args;
-    va_start(args, format);
-    log_with_prefix("WARN", format, args);
-    va_end(args);
+
+const char *log_get_file(void) {
+    return log_path;
+}
+
+
+static FILE *open_sink(void) {
+    if (!log_file && !log_file_failed && log_path[0]) {
+        log_file = fopen(log_path, "a");
+        log_file_failed = log_file == NULL;
+    }
+    return log_file;
+}
+
+static void close_sink(void) {
+    if (log_file) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+}
+
+static void write_line(FILE *file, int level, time_t when, const char *message) {
+    struct tm t;
+#if defined(_WIN32) || defined(__WIN32__)
+    localtime_s(&t, &when);
+#else
+    localtime_r(&when, &t);
 #endif
+    fprintf(file, "[%02d:%02d:%02d] [%s] %s\n", t.tm_hour, t.tm_min, t.tm_sec, LEVEL_NAMES[level], message);
+}
+
+static void print_error(const char *message) {
+    fprintf(stderr, "ERROR: %s\n", message);
+}
+
+
+#ifdef LOGGER_THREAD
+
+// Bounded multi-producer queue: a producer claims the slot at write_pos and publishes it
+// by setting sequence to position + 1, the drainer frees it by setting position + LOG_RING_SLOTS
+typedef struct {
+    atomic_size_t sequence;
+    int level;
+    time_t time;
+    char message[LOG_MESSAGE_SIZE];
+} LogRecord;
+
+static LogRecord ring[LOG_RING_SLOTS];
+static atomic_size_t write_pos;
+static atomic_size_t dropped;
+static size_t read_pos;         // owned by the holder of sink_lock
+static size_t dropped_reported; // same
+
+static pthread_once_t logger_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t drainer;
+static atomic_bool running;
+static bool drainer_started = false;
+
+// The drainer blocks on wake while the ring is empty, the first message published after it set
+// drainer_waiting signals it. wake_lock is taken before sink_lock when both are held.
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static atomic_bool drainer_waiting;
+
+
+// Writes the published messages to the sink, returns whether there were any.
+// Must be called with sink_lock held.
+static bool drain(void) {
+    bool drained = false;
+    FILE *file = open_sink();
+
+    for (;;) {
+        LogRecord *record = &ring[read_pos % LOG_RING_SLOTS];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) != read_pos + 1) {
+            break;
+        }
+        if (file) {
+            write_line(file, record->level, record->time, record->message);
+        }
+        atomic_store_explicit(&record->sequence, read_pos + LOG_RING_SLOTS, memory_order_release);
+        read_pos++;
+        drained = true;
+    }
+
+    size_t dropped_now = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (dropped_now != dropped_reported) {
+        if (file) {
+            char message[64];
+            snprintf(message, sizeof message, "%zu messages dropped, the log buffer was full", dropped_now - dropped_reported);
+            write_line(file, LOG_LEVEL_WARN, time(NULL), message);
+        }
+        dropped_reported = dropped_now;
+    }
+
+    if (drained && file) {
+        fflush(file);
+    }
+
+    return drained;
+}
+
+// Blocks until a message is published at read_pos or the logger is stopped
+static void wait_for_messages(void) {
+    pthread_mutex_lock(&wake_lock);
+    atomic_store_explicit(&drainer_waiting, true, memory_order_seq_cst);
+    // Pairs with the fence of log_write(): either the producer sees the flag or the message is seen here
+    atomic_thread_fence(memory_order_seq_cst);
+    pthread_mutex_lock(&sink_lock);
+    LogRecord *record = &ring[read_pos % LOG_RING_SLOTS];
+    bool empty = atomic_load_explicit(&record->sequence, memory_order_acquire) != read_pos + 1;
+    pthread_mutex_unlock(&sink_lock);
+    if (empty && atomic_load_explicit(&running, memory_order_acquire)) {
+        pthread_cond_wait(&wake, &wake_lock);
+    }
+    atomic_store_explicit(&drainer_waiting, false, memory_order_relaxed);
+    pthread_mutex_unlock(&wake_lock);
+}
+
+static void wake_drainer(void) {
+    pthread_mutex_lock(&wake_lock);
+    atomic_store_explicit(&drainer_waiting, false, memory_order_relaxed);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+}
+
+static void *run_drainer(void *arg) {
+    (void)arg;
+
+    while (atomic_load_explicit(&running, memory_order_acquire)) {
+        pthread_mutex_lock(&sink_lock);
+        bool drained = drain();
+        pthread_mutex_unlock(&sink_lock);
+        if (!drained) {
+            wait_for_messages();
+        }
+    }
+
+    return NULL;
+}
+
+static void stop_logger(void) {
+    if (drainer_started) {
+        atomic_store_explicit(&running, false, memory_order_release);
+        wake_drainer();
+        pthread_join(drainer, NULL);
+        drainer_started = false;
+    }
+    pthread_mutex_lock(&sink_lock);
+    drain();
+    close_sink();
+    pthread_mutex_unlock(&sink_lock);
+}
+
+static void start_logger(void) {
+    for (size_t k = 0; k < LOG_RING_SLOTS; k++) {
+        atomic_init(&ring[k].sequence, k);
+    }
+    atomic_init(&write_pos, 0);
+    atomic_init(&dropped, 0);
+    atomic_init(&running, true);
+    atomic_init(&drainer_waiting, false);
+
+    // Without the thread messages are written by log_flush() and at exit
+    drainer_started = pthread_create(&drainer, NULL, run_drainer, NULL) == 0;
+    atexit(stop_logger);
 }
 
-void log_debug(const char *format, ...) {
-#if LOG_DEBUG_ENABLED
+
+void log_write(int level, const char *format, ...) {
+    if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_ERROR) {
+        return;
+    }
+    pthread_once(&logger_once, start_logger);
+
+    size_t pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+    LogRecord *record;
+    for (;;) {
+        record = &ring[pos % LOG_RING_SLOTS];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&write_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The ring is full, the message is counted instead of waiting for the drainer
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            record = NULL;
+            break;
+        } else {
+            pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+        }
+    }
+
+    char buffer[LOG_MESSAGE_SIZE];
+    char *message = record ? record->message : buffer;
     va_list args;
     va_start(args, format);
-    log_with_prefix("DEBUG", format, args);
+    vsnprintf(message, LOG_MESSAGE_SIZE, format, args);
     va_end(args);
-#endif
+
+    if (level == LOG_LEVEL_ERROR) {
+        print_error(message);
+    }
+
+    if (record) {
+        record->level = level;
+        record->time = time(NULL);
+        atomic_store_explicit(&record->sequence, pos + 1, memory_order_release);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&drainer_waiting, memory_order_relaxed)) {
+            wake_drainer();
+        }
+    }
+}
+
+void log_flush(void) {
+    pthread_once(&logger_once, start_logger);
+    pthread_mutex_lock(&sink_lock);
+    drain();
+    if (log_file) {
+        fflush(log_file);
+    }
+    pthread_mutex_unlock(&sink_lock);
+}
+
+int log_set_file(const char *path) {
+    if (path && strlen(path) >= sizeof log_path) {
+        return -1;
+    }
+
+    // Messages queued so far go to the previous file
+    pthread_once(&logger_once, start_logger);
+    pthread_mutex_lock(&sink_lock);
+    drain();
+    close_sink();
+    strcpy(log_path, path ? path : "");
+    log_file_failed = false;
+    pthread_mutex_unlock(&sink_lock);
+
+    return 0;
+}
+
+size_t log_dropped_count(void) {
+    pthread_once(&logger_once, start_logger);
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
 }
 
-void log_error(const char *format, ...) {
-#if LOG_DEBUG_ENABLED
+#else
+
+// Without threads messages are written right away to the file held open
+
+void log_write(int level, const char *format, ...) {
+    if (level < LOG_LEVEL_DEBUG || level > LOG_LEVEL_ERROR) {
+        return;
+    }
+
+    char message[LOG_MESSAGE_SIZE];
     va_list args;
     va_start(args, format);
-    fprintf(stderr, "ERROR: ");
-    vfprintf(stderr, format, args);
+    vsnprintf(message, sizeof message, format, args);
     va_end(args);
-    fprintf(stderr, "\n");
-#endif
+
+    if (level == LOG_LEVEL_ERROR) {
+        print_error(message);
+    }
+
+    FILE *file = open_sink();
+    if (file) {
+        write_line(file, level, time(NULL), message);
+    }
 }
 
-void log_memory_alloc(const void *ptr, size_t size, const char *func, int line) {
-#if LOG_MEM_ENABLED
-    FILE *log_file = fopen(LOG_FILE_PATH, "a");
-    if (!log_file) return;
-    fprintf(log_file, "[MEMORY] Allocated %zu bytes at %p (%s:%d)\n", size, ptr, func, line);
-    fclose(log_file);
-#endif
+void log_flush(void) {
+    if (log_file) {
+        fflush(log_file);
+    }
 }
 
-void log_memory_free(const void *ptr, const char *func, int line) {
-#if LOG_MEM_ENABLED
-    FILE *log_file = fopen(LOG_FILE_PATH, "a");
-    if (!log_file) return;
-    fprintf(log_file, "[MEMORY] Freed memory at %p (%s:%d)\n", ptr, func, line);
-    fclose(log_file);
-#endif
+int log_set_file(const char *path) {
+    if (path && strlen(path) >= sizeof log_path) {
+        return -1;
+    }
+
+    close_sink();
+    strcpy(log_path, path ? path : "");
+    log_file_failed = false;
+
+    return 0;
 }
+
+size_t log_dropped_count(void) {
+    return 0;
+}
+
+#endif
@@ -3,10 +3,18 @@
 
 #include <stddef.h>
 
-// Enable or disable logging categories
-#define LOG_INFO_ENABLED 1
-#define LOG_MEM_ENABLED  1
-#define LOG_DEBUG_ENABLED 1
+// Levels of log messages
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+// Messages below this level are removed at compile time together with the evaluation of their arguments,
+// e.g. build with -DLOG_COMPILE_LEVEL=0 to get debug messages
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
 
 #if defined(_WIN32) || defined(__WIN32__)
     #ifdef BUILDING_FASTDTWBD
@@ -22,16 +30,79 @@
     #endif
 #endif
 
-// Logging functions
-EXPORT void log_info(const char *format, ...);
-EXPORT void log_warn(const char *format, ...);
-EXPORT void log_debug(const char *format, ...);
-EXPORT void log_error(const char *format, ...);
-EXPORT void log_memory_alloc(const void *ptr, size_t size, const char *func, int line);
-EXPORT void log_memory_free(const void *ptr, const char *func, int line);
+#if defined(_MSC_VER)
+    #define LOG_THREAD_LOCAL __declspec(thread)
+#else
+    #define LOG_THREAD_LOCAL _Thread_local
+#endif
+
+#if defined(__GNUC__)
+    #define LOG_PRINTF_FORMAT __attribute__((format(printf, 2, 3)))
+#else
+    #define LOG_PRINTF_FORMAT
+#endif
+
+
+// Messages below the runtime level are skipped before their arguments are evaluated
+EXPORT extern volatile int log_runtime_level;
+
+// Level of the messages of the calling thread, -1 follows log_runtime_level.
+// Aligner contexts set it for the duration of an alignment, so each context logs at its own level.
+extern LOG_THREAD_LOCAL int log_thread_level;
+
+static inline int log_current_level(void) {
+    return log_thread_level >= 0 ? log_thread_level : log_runtime_level;
+}
+
+// Queues a message for the log file, errors are also printed to stderr right away.
+// Messages go through a lock-free ring buffer drained by a background thread,
+// so logging never waits for the file.
+EXPORT void log_write(int level, const char *format, ...) LOG_PRINTF_FORMAT;
+
+// Runtime control, returns 0 on success and -1 on invalid arguments
+EXPORT int log_set_level(int level);
+EXPORT int log_get_level(void);
+// Writes the following messages to the file at path (appending), NULL or "" discards them
+EXPORT int log_set_file(const char *path);
+// Returns the path of the log file, "" if messages are discarded
+EXPORT const char *log_get_file(void);
+// Writes all queued messages to the file
+EXPORT void log_flush(void);
+// Returns the number of messages lost because the ring buffer was full
+EXPORT size_t log_dropped_count(void);
+
 
-// Helper macros for memory logging
-#define LOG_ALLOC(ptr, size) log_memory_alloc(ptr, size, __func__, __LINE__)
-#define LOG_FREE(ptr)        log_memory_free(ptr, __func__, __LINE__)
+#define LOG_AT(level, ...) do { \
+        if ((level) >= log_current_level()) log_write((level), __VA_ARGS__); \
+    } while (0)
+
+// The disabled levels keep the calls type checked but the compiler drops them
+#define LOG_NOTHING(level, ...) do { \
+        if (0) log_write((level), __VA_ARGS__); \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+    #define log_debug(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+    #define log_debug(...) LOG_NOTHING(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+    #define log_info(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+    #define log_info(...) LOG_NOTHING(LOG_LEVEL_INFO, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+    #define log_warn(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+    #define log_warn(...) LOG_NOTHING(LOG_LEVEL_WARN, __VA_ARGS__)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+    #define log_error(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+    #define log_error(...) LOG_NOTHING(LOG_LEVEL_ERROR, __VA_ARGS__)
+#endif
 
 #endif // LOGGER_H
@@ -0,0 +1,538 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "mfcc.h"
+#include "logger.h"
+
+#if !defined(_WIN32) && !defined(__WIN32__)
+#define MFCC_THREADS 1
+#include <pthread.h>
+#endif
+
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MFCC_CUTOFF 0.00001
+#define MFCC_MEL_10 2595.0
+#define MFCC_MAX_THREADS 64
+#define MFCC_BLOCK_FRAMES 256   // frames computed by a thread at a time
+
+
+const MFCCOptions MFCC_DEFAULT_OPTIONS = {
+    .sample_rate = 16000,
+    .filters_count = 40,
+    .mfcc_size = 13,
+    .fft_order = 512,
+    .lower_frequency = 133.3333,
+    .upper_frequency = 6855.4976,
+    .emphasis_factor = 0.970,
+    .window_length = 0.100,
+    .window_shift = 0.040,
+};
+
+
+struct MFCCPlan {
+    MFCCOptions options;
+    size_t frame_shift;
+    size_t used_length;     // windowed samples that reach the FFT
+    size_t bins;            // fft_order / 2 + 1
+    size_t dim;
+    double *window;         // used_length values of the Hamming window of the whole frame
+    size_t *filter_first;   // first bin of every filter
+    size_t *filter_count;   // number of bins of every filter
+    double *filter_weights; // filters_count x bins, weights of filter f start at f * bins
+    double *dct;            // dim x filters_count, coefficients 1.. of the DCT divided by filters_count
+    double *split_re;       // bins twiddles of the real FFT
+    double *split_im;
+    double *fft_re;         // fft_order / 4 twiddles of the complex FFT of fft_order / 2 points
+    double *fft_im;
+    size_t *bit_reverse;    // fft_order / 2 indices
+};
+
+// Buffers of one thread
+typedef struct {
+    double *re;
+    double *im;
+    double *power;
+    double *log_energies;
+} MFCCScratch;
+
+
+static double hz_to_mel(double frequency) {
+    return MFCC_MEL_10 * log10(1.0 + frequency / 700.0);
+}
+
+static double mel_to_hz(double mel) {
+    return 700.0 * (pow(10.0, mel / MFCC_MEL_10) - 1.0);
+}
+
+static bool is_power_of_two(size_t x) {
+    return x >= 4 && (x & (x - 1)) == 0;
+}
+
+
+// Triangular filters of MFCC._create_mel_filter_bank(), bins are rounded half to even as numpy does
+static bool create_filters(MFCCPlan *plan) {
+    const MFCCOptions *o = &plan->options;
+    double dfreq = (double)o->sample_rate / (double)o->fft_order;
+    double mel_max = hz_to_mel(o->upper_frequency);
+    double mel_min = hz_to_mel(o->lower_frequency);
+    double dmelbw = (mel_max - mel_min) / (double)(o->filters_count + 1);
+
+    for (size_t f = 0; f < o->filters_count; f++) {
+        double left = nearbyint(mel_to_hz(mel_min + dmelbw * (double)f) / dfreq);
+        double center = nearbyint(mel_to_hz(mel_min + dmelbw * (double)(f + 1)) / dfreq);
+        double right = nearbyint(mel_to_hz(mel_min + dmelbw * (double)(f + 2)) / dfreq);
+        if (left < 0 || right >= (double)plan->bins || right <= left) {
+            log_error("[MFCC] Filter %zu does not fit the spectrum.", f);
+            return false;
+        }
+
+        size_t leftfr = (size_t)left, centerfr = (size_t)center, rightfr = (size_t)right;
+        double height = 2.0 / ((double)(rightfr - leftfr) * dfreq);
+        double left_slope = centerfr != leftfr ? height / (double)(centerfr - leftfr) : 0;
+        double right_slope = centerfr != rightfr ? height / ((double)centerfr - (double)rightfr) : 0;
+        double *weights = &plan->filter_weights[f * plan->bins];
+
+        plan->filter_first[f] = leftfr + 1;
+        plan->filter_count[f] = rightfr - leftfr - 1;
+        for (size_t bin = leftfr + 1; bin < rightfr; bin++) {
+            if (bin < centerfr) {
+                weights[bin - leftfr - 1] = (double)(bin - leftfr) * left_slope;
+            } else if (bin == centerfr) {
+                weights[bin - leftfr - 1] = height;
+            } else {
+                weights[bin - leftfr - 1] = ((double)bin - (double)rightfr) * right_slope;
+            }
+        }
+    }
+    return true;
+}
+
+
+MFCCPlan *mfcc_plan_create(const MFCCOptions *options) {
+    if (!options) {
+        options = &MFCC_DEFAULT_OPTIONS;
+    }
+
+    size_t frame_length = (size_t)nearbyint(options->window_length * (double)options->sample_rate);
+    size_t frame_shift = (size_t)nearbyint(options->window_shift * (double)options->sample_rate);
+    if (!is_power_of_two(options->fft_order) || options->mfcc_size < 2 || options->filters_count == 0 ||
+        frame_length < 2 || frame_shift == 0 || options->upper_frequency > (double)options->sample_rate / 2 ||
+        options->lower_frequency >= options->upper_frequency) {
+        log_error("[MFCC] Invalid options.");
+        return NULL;
+    }
+
+    MFCCPlan *plan = calloc(1, sizeof(MFCCPlan));
+    if (!plan) {
+        log_error("[MFCC] Failed to allocate the plan.");
+        return NULL;
+    }
+
+    size_t n = options->fft_order, half = n / 2, filters = options->filters_count;
+    plan->options = *options;
+    plan->frame_shift = frame_shift;
+    plan->used_length = frame_length < n ? frame_length : n;
+    plan->bins = half + 1;
+    plan->dim = options->mfcc_size - 1;
+    plan->window = malloc(plan->used_length * sizeof(double));
+    plan->filter_first = calloc(filters, sizeof(size_t));
+    plan->filter_count = calloc(filters, sizeof(size_t));
+    plan->filter_weights = calloc(filters * plan->bins, sizeof(double));
+    plan->dct = malloc(plan->dim * filters * sizeof(double));
+    plan->split_re = malloc(plan->bins * sizeof(double));
+    plan->split_im = malloc(plan->bins * sizeof(double));
+    plan->fft_re = malloc(half / 2 * sizeof(double));
+    plan->fft_im = malloc(half / 2 * sizeof(double));
+    plan->bit_reverse = malloc(half * sizeof(size_t));
+    if (!plan->window || !plan->filter_first || !plan->filter_count || !plan->filter_weights || !plan->dct ||
+        !plan->split_re || !plan->split_im || !plan->fft_re || !plan->fft_im || !plan->bit_reverse) {
+        log_error("[MFCC] Failed to allocate the plan.");
+        mfcc_plan_destroy(plan);
+        return NULL;
+    }
+
+    if (!create_filters(plan)) {
+        mfcc_plan_destroy(plan);
+        return NULL;
+    }
+
+    // numpy.hamming() of the whole frame, only its beginning reaches the FFT
+    for (size_t i = 0; i < plan->used_length; i++) {
+        plan->window[i] = 0.54 - 0.46 * cos(2.0 * M_PI * (double)i / (double)(frame_length - 1));
+    }
+
+    // MFCC._create_dct_matrix() without coefficient 0
+    for (size_t c = 0; c < plan->dim; c++) {
+        for (size_t f = 0; f < filters; f++) {
+            double value = cos(M_PI * (double)(c + 1) / (double)filters * ((double)f + 0.5));
+            plan->dct[c * filters + f] = (f == 0 ? 0.5 * value : value) / (double)filters;
+        }
+    }
+
+    for (size_t k = 0; k < half / 2; k++) {
+        plan->fft_re[k] = cos(-2.0 * M_PI * (double)k / (double)half);
+        plan->fft_im[k] = sin(-2.0 * M_PI * (double)k / (double)half);
+    }
+    for (size_t k = 0; k < plan->bins; k++) {
+        plan->split_re[k] = cos(-2.0 * M_PI * (double)k / (double)n);
+        plan->split_im[k] = sin(-2.0 * M_PI * (double)k / (double)n);
+    }
+    size_t bits = 0;
+    while (((size_t)1 << bits) < half) {
+        bits++;
+    }
+    for (size_t i = 0; i < half; i++) {
+        size_t reversed = 0;
+        for (size_t b = 0; b < bits; b++) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        plan->bit_reverse[i] = reversed;
+    }
+
+    return plan;
+}
+
+void mfcc_plan_destroy(MFCCPlan *plan) {
+    if (!plan) {
+        return;
+    }
+    free(plan->window);
+    free(plan->filter_first);
+    free(plan->filter_count);
+    free(plan->filter_weights);
+    free(plan->dct);
+    free(plan->split_re);
+    free(plan->split_im);
+    free(plan->fft_re);
+    free(plan->fft_im);
+    free(plan->bit_reverse);
+    free(plan);
+}
+
+
+size_t mfcc_plan_dim(const MFCCPlan *plan) {
+    return plan->dim;
+}
+
+size_t mfcc_plan_shift(const MFCCPlan *plan) {
+    return plan->frame_shift;
+}
+
+size_t mfcc_frames_count(const MFCCPlan *plan, size_t samples_count) {
+    return samples_count / plan->frame_shift;
+}
+
+
+// In-place radix-2 FFT of fft_order / 2 points whose input is already in bit-reversed order
+static void fft(const MFCCPlan *plan, double *re, double *im) {
+    size_t points = plan->options.fft_order / 2;
+
+    for (size_t len = 2; len <= points; len <<= 1) {
+        size_t half = len / 2, step = points / len;
+        for (size_t i = 0; i < points; i += len) {
+            for (size_t j = 0; j < half; j++) {
+                double wr = plan->fft_re[j * step], wi = plan->fft_im[j * step];
+                double *ur = &re[i + j], *ui = &im[i + j], *vr = &re[i + j + half], *vi = &im[i + j + half];
+                double tr = *vr * wr - *vi * wi;
+                double ti = *vr * wi + *vi * wr;
+                *vr = *ur - tr;
+                *vi = *ui - ti;
+                *ur += tr;
+                *ui += ti;
+            }
+        }
+    }
+}
+
+// Computes a frame from its fft_order pre-emphasized samples, which are multiplied by the window in place
+static void compute_frame(const MFCCPlan *plan, double *samples, MFCCScratch *scratch, double *frame) {
+    size_t n = plan->options.fft_order, half = n / 2, filters = plan->options.filters_count;
+
+    for (size_t i = 0; i < plan->used_length; i++) {
+        samples[i] *= plan->window[i];
+    }
+
+    // Real FFT of n points as a complex FFT of the even and odd samples
+    for (size_t k = 0; k < half; k++) {
+        size_t r = plan->bit_reverse[k];
+        scratch->re[r] = samples[2 * k];
+        scratch->im[r] = samples[2 * k + 1];
+    }
+    fft(plan, scratch->re, scratch->im);
+
+    for (size_t k = 0; k <= half; k++) {
+        // a = k % half and b = (half - k) % half without the divisions, they took a third of the frame
+        size_t a = k < half ? k : 0, b = k > 0 && k < half ? half - k : 0;
+        double zr = scratch->re[a], zi = scratch->im[a];
+        double cr = scratch->re[b], ci = -scratch->im[b];
+        double er = 0.5 * (zr + cr), ei = 0.5 * (zi + ci);
+        double or_ = 0.5 * (zi - ci), oi = -0.5 * (zr - cr);
+        double xr = er + plan->split_re[k] * or_ - plan->split_im[k] * oi;
+        double xi = ei + plan->split_re[k] * oi + plan->split_im[k] * or_;
+        scratch->power[k] = xr * xr + xi * xi;
+    }
+
+    for (size_t f = 0; f < filters; f++) {
+        const double *weights = &plan->filter_weights[f * plan->bins];
+        const double *power = &scratch->power[plan->filter_first[f]];
+        double energy = 0;
+        for (size_t b = 0; b < plan->filter_count[f]; b++) {
+            energy += power[b] * weights[b];
+        }
+        scratch->log_energies[f] = log(energy > MFCC_CUTOFF ? energy : MFCC_CUTOFF);
+    }
+
+    for (size_t c = 0; c < plan->dim; c++) {
+        const double *row = &plan->dct[c * filters];
+        double value = 0;
+        for (size_t f = 0; f < filters; f++) {
+            value += row[f] * scratch->log_energies[f];
+        }
+        frame[c] = value;
+    }
+}
+
+
+typedef struct {
+    const MFCCPlan *plan;
+    const double *samples;
+    const int16_t *pcm;
+    size_t samples_count;
+    size_t origin;          // sample of the start of frame 0, the sample before it is the previous one
+    double *frames;
+    size_t frames_count;
+    size_t first_block;     // blocks of a worker are first_block, first_block + workers_count, ...
+    size_t workers_count;
+    bool ok;
+} MFCCWorker;
+
+// Copies count samples from start as doubles
+static void load_samples(const MFCCWorker *w, size_t start, size_t count, double *out) {
+    if (w->samples) {
+        for (size_t k = 0; k < count; k++) {
+            out[k] = w->samples[start + k];
+        }
+    } else {
+        for (size_t k = 0; k < count; k++) {
+            out[k] = (double)w->pcm[start + k] / 32768.0;
+        }
+    }
+}
+
+static void *run_worker(void *arg) {
+    MFCCWorker *w = arg;
+    const MFCCPlan *plan = w->plan;
+    size_t n = plan->options.fft_order;
+    double a = plan->options.emphasis_factor;
+
+    double *buffer = malloc((2 * n + 1 + 2 * (n / 2) + plan->bins + plan->options.filters_count) * sizeof(double));
+    if (!buffer) {
+        w->ok = false;
+        return NULL;
+    }
+    double *raw = buffer + n;   // the sample before the frame and the samples of the frame
+    MFCCScratch scratch = {
+        .re = raw + n + 1,
+        .im = raw + n + 1 + n / 2,
+        .power = raw + 2 * n + 1,
+        .log_energies = raw + 2 * n + 1 + plan->bins,
+    };
+
+    for (size_t block = w->first_block; block * MFCC_BLOCK_FRAMES < w->frames_count; block += w->workers_count) {
+        size_t end = (block + 1) * MFCC_BLOCK_FRAMES;
+        if (end > w->frames_count) {
+            end = w->frames_count;
+        }
+        for (size_t i = block * MFCC_BLOCK_FRAMES; i < end; i++) {
+            size_t start = w->origin + i * plan->frame_shift;
+            size_t used = w->samples_count - start < plan->used_length ? w->samples_count - start : plan->used_length;
+
+            // Pre-emphasis keeps the first sample, samples past the end are zeros
+            raw[0] = 0;
+            if (start > 0) {
+                load_samples(w, start - 1, 1, raw);
+            }
+            load_samples(w, start, used, raw + 1);
+            for (size_t k = 0; k < used; k++) {
+                buffer[k] = raw[k + 1] - a * raw[k];
+            }
+            for (size_t k = used; k < n; k++) {
+                buffer[k] = 0;
+            }
+            compute_frame(plan, buffer, &scratch, &w->frames[i * plan->dim]);
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+// Computes frames_count frames starting at samples[origin + i * shift]
+static ssize_t compute_frames(const MFCCPlan *plan, const double *samples, const int16_t *pcm, size_t samples_count,
+                              size_t origin, size_t frames_count, int threads, double *frames) {
+    size_t blocks_count = (frames_count + MFCC_BLOCK_FRAMES - 1) / MFCC_BLOCK_FRAMES;
+    size_t count = threads > 1 ? (size_t)threads : 1;
+    if (count > MFCC_MAX_THREADS) count = MFCC_MAX_THREADS;
+    if (count > blocks_count) count = blocks_count;
+    if (count == 0) {
+        return 0;
+    }
+
+    MFCCWorker workers[MFCC_MAX_THREADS];
+    for (size_t k = 0; k < count; k++) {
+        workers[k] = (MFCCWorker){
+            .plan = plan, .samples = samples, .pcm = pcm, .samples_count = samples_count, .origin = origin,
+            .frames = frames, .frames_count = frames_count,
+            .first_block = k, .workers_count = count, .ok = true,
+        };
+    }
+
+#ifdef MFCC_THREADS
+    pthread_t handles[MFCC_MAX_THREADS];
+    size_t started = 1;
+    for (; started < count; started++) {
+        if (pthread_create(&handles[started], NULL, run_worker, &workers[started]) != 0) {
+            break;
+        }
+    }
+    // Blocks of the workers that could not be started are computed by this thread
+    run_worker(&workers[0]);
+    for (size_t k = started; k < count; k++) {
+        run_worker(&workers[k]);
+    }
+    for (size_t k = 1; k < started; k++) {
+        pthread_join(handles[k], NULL);
+    }
+#else
+    for (size_t k = 0; k < count; k++) {
+        run_worker(&workers[k]);
+    }
+#endif
+
+    for (size_t k = 0; k < count; k++) {
+        if (!workers[k].ok) {
+            log_error("[MFCC] Failed to allocate the buffers of a thread.");
+            return -1;
+        }
+    }
+
+    log_debug("[MFCC] Computed %zu frames with %zu threads.", frames_count, count);
+    return (ssize_t)frames_count;
+}
+
+ssize_t mfcc_compute(const MFCCPlan *plan, const double *samples, size_t samples_count, int threads, double *frames) {
+    return compute_frames(plan, samples, NULL, samples_count, 0, mfcc_frames_count(plan, samples_count), threads, frames);
+}
+
+ssize_t mfcc_compute_pcm16(const MFCCPlan *plan, const int16_t *samples, size_t samples_count, int threads, double *frames) {
+    return compute_frames(plan, NULL, samples, samples_count, 0, mfcc_frames_count(plan, samples_count), threads, frames);
+}
+
+
+struct MFCCStream {
+    MFCCPlan *plan;
+    int threads;
+    double *pending;        // samples from the one before the next frame, or from the first one
+    size_t pending_count;
+    size_t pending_capacity;
+    size_t samples_count;   // pushed so far
+    size_t next_frame;
+};
+
+
+MFCCStream *mfcc_stream_create(const MFCCOptions *options, int threads) {
+    MFCCStream *stream = calloc(1, sizeof(MFCCStream));
+    if (!stream || !(stream->plan = mfcc_plan_create(options))) {
+        log_error("[MFCC] Failed to create the stream.");
+        free(stream);
+        return NULL;
+    }
+    stream->threads = threads;
+    return stream;
+}
+
+void mfcc_stream_destroy(MFCCStream *stream) {
+    if (!stream) {
+        return;
+    }
+    mfcc_plan_destroy(stream->plan);
+    free(stream->pending);
+    free(stream);
+}
+
+size_t mfcc_stream_dim(const MFCCStream *stream) {
+    return stream->plan->dim;
+}
+
+size_t mfcc_stream_max_frames(const MFCCStream *stream, size_t count) {
+    return mfcc_frames_count(stream->plan, stream->samples_count + count) - stream->next_frame;
+}
+
+size_t mfcc_stream_memory(const MFCCStream *stream) {
+    return stream->pending_capacity * sizeof(double);
+}
+
+// Computes the frames before last_frame and drops the samples no later frame needs
+static ssize_t stream_emit(MFCCStream *stream, size_t last_frame, double *frames) {
+    const MFCCPlan *plan = stream->plan;
+    if (last_frame <= stream->next_frame) {
+        return 0;
+    }
+
+    size_t count = last_frame - stream->next_frame;
+    size_t origin = stream->next_frame > 0 ? 1 : 0;
+    if (compute_frames(plan, stream->pending, NULL, stream->pending_count, origin, count, stream->threads, frames) < 0) {
+        return -1;
+    }
+    stream->next_frame = last_frame;
+
+    // Keep the sample before the next frame for the pre-emphasis
+    size_t drop = origin + count * plan->frame_shift - 1;
+    if (drop > stream->pending_count) {
+        drop = stream->pending_count;
+    }
+    memmove(stream->pending, stream->pending + drop, (stream->pending_count - drop) * sizeof(double));
+    stream->pending_count -= drop;
+
+    return (ssize_t)count;
+}
+
+ssize_t mfcc_stream_push_pcm16(MFCCStream *stream, const int16_t *samples, size_t count, double *frames) {
+    const MFCCPlan *plan = stream->plan;
+
+    if (stream->pending_count + count > stream->pending_capacity) {
+        size_t capacity = 2 * stream->pending_capacity;
+        if (capacity < stream->pending_count + count) {
+            capacity = stream->pending_count + count;
+        }
+        double *pending = realloc(stream->pending, capacity * sizeof(double));
+        if (!pending) {
+            log_error("[MFCC] Failed to allocate %zu pending samples.", capacity);
+            return -1;
+        }
+        stream->pending = pending;
+        stream->pending_capacity = capacity;
+    }
+    for (size_t k = 0; k < count; k++) {
+        stream->pending[stream->pending_count + k] = (double)samples[k] / 32768.0;
+    }
+    stream->pending_count += count;
+    stream->samples_count += count;
+
+    // Frames whose window is complete
+    size_t ready = 0;
+    if (stream->samples_count >= plan->used_length) {
+        ready = (stream->samples_count - plan->used_length) / plan->frame_shift + 1;
+    }
+    size_t total = mfcc_frames_count(plan, stream->samples_count);
+    return stream_emit(stream, ready < total ? ready : total, frames);
+}
+
+ssize_t mfcc_stream_finish(MFCCStream *stream, double *frames) {
+    return stream_emit(stream, mfcc_frames_count(stream->plan, stream->samples_count), frames);
+}
@@ -0,0 +1,78 @@
+#ifndef MFCC_H
+#define MFCC_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "dtwbd.h"  // for EXPORT
+
+
+// MFCC frames of mono PCM audio computed as aeneas' MFCC class does, which follows the Sphinx front end:
+// pre-emphasis, Hamming window of window_length seconds every window_shift seconds, power spectrum of
+// the first fft_order windowed samples (numpy.fft.rfft() crops longer windows), triangular mel filters
+// clipped at 1e-5, log and DCT-II with the first filter halved, divided by the number of filters.
+// There are samples_count / shift frames, frames past the end of the audio see zeros.
+// Coefficient 0 is dropped, so a frame has mfcc_size - 1 values, which is the layout build_sync_map aligns.
+typedef struct {
+    size_t sample_rate;
+    size_t filters_count;
+    size_t mfcc_size;
+    size_t fft_order;           // power of two
+    double lower_frequency;
+    double upper_frequency;     // at most sample_rate / 2
+    double emphasis_factor;
+    double window_length;       // seconds
+    double window_shift;        // seconds
+} MFCCOptions;
+
+// Defaults of aeneas' RuntimeConfiguration for 16 kHz audio
+EXPORT extern const MFCCOptions MFCC_DEFAULT_OPTIONS;
+
+// Filters, window and DCT matrix shared by all the computations with the same options
+typedef struct MFCCPlan MFCCPlan;
+
+// Returns NULL on invalid options or if out of memory, NULL options stand for the defaults
+EXPORT MFCCPlan *mfcc_plan_create(const MFCCOptions *options);
+EXPORT void mfcc_plan_destroy(MFCCPlan *plan);
+
+// Values per frame, i.e. mfcc_size - 1
+EXPORT size_t mfcc_plan_dim(const MFCCPlan *plan);
+
+// Samples between the starts of two frames
+EXPORT size_t mfcc_plan_shift(const MFCCPlan *plan);
+
+// Number of frames of samples_count samples
+EXPORT size_t mfcc_frames_count(const MFCCPlan *plan, size_t samples_count);
+
+// Writes the frames of samples in [-1, 1] or of 16-bit PCM to frames, mfcc_frames_count() x mfcc_plan_dim()
+// contiguous values, splitting them in blocks computed by up to threads threads.
+// Returns the number of frames or -1 if out of memory.
+EXPORT ssize_t mfcc_compute(const MFCCPlan *plan, const double *samples, size_t samples_count, int threads, double *frames);
+EXPORT ssize_t mfcc_compute_pcm16(const MFCCPlan *plan, const int16_t *samples, size_t samples_count, int threads, double *frames);
+
+
+// Incremental computation of the frames of 16-bit PCM decoded in chunks.
+// Only the samples of the frames that are not complete yet are kept, so memory is bounded by the chunks.
+// The frames are the same as the ones of mfcc_compute_pcm16() on the whole audio.
+typedef struct MFCCStream MFCCStream;
+
+// Returns NULL on invalid options or if out of memory
+EXPORT MFCCStream *mfcc_stream_create(const MFCCOptions *options, int threads);
+EXPORT void mfcc_stream_destroy(MFCCStream *stream);
+
+EXPORT size_t mfcc_stream_dim(const MFCCStream *stream);
+
+// Upper bound of the frames written by the next push of count samples, or by finish with count = 0
+EXPORT size_t mfcc_stream_max_frames(const MFCCStream *stream, size_t count);
+
+// Bytes of the buffer of pending samples
+EXPORT size_t mfcc_stream_memory(const MFCCStream *stream);
+
+// Appends count samples and writes the frames whose window is complete, returns their number or -1 on error
+EXPORT ssize_t mfcc_stream_push_pcm16(MFCCStream *stream, const int16_t *samples, size_t count, double *frames);
+
+// Ends the audio and writes the remaining frames, whose windows are padded with zeros
+EXPORT ssize_t mfcc_stream_finish(MFCCStream *stream, double *frames);
+
+#endif // MFCC_H
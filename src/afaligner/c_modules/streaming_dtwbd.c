@@ -0,0 +1,501 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include "streaming_dtwbd.h"
+#include "band_matrix.h"   // for the directions
+#include "distance.h"
+#include "workspace.h"
+#include "logger.h"
+
+
+struct StreamingDTWBD {
+    Workspace ws;
+    double *s;
+    size_t n;
+    size_t l;
+    double skip_penalty;
+    int radius;
+    size_t width;           // text frames of every column band
+    size_t capacity;        // columns kept
+
+    // Column j is kept in the slot j % capacity
+    double *costs;          // capacity x width accumulated distances, DBL_MAX for unreachable cells
+    uint8_t *directions;    // capacity x width backpointers
+    uint8_t *marks;         // capacity x width scratch of the traceback, kept zeroed
+    size_t *lo;             // first text frame of the band of every column
+
+    size_t frames;          // audio frames pushed so far
+    size_t next_lo;         // band of the next column
+    bool finished;
+
+    // Best path end so far, it always continues the committed path
+    bool has_end;
+    size_t end_i, end_j;
+    double end_cost;
+    double end_key;
+
+    // Last committed cell
+    bool has_anchor;
+    size_t anchor_i, anchor_j;
+};
+
+
+// Share of the window committed at once when the paths do not meet
+#define STREAMING_FORCE_FRACTION 8
+
+
+static size_t cell_index(const StreamingDTWBD *sd, size_t i, size_t j) {
+    return (j % sd->capacity) * sd->width + (i - sd->lo[j % sd->capacity]);
+}
+
+static size_t first_column(const StreamingDTWBD *sd) {
+    return sd->frames > sd->capacity ? sd->frames - sd->capacity : 0;
+}
+
+static bool in_window(const StreamingDTWBD *sd, size_t j) {
+    return j < sd->frames && j >= first_column(sd);
+}
+
+static bool is_anchor(const StreamingDTWBD *sd, size_t i, size_t j) {
+    return sd->has_anchor && i == sd->anchor_i && j == sd->anchor_j;
+}
+
+static bool predecessor(unsigned direction, size_t *i, size_t *j) {
+    switch (direction) {
+        case DIRECTION_UP: (*i)--; return true;
+        case DIRECTION_LEFT: (*j)--; return true;
+        case DIRECTION_DIAG: (*i)--; (*j)--; return true;
+        default: return false;
+    }
+}
+
+// Path ends are compared without the skip penalty of the unknown audio length,
+// ties go to the first cell in row-major order as in DTWBD()
+static bool better_end(const StreamingDTWBD *sd, double key, size_t i, size_t j) {
+    return !sd->has_end || key < sd->end_key ||
+           (key == sd->end_key && (i < sd->end_i || (i == sd->end_i && j < sd->end_j)));
+}
+
+static void offer_end(StreamingDTWBD *sd, double cost, size_t i, size_t j) {
+    double key = cost - sd->skip_penalty * (double)(i + j);
+    if (better_end(sd, key, i, j)) {
+        sd->has_end = true;
+        sd->end_i = i;
+        sd->end_j = j;
+        sd->end_cost = cost;
+        sd->end_key = key;
+    }
+}
+
+
+size_t streaming_dtwbd_max_output(const StreamingDTWBD *sd, size_t count) {
+    size_t i = sd->has_anchor ? sd->anchor_i : 0;
+    size_t j = sd->has_anchor ? sd->anchor_j : 0;
+    return (sd->n - i) + (sd->frames + count - j) + 1;
+}
+
+size_t streaming_dtwbd_frames(const StreamingDTWBD *sd) {
+    return sd->frames;
+}
+
+size_t streaming_dtwbd_memory(const StreamingDTWBD *sd) {
+    return sd->ws.size + sizeof(StreamingDTWBD);
+}
+
+
+StreamingDTWBD *streaming_dtwbd_create(
+    const double *s, size_t n, size_t l,
+    double skip_penalty,
+    int radius,
+    size_t window
+) {
+    if (n == 0 || radius < 0 || window == 0) {
+        log_error("[Streaming] Invalid arguments: n=%zu, radius=%d, window=%zu.", n, radius, window);
+        return NULL;
+    }
+
+    StreamingDTWBD *sd = calloc(1, sizeof(StreamingDTWBD));
+    if (!sd) {
+        log_error("[Streaming] Failed to allocate the engine.");
+        return NULL;
+    }
+
+    sd->n = n;
+    sd->l = l;
+    sd->skip_penalty = skip_penalty;
+    sd->radius = radius;
+    sd->width = (size_t)radius < n / 2 ? 2 * (size_t)radius + 1 : n;
+    sd->capacity = window;
+
+    size_t cells = sd->capacity * sd->width;
+    size_t size = workspace_block_size(n * l * sizeof(double)) +
+                  workspace_block_size(cells * sizeof(double)) +
+                  2 * workspace_block_size(cells) +
+                  workspace_block_size(sd->capacity * sizeof(size_t));
+    if (!workspace_init(&sd->ws, size)) {
+        free(sd);
+        return NULL;
+    }
+
+    sd->s = workspace_alloc(&sd->ws, n * l * sizeof(double));
+    sd->costs = workspace_alloc(&sd->ws, cells * sizeof(double));
+    sd->directions = workspace_alloc(&sd->ws, cells);
+    sd->marks = workspace_alloc(&sd->ws, cells);
+    sd->lo = workspace_alloc(&sd->ws, sd->capacity * sizeof(size_t));
+    memcpy(sd->s, s, n * l * sizeof(double));
+    memset(sd->marks, 0, cells);
+
+    log_info("[Streaming] Created for %zu text frames, band of %zu frames, window of %zu frames.",
+             n, sd->width, sd->capacity);
+
+    return sd;
+}
+
+void streaming_dtwbd_destroy(StreamingDTWBD *sd) {
+    if (!sd) {
+        return;
+    }
+
+    workspace_free(&sd->ws);
+    free(sd);
+}
+
+
+// Computes the column of the next audio frame, whose slot must be free
+static void push_column(StreamingDTWBD *sd, const double *y) {
+    size_t j = sd->frames, width = sd->width;
+    size_t lo = sd->next_lo;
+    size_t slot = j % sd->capacity;
+    double *column = &sd->costs[slot * width];
+    uint8_t *directions = &sd->directions[slot * width];
+
+    const double *prev = NULL;
+    size_t prev_lo = 0;
+    if (j > 0) {
+        prev_lo = sd->lo[(j - 1) % sd->capacity];
+        prev = &sd->costs[((j - 1) % sd->capacity) * width];
+    }
+
+    DistanceKernel distance = euclid_distance_kernel;
+    size_t best_row = lo;
+    double best_row_key = DBL_MAX;
+
+    for (size_t r = 0; r < width; r++) {
+        size_t i = lo + r;
+        double d = distance(&sd->s[i * sd->l], y, sd->l);
+
+        double min_prev_distance = DBL_MAX;
+        unsigned direction = DIRECTION_NONE;
+
+        // Same order of comparisons as in DTWBD() to get the same ties
+        if (r > 0 && column[r - 1] < min_prev_distance) {
+            min_prev_distance = column[r - 1];
+            direction = DIRECTION_UP;
+        }
+        if (prev && i >= prev_lo && i < prev_lo + width && prev[i - prev_lo] < min_prev_distance) {
+            min_prev_distance = prev[i - prev_lo];
+            direction = DIRECTION_LEFT;
+        }
+        if (prev && i > prev_lo && i - 1 < prev_lo + width && prev[i - 1 - prev_lo] < min_prev_distance) {
+            min_prev_distance = prev[i - 1 - prev_lo];
+            direction = DIRECTION_DIAG;
+        }
+
+        // Only (0, 0) starts a path, other cells are unreachable without a predecessor
+        double cost = DBL_MAX;
+        if (direction != DIRECTION_NONE) {
+            cost = d + min_prev_distance;
+        } else if (i == 0 && j == 0) {
+            cost = d;
+        }
+        column[r] = cost;
+        directions[r] = (uint8_t)direction;
+
+        if (cost < DBL_MAX) {
+            offer_end(sd, cost, i, j);
+            double row_key = cost;
+            if (row_key < best_row_key) {
+                best_row_key = row_key;
+                best_row = i;
+            }
+        }
+    }
+
+    sd->lo[slot] = lo;
+    sd->frames++;
+
+    // The next band is centered on the cheapest partial path and never moves back
+    size_t radius = (size_t)sd->radius;
+    size_t want = best_row > radius ? best_row - radius : 0;
+    if (want > sd->n - width) {
+        want = sd->n - width;
+    }
+    if (best_row_key < DBL_MAX && want > lo) {
+        sd->next_lo = want;
+    }
+}
+
+
+// Finds the last cell that the paths of all the cells of the last column and of the best end go through.
+// Returns false if it is the anchor, i.e. there is nothing new to commit.
+static bool find_meeting_cell(StreamingDTWBD *sd, size_t *meet_i, size_t *meet_j) {
+    if (sd->frames == 0 || !sd->has_end || is_anchor(sd, sd->end_i, sd->end_j)) {
+        return false;
+    }
+
+    size_t width = sd->width;
+    size_t last = sd->frames - 1, first = first_column(sd);
+    size_t pending = 0;
+
+    for (size_t r = 0; r < width; r++) {
+        size_t cell = (last % sd->capacity) * width + r;
+        if (sd->costs[cell] < DBL_MAX) {
+            sd->marks[cell] = 1;
+            pending++;
+        }
+    }
+    size_t end_cell = cell_index(sd, sd->end_i, sd->end_j);
+    if (!sd->marks[end_cell]) {
+        sd->marks[end_cell] = 1;
+        pending++;
+    }
+
+    // Cells are visited after all the cells whose paths go through them,
+    // so the meeting cell is the first one visited with nothing else pending.
+    // Paths that leave the window go to the anchor, which is counted once.
+    bool anchor_pending = false;
+    for (size_t j = last;; j--) {
+        size_t lo = sd->lo[j % sd->capacity];
+        for (size_t r = width; r-- > 0;) {
+            size_t cell = (j % sd->capacity) * width + r;
+            if (!sd->marks[cell]) {
+                continue;
+            }
+            sd->marks[cell] = 0;
+            pending--;
+
+            size_t i = lo + r;
+            if (pending == 0) {
+                *meet_i = i;
+                *meet_j = j;
+                return !is_anchor(sd, i, j);
+            }
+
+            size_t pi = i, pj = j;
+            if (!predecessor(sd->directions[cell], &pi, &pj)) {
+                continue;
+            }
+            if (pj < first) {
+                if (!anchor_pending) {
+                    anchor_pending = true;
+                    pending++;
+                }
+                continue;
+            }
+            size_t prev_cell = cell_index(sd, pi, pj);
+            if (!sd->marks[prev_cell]) {
+                sd->marks[prev_cell] = 1;
+                pending++;
+            }
+        }
+        if (j == first) {
+            break;
+        }
+    }
+
+    // Only the anchor is left
+    return false;
+}
+
+
+// Writes the path from the anchor (excluded) to (i, j) and makes (i, j) the anchor
+static size_t commit_path(StreamingDTWBD *sd, size_t i, size_t j, size_t *path_buffer) {
+    size_t count = 0;
+    size_t end_i = i, end_j = j;
+
+    while (!is_anchor(sd, i, j)) {
+        path_buffer[2 * count] = i;
+        path_buffer[2 * count + 1] = j;
+        count++;
+
+        if (!predecessor(sd->directions[cell_index(sd, i, j)], &i, &j)) {
+            break;
+        }
+        if (!in_window(sd, j)) {
+            // Paths leave the window only in the evicted column of the anchor, which they reach going up
+            for (; i > sd->anchor_i; i--) {
+                path_buffer[2 * count] = i;
+                path_buffer[2 * count + 1] = j;
+                count++;
+            }
+            break;
+        }
+    }
+    if (count > 1) {
+        reverse_path(path_buffer, (ssize_t)count);
+    }
+
+    sd->has_anchor = true;
+    sd->anchor_i = end_i;
+    sd->anchor_j = end_j;
+
+    return count;
+}
+
+
+// Commits the path of the best end up to a column ahead of the oldest one when the paths do not meet,
+// drops the cells that do not continue it and looks for the best end again
+static size_t force_commit(StreamingDTWBD *sd, size_t *path_buffer) {
+    size_t width = sd->width;
+    size_t first = first_column(sd), last = sd->frames - 1;
+    size_t step = sd->capacity / STREAMING_FORCE_FRACTION;
+    size_t target = first + (step > 0 ? step : 1);
+
+    // The best end may be the anchor that left the window, then the best cell of the window goes on
+    if (!in_window(sd, sd->end_j)) {
+        bool has_end = sd->has_end;
+        size_t end_i = sd->end_i, end_j = sd->end_j;
+        double end_cost = sd->end_cost, end_key = sd->end_key;
+
+        sd->has_end = false;
+        for (size_t j = first; j <= last; j++) {
+            size_t slot = j % sd->capacity;
+            for (size_t r = 0; r < width; r++) {
+                if (sd->costs[slot * width + r] < DBL_MAX) {
+                    offer_end(sd, sd->costs[slot * width + r], sd->lo[slot] + r, j);
+                }
+            }
+        }
+        if (!sd->has_end) {
+            sd->has_end = has_end;
+            sd->end_i = end_i;
+            sd->end_j = end_j;
+            sd->end_cost = end_cost;
+            sd->end_key = end_key;
+            return 0;
+        }
+    }
+
+    // Trace the path of the best end into the target column
+    size_t i = sd->end_i, j = sd->end_j;
+    while (j > target) {
+        size_t pi = i, pj = j;
+        if (!predecessor(sd->directions[cell_index(sd, i, j)], &pi, &pj) || !in_window(sd, pj) || is_anchor(sd, pi, pj)) {
+            break;
+        }
+        i = pi;
+        j = pj;
+    }
+
+    log_debug("[Streaming] Paths do not meet within the window, committing up to (%zu, %zu).", i, j);
+    size_t count = commit_path(sd, i, j, path_buffer);
+    size_t anchor_i = i, anchor_j = j;
+
+    // Cells continue the anchor if their predecessor does, the marks hold the result
+    for (j = anchor_j; j <= last; j++) {
+        size_t slot = j % sd->capacity;
+        size_t lo = sd->lo[slot];
+        for (size_t r = 0; r < width; r++) {
+            size_t cell = slot * width + r;
+            i = lo + r;
+            bool valid;
+            if (i == anchor_i && j == anchor_j) {
+                valid = true;
+            } else if (sd->costs[cell] == DBL_MAX) {
+                valid = false;
+            } else {
+                size_t pi = i, pj = j;
+                valid = predecessor(sd->directions[cell], &pi, &pj) && pj >= anchor_j &&
+                        sd->marks[cell_index(sd, pi, pj)];
+            }
+            sd->marks[cell] = valid;
+        }
+    }
+
+    sd->has_end = false;
+    offer_end(sd, sd->costs[cell_index(sd, anchor_i, anchor_j)], anchor_i, anchor_j);
+    for (j = anchor_j; j <= last; j++) {
+        size_t slot = j % sd->capacity;
+        size_t lo = sd->lo[slot];
+        for (size_t r = 0; r < width; r++) {
+            size_t cell = slot * width + r;
+            if (!sd->marks[cell]) {
+                sd->costs[cell] = DBL_MAX;
+            } else if (j > anchor_j) {
+                offer_end(sd, sd->costs[cell], lo + r, j);
+            }
+            sd->marks[cell] = 0;
+        }
+    }
+
+    return count;
+}
+
+
+// Frees the slot of the oldest column, committing its part of the path first
+static size_t evict_column(StreamingDTWBD *sd, size_t *path_buffer) {
+    size_t oldest = sd->frames - sd->capacity;
+    if (!sd->has_end || (sd->has_anchor && sd->anchor_j > oldest)) {
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t i, j;
+    if (find_meeting_cell(sd, &i, &j)) {
+        count = commit_path(sd, i, j, path_buffer);
+    }
+    if (sd->has_anchor && sd->anchor_j > oldest) {
+        return count;
+    }
+
+    return count + force_commit(sd, &path_buffer[2 * count]);
+}
+
+
+ssize_t streaming_dtwbd_push(StreamingDTWBD *sd, const double *frames, size_t count, size_t *path_buffer) {
+    if (sd->finished) {
+        log_error("[Streaming] Frames pushed after the end of the audio.");
+        return -1;
+    }
+
+    size_t written = 0;
+    for (size_t k = 0; k < count; k++) {
+        if (sd->frames >= sd->capacity) {
+            written += evict_column(sd, &path_buffer[2 * written]);
+        }
+        push_column(sd, &frames[k * sd->l]);
+    }
+
+    size_t i, j;
+    if (find_meeting_cell(sd, &i, &j)) {
+        written += commit_path(sd, i, j, &path_buffer[2 * written]);
+    }
+
+    return (ssize_t)written;
+}
+
+
+ssize_t streaming_dtwbd_finish(StreamingDTWBD *sd, size_t *path_buffer, double *path_distance) {
+    if (sd->finished) {
+        log_error("[Streaming] The audio is already finished.");
+        return -1;
+    }
+    sd->finished = true;
+
+    if (!sd->has_end) {
+        log_info("[Streaming] No matching path found");
+        return 0;
+    }
+
+    size_t n = sd->n, m = sd->frames;
+    *path_distance = sd->end_cost + sd->skip_penalty * (n - sd->end_i + m - sd->end_j - 2);
+
+    size_t count = in_window(sd, sd->end_j) ? commit_path(sd, sd->end_i, sd->end_j, path_buffer) : 0;
+
+    log_info("[Streaming] Finished after %zu frames. Min path distance: %.4f, end_i: %zu, end_j: %zu",
+             m, *path_distance, sd->end_i, sd->end_j);
+
+    return (ssize_t)count;
+}
@@ -0,0 +1,51 @@
+#ifndef STREAMING_DTWBD_H
+#define STREAMING_DTWBD_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "dtwbd.h"  // for EXPORT
+
+
+// Online DTWBD of a text sequence known up front against audio frames pushed in chunks.
+//
+// Audio frames are the columns of the DTWBD matrix. Each column is computed over a band of
+// 2 x radius + 1 text frames that follows the cheapest partial path, and only the last `window` columns
+// of accumulated distances and backpointers are kept, so memory does not depend on the audio length.
+// The recurrence and the path end are those of DTWBD(): the path starts at (0, 0), leading audio
+// is skipped along the first row and the path may end anywhere at skip_penalty per unmatched frame.
+//
+// The path is returned as it becomes stable: a prefix is committed once the paths of all the cells
+// of the last column and of the best end so far go through it. If they do not meet within the window,
+// the prefix of the best path is committed and the cells that do not continue it are dropped.
+// With radius >= n and window >= m the path is the one of DTWBD() on the whole sequences.
+typedef struct StreamingDTWBD StreamingDTWBD;
+
+// Copies the text sequence s (n x l), returns NULL on invalid arguments or if out of memory
+EXPORT StreamingDTWBD *streaming_dtwbd_create(
+    const double *s, size_t n, size_t l,
+    double skip_penalty,
+    int radius,
+    size_t window
+);
+EXPORT void streaming_dtwbd_destroy(StreamingDTWBD *sd);
+
+// Aligns the next count audio frames (count x l) and writes the newly committed cells to path_buffer.
+// Returns their number or -1 on error, path_buffer must hold streaming_dtwbd_max_output(sd, count) cells.
+EXPORT ssize_t streaming_dtwbd_push(StreamingDTWBD *sd, const double *frames, size_t count, size_t *path_buffer);
+
+// Ends the audio, writes the rest of the path to path_buffer and its distance to path_distance.
+// Returns the number of cells, 0 if there is no match, or -1 on error.
+// path_buffer must hold streaming_dtwbd_max_output(sd, 0) cells.
+EXPORT ssize_t streaming_dtwbd_finish(StreamingDTWBD *sd, size_t *path_buffer, double *path_distance);
+
+// Upper bound of the cells written by the next push of count frames or by finish with count = 0
+EXPORT size_t streaming_dtwbd_max_output(const StreamingDTWBD *sd, size_t count);
+
+// Audio frames pushed so far
+EXPORT size_t streaming_dtwbd_frames(const StreamingDTWBD *sd);
+
+// Bytes held by the engine, fixed at creation
+EXPORT size_t streaming_dtwbd_memory(const StreamingDTWBD *sd);
+
+#endif // STREAMING_DTWBD_H
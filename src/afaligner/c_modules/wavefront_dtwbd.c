@@ -0,0 +1,378 @@
+#include "wavefront_dtwbd.h"
+#include "distance.h"
+#include "logger.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#if !defined(_WIN32) && !defined(__WIN32__) && !defined(__STDC_NO_ATOMICS__)
+#define WAVEFRONT_THREADS 1
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
+
+// Busy waits before a waiting thread yields the CPU
+#define WAVEFRONT_SPINS 64
+
+
+size_t wavefront_threads(size_t n, int threads) {
+    size_t strips_count = (n + WAVEFRONT_STRIP_ROWS - 1) / WAVEFRONT_STRIP_ROWS;
+    size_t count = threads > 1 ? (size_t)threads : 1;
+
+    if (count > WAVEFRONT_MAX_THREADS) count = WAVEFRONT_MAX_THREADS;
+    if (count > strips_count) count = strips_count;
+
+    return count > 0 ? count : 1;
+}
+
+
+#ifdef WAVEFRONT_THREADS
+
+// Last row of a strip passed to the strip below.
+// The counters only grow: a slot is taken by a new strip after the reader of the previous one has finished.
+typedef struct {
+    _Alignas(WORKSPACE_ALIGNMENT) atomic_size_t owner;  // strip + 1 of the row being written, 0 for none
+    atomic_size_t progress;     // costs of the columns below progress are final
+    atomic_size_t consumed;     // strip + 1 of the last row read by the strip below, 0 for none
+    double *costs;              // m accumulated distances indexed by column, valid inside the window of the row
+} WavefrontSlot;
+
+typedef struct {
+    BandMatrix *D;
+    double *s;
+    double *t;
+    size_t dim;
+    double skip_penalty;
+    DistanceKernel distance;
+    size_t strips_count;
+    atomic_size_t next_strip;
+    WavefrontSlot *slots;
+    size_t slots_count;
+} Wavefront;
+
+typedef struct {
+    _Alignas(WORKSPACE_ALIGNMENT) Wavefront *wf;
+    double *tile;       // WAVEFRONT_STRIP_ROWS x (WAVEFRONT_TILE_COLUMNS + 1) accumulated distances
+    bool match;
+    double min_path_distance;
+    size_t end_i;
+    size_t end_j;
+} WavefrontWorker;
+
+
+static size_t tile_stride(void) {
+    return WAVEFRONT_TILE_COLUMNS + 1;
+}
+
+bool wavefront_supported(void) {
+    return true;
+}
+
+size_t wavefront_workspace_size(size_t n, size_t m, int threads) {
+    size_t count = wavefront_threads(n, threads);
+
+    return workspace_block_size(2 * count * sizeof(WavefrontSlot)) +
+           2 * count * workspace_block_size(m * sizeof(double)) +
+           workspace_block_size(count * sizeof(WavefrontWorker)) +
+           count * workspace_block_size(WAVEFRONT_STRIP_ROWS * tile_stride() * sizeof(double)) +
+           workspace_block_size(count * sizeof(pthread_t));
+}
+
+
+static void wait_at_least(atomic_size_t *value, size_t target) {
+    for (unsigned spins = 0; atomic_load_explicit(value, memory_order_acquire) < target; spins++) {
+        if (spins >= WAVEFRONT_SPINS) {
+            sched_yield();
+        }
+    }
+}
+
+// Whether (i, j) ends a cheaper path than the best one, ties go to the first cell in the row major order
+// as in the row by row fill, since cells are not visited in that order
+static bool better_end(double path_distance, size_t i, size_t j, bool match, double best, size_t best_i, size_t best_j) {
+    if (path_distance < best) {
+        return true;
+    }
+    return match && path_distance == best && (i < best_i || (i == best_i && j < best_j));
+}
+
+
+// Fills the rows [i0, i1) of the strip tile by tile.
+// tile[r * stride] is the cell (i0 + r, c0 - 1) of the previous tile and tile[r * stride + 1 + j - c0] is (i0 + r, j),
+// cells outside the window are INFINITY, which never wins the strict comparisons of the recurrence.
+static void fill_strip(Wavefront *wf, WavefrontWorker *w, size_t strip) {
+    BandMatrix *D = wf->D;
+    size_t n = D->n, m = D->m, dim = wf->dim;
+    double *s = wf->s, *t = wf->t;
+    double skip_penalty = wf->skip_penalty;
+    DistanceKernel distance = wf->distance;
+
+    size_t i0 = strip * WAVEFRONT_STRIP_ROWS;
+    size_t i1 = i0 + WAVEFRONT_STRIP_ROWS < n ? i0 + WAVEFRONT_STRIP_ROWS : n;
+    size_t rows = i1 - i0;
+    size_t stride = tile_stride();
+    double *tile = w->tile;
+
+    WavefrontSlot *out = &wf->slots[strip % wf->slots_count];
+    WavefrontSlot *in = strip > 0 ? &wf->slots[(strip - 1) % wf->slots_count] : NULL;
+
+    if (strip >= wf->slots_count) {
+        wait_at_least(&out->consumed, strip - wf->slots_count + 1);
+    }
+    atomic_store_explicit(&out->progress, 0, memory_order_relaxed);
+    atomic_store_explicit(&out->owner, strip + 1, memory_order_release);
+    if (in) {
+        wait_at_least(&in->owner, strip);
+    }
+
+    size_t up_lo = 0, up_hi = 0;
+    if (i0 > 0) {
+        up_lo = band_lo(D, i0 - 1);
+        up_hi = band_hi(D, i0 - 1);
+    }
+
+    // Tiles cover the union of the windows of the strip
+    size_t c_lo = m, c_hi = 0;
+    for (size_t i = i0; i < i1; i++) {
+        size_t lo = band_lo(D, i), hi = band_hi(D, i);
+        if (lo < hi) {
+            if (lo < c_lo) c_lo = lo;
+            if (hi > c_hi) c_hi = hi;
+        }
+    }
+
+    // Bytes of backpointers shared with the neighboring strips are updated atomically
+    size_t first_byte = D->offsets[i0] / 4;
+    size_t last_byte = D->offsets[i1] > D->offsets[i0] ? (D->offsets[i1] - 1) / 4 : first_byte;
+
+    bool match = false;
+    double best = DBL_MAX;
+    size_t best_i = 0, best_j = 0;
+
+    for (size_t r = 0; r < rows; r++) {
+        tile[r * stride] = INFINITY;
+    }
+
+    for (size_t c0 = c_lo; c0 < c_hi; c0 += WAVEFRONT_TILE_COLUMNS) {
+        size_t c1 = c0 + WAVEFRONT_TILE_COLUMNS < c_hi ? c0 + WAVEFRONT_TILE_COLUMNS : c_hi;
+
+        if (in) {
+            wait_at_least(&in->progress, c1);
+        }
+
+        for (size_t r = 0; r < rows; r++) {
+            size_t i = i0 + r;
+            size_t lo = band_lo(D, i), hi = band_hi(D, i);
+            size_t a = lo > c0 ? lo : c0;
+            size_t b = hi < c1 ? hi : c1;
+            if (a > b) {
+                // The window of the row misses the tile
+                a = b = c0;
+            }
+
+            double *row = &tile[r * stride];
+            const double *up = r > 0 ? &tile[(r - 1) * stride] : NULL;
+
+            for (size_t j = c0; j < a; j++) row[1 + j - c0] = INFINITY;
+            for (size_t j = b; j < c1; j++) row[1 + j - c0] = INFINITY;
+
+            size_t cell = D->offsets[i] + a - lo;
+            for (size_t j = a; j < b; j++, cell++) {
+                double d = distance(&s[i * dim], &t[j * dim], dim);
+
+                double up_distance, diag_distance;
+                if (up) {
+                    up_distance = up[1 + j - c0];
+                    diag_distance = up[j - c0];
+                } else {
+                    up_distance = j >= up_lo && j < up_hi ? in->costs[j] : INFINITY;
+                    diag_distance = j > up_lo && j - 1 < up_hi ? in->costs[j - 1] : INFINITY;
+                }
+
+                double min_prev_distance = DBL_MAX;
+                unsigned direction = DIRECTION_NONE;
+
+                // Same order of comparisons as in fill_rolling() to get the same ties
+                if (up_distance < min_prev_distance) {
+                    min_prev_distance = up_distance;
+                    direction = DIRECTION_UP;
+                }
+                if (row[j - c0] < min_prev_distance) {
+                    min_prev_distance = row[j - c0];
+                    direction = DIRECTION_LEFT;
+                }
+                if (diag_distance < min_prev_distance) {
+                    min_prev_distance = diag_distance;
+                    direction = DIRECTION_DIAG;
+                }
+
+                double cost = d + (min_prev_distance == DBL_MAX ? 0 : min_prev_distance);
+                row[1 + j - c0] = cost;
+
+                if (cell / 4 == first_byte || cell / 4 == last_byte) {
+                    __atomic_fetch_or(&D->directions[cell / 4], (uint8_t)(direction << (2 * (cell % 4))), __ATOMIC_RELAXED);
+                } else {
+                    band_set_direction(D, cell, direction);
+                }
+
+                double cur_path_distance = cost + skip_penalty * (n - i + m - j - 2);
+                if (better_end(cur_path_distance, i, j, match, best, best_i, best_j)) {
+                    best = cur_path_distance;
+                    best_i = i;
+                    best_j = j;
+                    match = true;
+                }
+            }
+        }
+
+        const double *last_row = &tile[(rows - 1) * stride];
+        for (size_t j = c0; j < c1; j++) {
+            out->costs[j] = last_row[1 + j - c0];
+        }
+        atomic_store_explicit(&out->progress, c1, memory_order_release);
+
+        for (size_t r = 0; r < rows; r++) {
+            tile[r * stride] = tile[r * stride + c1 - c0];
+        }
+    }
+
+    atomic_store_explicit(&out->progress, m, memory_order_release);
+    if (in) {
+        atomic_store_explicit(&in->consumed, strip, memory_order_release);
+    }
+
+    if (match && better_end(best, best_i, best_j, w->match, w->min_path_distance, w->end_i, w->end_j)) {
+        w->min_path_distance = best;
+        w->end_i = best_i;
+        w->end_j = best_j;
+        w->match = true;
+    }
+}
+
+// Takes strips in order until there are none, every wait is for an earlier strip
+static void *run_worker(void *arg) {
+    WavefrontWorker *w = arg;
+    Wavefront *wf = w->wf;
+
+    for (;;) {
+        size_t strip = atomic_fetch_add_explicit(&wf->next_strip, 1, memory_order_relaxed);
+        if (strip >= wf->strips_count) {
+            break;
+        }
+        fill_strip(wf, w, strip);
+    }
+
+    return NULL;
+}
+
+
+bool fill_wavefront(
+    BandMatrix *D,
+    double *s, double *t, size_t dim,
+    double skip_penalty,
+    int threads,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j,
+    Workspace *ws
+) {
+    size_t n = D->n, m = D->m;
+    size_t count = wavefront_threads(n, threads);
+
+    size_t ws_mark = workspace_mark(ws);
+    Wavefront wf = {
+        .D = D,
+        .s = s,
+        .t = t,
+        .dim = dim,
+        .skip_penalty = skip_penalty,
+        .distance = euclid_distance_kernel,
+        .strips_count = (n + WAVEFRONT_STRIP_ROWS - 1) / WAVEFRONT_STRIP_ROWS,
+        .slots_count = 2 * count,
+    };
+    atomic_init(&wf.next_strip, 0);
+
+    wf.slots = workspace_alloc(ws, wf.slots_count * sizeof(WavefrontSlot));
+    WavefrontWorker *workers = workspace_alloc(ws, count * sizeof(WavefrontWorker));
+    pthread_t *handles = workspace_alloc(ws, count * sizeof(pthread_t));
+    bool allocated = wf.slots && workers && handles;
+
+    for (size_t k = 0; allocated && k < wf.slots_count; k++) {
+        WavefrontSlot *slot = &wf.slots[k];
+        atomic_init(&slot->owner, 0);
+        atomic_init(&slot->progress, 0);
+        atomic_init(&slot->consumed, 0);
+        slot->costs = workspace_alloc(ws, m * sizeof(double));
+        allocated = slot->costs != NULL;
+    }
+    for (size_t k = 0; allocated && k < count; k++) {
+        workers[k] = (WavefrontWorker){ .wf = &wf, .min_path_distance = DBL_MAX };
+        workers[k].tile = workspace_alloc(ws, WAVEFRONT_STRIP_ROWS * tile_stride() * sizeof(double));
+        allocated = workers[k].tile != NULL;
+    }
+    if (!allocated) {
+        log_error("[Wavefront] Failed to allocate memory for %zu threads.", count);
+        workspace_release(ws, ws_mark);
+        return false;
+    }
+
+    // The calling thread is the worker 0, the fill is correct with any number of started threads
+    size_t started = 1;
+    for (size_t k = 1; k < count; k++) {
+        if (pthread_create(&handles[k], NULL, run_worker, &workers[k]) != 0) {
+            log_warn("[Wavefront] Failed to start a thread, filling with %zu threads.", started);
+            break;
+        }
+        started++;
+    }
+    run_worker(&workers[0]);
+    for (size_t k = 1; k < started; k++) {
+        pthread_join(handles[k], NULL);
+    }
+
+    bool match = false;
+    for (size_t k = 0; k < started; k++) {
+        WavefrontWorker *w = &workers[k];
+        if (w->match && better_end(w->min_path_distance, w->end_i, w->end_j, match, *min_path_distance, *end_i, *end_j)) {
+            *min_path_distance = w->min_path_distance;
+            *end_i = w->end_i;
+            *end_j = w->end_j;
+            match = true;
+        }
+    }
+
+    workspace_release(ws, ws_mark);
+
+    return match;
+}
+
+#else
+
+bool wavefront_supported(void) {
+    return false;
+}
+
+size_t wavefront_workspace_size(size_t n, size_t m, int threads) {
+    (void)n;
+    (void)m;
+    (void)threads;
+    return 0;
+}
+
+bool fill_wavefront(
+    BandMatrix *D,
+    double *s, double *t, size_t dim,
+    double skip_penalty,
+    int threads,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j,
+    Workspace *ws
+) {
+    (void)D; (void)s; (void)t; (void)dim; (void)skip_penalty; (void)threads;
+    (void)min_path_distance; (void)end_i; (void)end_j; (void)ws;
+    log_error("[Wavefront] Threads are not supported by this build.");
+    return false;
+}
+
+#endif
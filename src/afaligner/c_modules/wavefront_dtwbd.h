@@ -0,0 +1,43 @@
+#ifndef WAVEFRONT_DTWBD_H
+#define WAVEFRONT_DTWBD_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "band_matrix.h"
+#include "workspace.h"
+
+
+// Rows of a strip and columns of a tile, a tile is the unit of work between two synchronizations
+#define WAVEFRONT_STRIP_ROWS 32
+#define WAVEFRONT_TILE_COLUMNS 32
+
+// Smaller matrices are filled by one thread
+#define WAVEFRONT_MIN_CELLS (1 << 16)
+#define WAVEFRONT_MAX_THREADS 256
+
+
+// Multithreaded fill of the rolling storage (DTWBDOptions.threads > 1).
+// The matrix is split into strips of WAVEFRONT_STRIP_ROWS rows that the threads take in order.
+// A strip is filled tile by tile from left to right, a tile starts as soon as the strip above
+// has finished the same columns, so the threads sweep the band as a wavefront.
+// The last row of every strip is passed to the strip below through a ring of 2 x threads slots,
+// so the memory does not depend on the number of strips.
+// Every cell is computed as in the row by row fill with direct distances,
+// the backpointers and the path end do not depend on the number of threads.
+
+bool wavefront_supported(void);
+size_t wavefront_threads(size_t n, int threads);
+size_t wavefront_workspace_size(size_t n, size_t m, int threads);
+
+// Fills the packed backpointers of D, returns whether a path end is found
+bool fill_wavefront(
+    BandMatrix *D,
+    double *s, double *t, size_t dim,
+    double skip_penalty,
+    int threads,
+    double *min_path_distance,
+    size_t *end_i, size_t *end_j,
+    Workspace *ws
+);
+
+#endif
@@ -0,0 +1,80 @@
+#include "workspace.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+
+bool workspace_init(Workspace *ws, size_t size) {
+    ws->size = workspace_block_size(size > 0 ? size : 1);
+    ws->used = 0;
+    ws->peak = 0;
+    ws->allocated = 0;
+
+    // Over-allocate to be able to align the base, malloc guarantees only 16 bytes
+    ws->base = malloc(ws->size + WORKSPACE_ALIGNMENT);
+    if (!ws->base) {
+        log_error("[Workspace] Failed to allocate workspace of %zu bytes.", ws->size);
+        ws->size = 0;
+        return false;
+    }
+
+    log_debug("[Workspace] Workspace of %zu bytes created at %p", ws->size, (void *)ws->base);
+
+    return true;
+}
+
+void workspace_free(Workspace *ws) {
+    if (!ws->base) {
+        return;
+    }
+
+    log_info("[Workspace] Freed workspace of %zu bytes, peak usage %zu bytes.", ws->size, ws->peak);
+    free(ws->base);
+    ws->base = NULL;
+    ws->size = 0;
+    ws->used = 0;
+}
+
+// Empties a workspace for reuse, reallocating it only if it is smaller than size,
+// so a workspace reused across alignments grows to the largest of them.
+// The workspace must be zeroed or initialized before the first call.
+bool workspace_reserve(Workspace *ws, size_t size) {
+    if (ws->base && workspace_block_size(size > 0 ? size : 1) <= ws->size) {
+        ws->used = 0;
+        ws->peak = 0;
+        ws->allocated = 0;
+        return true;
+    }
+
+    workspace_free(ws);
+    return workspace_init(ws, size);
+}
+
+void *workspace_alloc(Workspace *ws, size_t size) {
+    size_t block_size = workspace_block_size(size);
+    if (block_size > ws->size - ws->used) {
+        log_error("[Workspace] Out of workspace memory: requested %zu bytes, %zu of %zu bytes are used.",
+                  size, ws->used, ws->size);
+        return NULL;
+    }
+
+    uintptr_t aligned_base = ((uintptr_t)ws->base + WORKSPACE_ALIGNMENT - 1) & ~(uintptr_t)(WORKSPACE_ALIGNMENT - 1);
+    void *block = (char *)aligned_base + ws->used;
+    ws->used += block_size;
+    ws->allocated += block_size;
+    if (ws->used > ws->peak) {
+        ws->peak = ws->used;
+    }
+
+    return block;
+}
+
+size_t workspace_mark(const Workspace *ws) {
+    return ws->used;
+}
+
+void workspace_release(Workspace *ws, size_t mark) {
+    if (mark <= ws->used) {
+        ws->used = mark;
+    }
+}
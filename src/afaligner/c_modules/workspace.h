@@ -0,0 +1,37 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Alignment of every block carved from a workspace
+#define WORKSPACE_ALIGNMENT 64
+
+
+// Arena that holds all scratch memory of an alignment.
+// It is allocated once with a precomputed size, blocks are carved from it
+// with a bump pointer and released in the LIFO order with workspace_release().
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+    size_t allocated;   // bytes of all the blocks carved so far, released ones included
+} Workspace;
+
+
+// API
+bool workspace_init(Workspace *ws, size_t size);
+void workspace_free(Workspace *ws);
+bool workspace_reserve(Workspace *ws, size_t size);
+void *workspace_alloc(Workspace *ws, size_t size);
+size_t workspace_mark(const Workspace *ws);
+void workspace_release(Workspace *ws, size_t mark);
+
+
+// Returns the number of workspace bytes taken by a block of the given size
+static inline size_t workspace_block_size(size_t size) {
+    return (size + WORKSPACE_ALIGNMENT - 1) / WORKSPACE_ALIGNMENT * WORKSPACE_ALIGNMENT;
+}
+
+#endif
@@ -0,0 +1,168 @@
+import hashlib
+import json
+import os
+import tempfile
+
+from afaligner.c_dtwbd_wrapper import Pyramid, FastDTWBDError
+
+
+# Bumped whenever the stored features change for the same audio and parameters
+FEATURES_VERSION = 1
+
+DEFAULT_CACHE_SIZE = 2 * 1024 ** 3
+
+
+class FeatureCache:
+    """
+    Persistent cache of the MFCC features of audio files and of synthesized texts.
+
+    Entries are pyramid files (see Pyramid.save()) named after the SHA-256 of the content
+    and of the feature parameters, so renamed or copied files hit the same entry
+    and a change of the parameters misses it. Entries are opened with mmap, a hit costs hashing the content only.
+    An entry may come with JSON metadata, e.g. the anchors of a text, stored next to it.
+
+    The total size of the entries is kept under `max_size` bytes by removing the least recently used ones,
+    every hit refreshes the modification time of its entry.
+    """
+    SUFFIX = '.pyramid'
+    METADATA_SUFFIX = '.json'
+
+    def __init__(self, cache_dir, max_size=None):
+        self.cache_dir = os.path.expanduser(os.fspath(cache_dir))
+        self.max_size = DEFAULT_CACHE_SIZE if max_size is None else max_size
+        os.makedirs(self.cache_dir, exist_ok=True)
+
+    def key(self, audio_path, parameters):
+        """
+        Returns the key of the features of the file at `audio_path` computed with `parameters`, a JSON-able dict.
+        """
+        digest = hashlib.sha256()
+        with open(audio_path, 'rb') as f:
+            for chunk in iter(lambda: f.read(1024 * 1024), b''):
+                digest.update(chunk)
+
+        return self._key(digest, parameters)
+
+    def content_key(self, content, parameters):
+        """
+        Returns the key of the features of `content`, a JSON-able value such as the fragments of a text.
+        """
+        digest = hashlib.sha256(json.dumps(content, sort_keys=True).encode())
+        return self._key(digest, parameters)
+
+    def get(self, key):
+        """
+        Returns the mapped pyramid of the entry or `None` on a miss. Unreadable entries are removed.
+        """
+        path = self._entry_path(key)
+        if not os.path.exists(path):
+            return None
+        try:
+            pyramid = Pyramid.open(path)
+        except FastDTWBDError:
+            self._remove_entry(path)
+            return None
+
+        try:
+            os.utime(path)
+        except OSError:
+            pass
+        return pyramid
+
+    def get_with_metadata(self, key):
+        """
+        Returns the mapped pyramid of the entry and its metadata or `None` on a miss.
+        """
+        try:
+            with open(self._entry_path(key)[:-len(self.SUFFIX)] + self.METADATA_SUFFIX) as f:
+                metadata = json.load(f)
+        except (OSError, ValueError):
+            return None
+
+        pyramid = self.get(key)
+        return None if pyramid is None else (pyramid, metadata)
+
+    def put(self, key, pyramid, metadata=None):
+        """
+        Stores the pyramid and the JSON-able metadata under the key
+        and evicts the least recently used entries above the size limit.
+        """
+        path = self._entry_path(key)
+        if metadata is not None:
+            # Written first, the pyramid file is what makes the entry visible
+            self._write(path[:-len(self.SUFFIX)] + self.METADATA_SUFFIX, lambda p: self._dump(metadata, p))
+        self._write(path, pyramid.save)
+
+        self.evict()
+
+    def evict(self):
+        """
+        Removes the least recently used entries until their total size fits the limit.
+        """
+        entries = []
+        for name in os.listdir(self.cache_dir):
+            if name.endswith(self.SUFFIX):
+                path = os.path.join(self.cache_dir, name)
+                try:
+                    st = os.stat(path)
+                except OSError:
+                    continue
+                entries.append((st.st_mtime, st.st_size + self._metadata_size(path), path))
+
+        total = sum(size for _, size, _ in entries)
+        for _, size, path in sorted(entries):
+            if total <= self.max_size:
+                break
+            # Mapped pyramids stay valid after their file is removed
+            self._remove_entry(path)
+            total -= size
+
+    def size(self):
+        """
+        Total size of the entries in bytes.
+        """
+        return sum(
+            os.path.getsize(os.path.join(self.cache_dir, name))
+            for name in os.listdir(self.cache_dir) if name.endswith((self.SUFFIX, self.METADATA_SUFFIX))
+        )
+
+    def _key(self, digest, parameters):
+        digest.update(json.dumps({'version': FEATURES_VERSION, **parameters}, sort_keys=True).encode())
+        return digest.hexdigest()
+
+    def _entry_path(self, key):
+        return os.path.join(self.cache_dir, key + self.SUFFIX)
+
+    def _metadata_size(self, path):
+        try:
+            return os.path.getsize(path[:-len(self.SUFFIX)] + self.METADATA_SUFFIX)
+        except OSError:
+            return 0
+
+    def _write(self, path, save):
+        fd, tmp_path = tempfile.mkstemp(dir=self.cache_dir, suffix='.tmp')
+        os.close(fd)
+        try:
+            save(tmp_path)
+            os.chmod(tmp_path, 0o644)
+            # Readers see either no file or a complete one
+            os.replace(tmp_path, path)
+        except BaseException:
+            self._remove(tmp_path)
+            raise
+
+    @staticmethod
+    def _dump(metadata, path):
+        with open(path, 'w') as f:
+            json.dump(metadata, f)
+
+    def _remove_entry(self, path):
+        self._remove(path)
+        self._remove(path[:-len(self.SUFFIX)] + self.METADATA_SUFFIX)
+
+    @staticmethod
+    def _remove(path):
+        try:
+            os.remove(path)
+        except FileNotFoundError:
+            pass
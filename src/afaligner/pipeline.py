@@ -0,0 +1,36 @@
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
+
+
+def prefetch(function, items, depth=1, executor=None):
+    """
+    Yields `function(item)` for the items in order, computing up to `depth` results ahead on a worker thread
+    while the caller uses the current one. With `depth=0` the results are computed lazily by the caller.
+    Given an `executor`, e.g. a pool of processes, the results ahead are submitted to it instead
+    and up to `depth` of them are computed at the same time.
+
+    Exceptions of `function` are raised when their result is reached.
+    Closing the generator cancels the results not started yet.
+    """
+    if depth <= 0:
+        yield from map(function, items)
+        return
+
+    if executor is None:
+        # The running result is waited for when the generator is closed
+        with ThreadPoolExecutor(max_workers=1) as executor:
+            yield from prefetch(function, items, depth, executor)
+        return
+
+    # Bounded queue of the results ahead, the next one is at the left
+    pending = deque()
+    try:
+        for item in items:
+            pending.append(executor.submit(function, item))
+            if len(pending) > depth:
+                yield pending.popleft().result()
+        while pending:
+            yield pending.popleft().result()
+    finally:
+        for future in pending:
+            future.cancel()
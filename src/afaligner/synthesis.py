@@ -0,0 +1,91 @@
+from concurrent.futures import ProcessPoolExecutor
+import multiprocessing
+import os.path
+
+import aeneas
+from aeneas.audiofilemfcc import AudioFileMFCC
+from aeneas.synthesizer import Synthesizer
+from aeneas.textfile import TextFile, TextFileFormat
+from aeneas.exacttiming import TimeValue
+import numpy as np
+
+# Parameters of the synthesized text features, part of the keys of the cache with the language
+SYNTHESIS_PARAMETERS = {
+    'synthesizer': 'aeneas.Synthesizer',
+    'aeneas_version': aeneas.__version__,
+    'extractor': 'aeneas.AudioFileMFCC',
+    'window_length': 0.100,
+    'window_shift': 0.040,
+    'drop_coefficients': [0],
+}
+
+# Synthesizer of a worker process of the pool, started once by the initializer
+_worker_synthesizer = None
+
+
+def read_text(text_path, language):
+    """
+    Parses the fragments of the text file.
+    """
+    parse_parameters = {'is_text_unparsed_id_regex': 'f[0-9]+'}
+    textfile = TextFile(text_path, file_format=TextFileFormat.UNPARSED, parameters=parse_parameters)
+    textfile.set_language(language)
+    return textfile
+
+
+def text_content(text_path, language):
+    """
+    Returns what the synthesis of the text file depends on: the identifiers and the text of its fragments.
+    """
+    return [[f.identifier, f.text] for f in read_text(text_path, language).fragments]
+
+
+def synthesize_text(text_path, tmp_dir, language, synthesizer):
+    """
+    Synthesizes the text file, returns its name, fragments, anchors' frames and its MFCC frames.
+    """
+    text_name = os.path.split(text_path)[1]
+    textfile = read_text(text_path, language)
+    text_wav_path = os.path.join(tmp_dir, f'{os.path.splitext(text_name)[0]}_text.wav')
+
+    # Produce synthesized audio, get anchors
+    anchors, _, _ = synthesizer.synthesize(textfile, text_wav_path)
+
+    # Get fragments, convert anchors timings to the frames indicies
+    fragments = [a[1] for a in anchors]
+    anchors = np.array([int(a[0] / TimeValue('0.040')) for a in anchors])
+
+    # MFCC frames sequence memory layout is a n x l 2D array,
+    # where n - number of frames and l - number of MFFCs
+    # i.e it is c-contiguous, but after dropping the first coefficient it siezes to be c-contiguous.
+    # Should decide whether to make a copy or to work around the first coefficient.
+    text_mfcc_sequence = np.ascontiguousarray(
+        AudioFileMFCC(text_wav_path).all_mfcc.T[:, 1:]
+    )
+    return text_name, fragments, anchors, text_mfcc_sequence
+
+
+def start_synthesizer_pool(workers, synthesizer_factory=Synthesizer):
+    """
+    Returns an executor of `workers` processes, each one creates a synthesizer once and keeps it
+    for all the texts it is given. Submit synthesize_in_worker() to it.
+
+    Processes rather than threads: eSpeak keeps global state, one synthesis runs per process at a time.
+    """
+    return ProcessPoolExecutor(
+        workers,
+        mp_context=multiprocessing.get_context('spawn'),
+        initializer=_start_worker_synthesizer, initargs=(synthesizer_factory,),
+    )
+
+
+def synthesize_in_worker(text_path, tmp_dir, language):
+    """
+    synthesize_text() with the synthesizer of the worker process.
+    """
+    return synthesize_text(text_path, tmp_dir, language, _worker_synthesizer)
+
+
+def _start_worker_synthesizer(synthesizer_factory):
+    global _worker_synthesizer
+    _worker_synthesizer = synthesizer_factory()
@@ -16,4 +16,17 @@ def complete_sync_map():
         os.path.join(RESOURCES_DIR, 'shakespeare/text_complete/'),
         os.path.join(RESOURCES_DIR, 'shakespeare/audio/'),
         times_as_timedelta=True
-    )
\ No newline at end of file
+    )
+
+
+@pytest.fixture(scope='session')
+def windowed_sync_map():
+    """
+    complete_sync_map aligned with tail_window.
+    """
+    return align(
+        os.path.join(RESOURCES_DIR, 'shakespeare/text_complete/'),
+        os.path.join(RESOURCES_DIR, 'shakespeare/audio/'),
+        times_as_timedelta=True,
+        tail_window=True,
+    )
@@ -0,0 +1,79 @@
+import numpy as np
+import pytest
+
+from afaligner import align_files, get_audio_window
+from afaligner.c_dtwbd_wrapper import Aligner, Pyramid
+
+RADIUS = 10
+
+
+def speech_frames(rng, n):
+    # Consecutive frames are correlated as MFCCs of speech are
+    frames = rng.normal(size=(n, 12))
+    for i in range(1, n):
+        frames[i] += 0.8 * frames[i - 1]
+    return frames
+
+
+def align_prepared(texts, audio, skip_penalty, tail_window=False):
+    """
+    align_files() of (name, anchors, frames) texts against one audio file or a list of them
+    """
+    prepared_texts = (
+        (name, [f'{name}_f{k}' for k in range(len(anchors))], np.array(anchors), Pyramid(frames, RADIUS))
+        for name, anchors, frames in texts
+    )
+    audios = audio if isinstance(audio, list) else [audio]
+    prepared_audios = iter([
+        (f'audio{k}.mp3', Pyramid(np.ascontiguousarray(frames), RADIUS)) for k, frames in enumerate(audios)
+    ])
+    return align_files(prepared_texts, prepared_audios, '', '', skip_penalty, RADIUS, False, Aligner(), tail_window)
+
+
+@pytest.mark.parametrize('seed, lead, lead_kind, skip_penalty', [
+    (0, 1500, 'silence', 3), (2, 800, 'silence', 3), (0, 1500, 'music', 5), (1, 2500, 'music', 5), (0, 300, 'music', 5),
+])
+def test_long_audio_lead_is_aligned_as_the_whole_tail(seed, lead, lead_kind, skip_penalty):
+    rng = np.random.default_rng(seed)
+    first, second = speech_frames(rng, 400), speech_frames(rng, 300)
+    lead_frames = 0.3 * rng.normal(size=(lead, 12)) if lead_kind == 'silence' else speech_frames(rng, lead)
+    audio = np.vstack([np.repeat(first, 2, axis=0), lead_frames, np.repeat(second, 2, axis=0)])
+    audio += rng.normal(scale=0.1, size=audio.shape)
+    texts = [('first.xhtml', [0, 200], first), ('second.xhtml', [0, 150], second)]
+
+    sync_map = align_prepared(texts, audio, skip_penalty, tail_window=True)
+    assert sync_map == align_prepared(texts, audio, skip_penalty)
+    assert len(sync_map['second.xhtml']) == 2
+
+
+def test_partial_alignment_does_not_shrink_the_next_windows():
+    rng = np.random.default_rng(0)
+    # Only the beginning of the first text is narrated, at a low rate
+    first, second = speech_frames(rng, 1000), speech_frames(rng, 300)
+    audio = np.vstack([first[:200:2], np.repeat(second, 2, axis=0)])
+    audio += rng.normal(scale=0.1, size=audio.shape)
+    texts = [('first.xhtml', [0], first), ('second.xhtml', [0, 150], second)]
+
+    sync_map = align_prepared(texts, audio, 3, tail_window=True)
+    assert sync_map == align_prepared(texts, audio, 3)
+    assert len(sync_map['second.xhtml']) == 2
+    # A wrong rate does not starve the window either
+    assert get_audio_window(300, 8000, 0.01, RADIUS) >= 1000
+
+
+@pytest.mark.parametrize('seed', [0, 1, 2])
+def test_tail_window_gives_same_sync_map_on_several_files(seed):
+    rng = np.random.default_rng(seed)
+    # Three texts narrated in three audio files with a short lead, the last text spans two files
+    frames = [speech_frames(rng, 400), speech_frames(rng, 250), speech_frames(rng, 600)]
+    texts = [(f'p00{k + 1}.xhtml', list(range(0, len(f), 50)), f) for k, f in enumerate(frames)]
+    audios = [
+        np.vstack([0.3 * rng.normal(size=(40, 12)), np.repeat(frames[0], 2, axis=0)]),
+        np.vstack([np.repeat(frames[1], 2, axis=0), np.repeat(frames[2][:300], 2, axis=0)]),
+        np.vstack([0.3 * rng.normal(size=(40, 12)), np.repeat(frames[2][300:], 2, axis=0)]),
+    ]
+    audios = [a + rng.normal(scale=0.1, size=a.shape) for a in audios]
+
+    sync_map = align_prepared(texts, audios, 3)
+    assert sync_map == align_prepared(texts, audios, 3, tail_window=True)
+    assert [len(sync_map[name]) for name, _, _ in texts] == [8, 5, 12]
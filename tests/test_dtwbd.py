@@ -1,7 +1,11 @@
 import pytest
 import numpy as np
 
-from afaligner.c_dtwbd_wrapper import c_FastDTWBD
+from afaligner.c_dtwbd_wrapper import (
+    c_FastDTWBD, c_FastDTWBD_f32, c_FastDTWBD_workspace_size, c_set_distance_kernel, c_get_distance_kernel,
+    c_set_log_level, c_get_log_level, c_set_log_file, c_get_log_file, c_flush_log,
+    Aligner, Pyramid, StreamingAligner, FastDTWBDError,
+)
 
 
 def test_perfect_match():
@@ -45,4 +49,413 @@ def test_perfect_match_in_the_middle():
 def test_allocate_large_matrix():
     s = np.arange(100000, dtype='float64').reshape(-1,1)
     t = np.arange(100000, dtype='float64').reshape(-1,1)
-    c_FastDTWBD(s, t, skip_penalty=0.5, radius=100)
\ No newline at end of file
+    c_FastDTWBD(s, t, skip_penalty=0.5, radius=100)
+
+
+def test_workspace_size_grows_linearly():
+    size = c_FastDTWBD_workspace_size(100000, 100000, 12, radius=100)
+    double_size = c_FastDTWBD_workspace_size(200000, 200000, 12, radius=100)
+    assert size > 0
+    assert double_size <= 2.1 * size
+
+
+@pytest.mark.parametrize('storage', ['rolling', 'linear'])
+@pytest.mark.parametrize('n, m, radius', [(500, 700, 5), (300, 40, 100), (400, 400, 500)])
+def test_storages_give_same_path(storage, n, m, radius):
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(n, 12))
+    t = np.repeat(s, 2, axis=0)[:m] + rng.normal(scale=0.1, size=(m, 12))
+    band_distance, band_path = c_FastDTWBD(s, t, skip_penalty=5, radius=radius, storage='band')
+    distance, path = c_FastDTWBD(s, t, skip_penalty=5, radius=radius, storage=storage)
+    assert distance == band_distance
+    np.testing.assert_equal(path, band_path)
+
+
+def test_rolling_storage_saves_memory():
+    band_size = c_FastDTWBD_workspace_size(100000, 100000, 12, radius=100, storage='band')
+    rolling_size = c_FastDTWBD_workspace_size(100000, 100000, 12, radius=100, storage='rolling')
+    assert rolling_size * 10 < band_size
+
+
+def test_linear_storage_memory_is_linear():
+    rolling_size = c_FastDTWBD_workspace_size(100, 1000000, 12, radius=100, storage='rolling')
+    linear_size = c_FastDTWBD_workspace_size(100, 1000000, 12, radius=100, storage='linear')
+    assert linear_size < 40 * (100 + 1000000)
+    assert linear_size < rolling_size
+
+
+@pytest.mark.parametrize('kernel', ['sse2', 'avx2', 'avx512', 'neon'])
+def test_distance_kernels_give_same_path(kernel):
+    default_kernel = c_get_distance_kernel()
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(300, 12))
+    t = np.repeat(s, 2, axis=0)[:500] + rng.normal(scale=0.1, size=(500, 12))
+    try:
+        c_set_distance_kernel('scalar')
+        scalar_distance, scalar_path = c_FastDTWBD(s, t, skip_penalty=5, radius=10)
+        try:
+            c_set_distance_kernel(kernel)
+        except ValueError:
+            pytest.skip(f'{kernel} is not supported by the CPU')
+        distance, path = c_FastDTWBD(s, t, skip_penalty=5, radius=10)
+    finally:
+        c_set_distance_kernel(default_kernel)
+    assert distance == pytest.approx(scalar_distance)
+    np.testing.assert_equal(path, scalar_path)
+
+
+@pytest.mark.parametrize('storage', ['rolling', 'band', 'linear'])
+def test_tile_distance_gives_same_path(storage):
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(500, 12))
+    t = np.repeat(s, 2, axis=0)[:700] + rng.normal(scale=0.1, size=(700, 12))
+    direct_distance, direct_path = c_FastDTWBD(s, t, skip_penalty=5, radius=100, storage=storage)
+    distance, path = c_FastDTWBD(s, t, skip_penalty=5, radius=100, storage=storage, distance='tile')
+    assert distance == pytest.approx(direct_distance)
+    np.testing.assert_equal(path, direct_path)
+
+
+@pytest.mark.parametrize('accumulator', ['float32', 'float64'])
+def test_float32_path_matches_within_a_frame(accumulator):
+    rng = np.random.default_rng(0)
+    s = 5 * rng.normal(size=(500, 12))
+    t = np.repeat(s, 4, axis=0)[::3] + rng.normal(size=(667, 12))
+    distance, path = c_FastDTWBD(s, t, skip_penalty=20, radius=10)
+    f32_distance, f32_path = c_FastDTWBD_f32(
+        s.astype('float32'), t.astype('float32'), skip_penalty=20, radius=10, accumulator=accumulator
+    )
+    assert f32_distance == pytest.approx(distance, rel=1e-4)
+    columns = {}
+    for i, j in path.astype(int):
+        columns.setdefault(i, []).append(j)
+    for i, j in f32_path.astype(int):
+        assert min(abs(j - k) for k in columns.get(i, [-2])) <= 1
+
+
+@pytest.mark.parametrize('storage', ['rolling', 'linear'])
+@pytest.mark.parametrize('n, m, radius', [(500, 700, 5), (300, 40, 100), (400, 400, 500)])
+def test_diagonal_order_gives_same_path(storage, n, m, radius):
+    default_kernel = c_get_distance_kernel()
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(n, 12))
+    t = np.repeat(s, 2, axis=0)[:m] + rng.normal(scale=0.1, size=(m, 12))
+    try:
+        c_set_distance_kernel('scalar')
+        rows_distance, rows_path = c_FastDTWBD(s, t, skip_penalty=5, radius=radius, storage=storage)
+        distance, path = c_FastDTWBD(s, t, skip_penalty=5, radius=radius, storage=storage, order='diagonals')
+    finally:
+        c_set_distance_kernel(default_kernel)
+    assert distance == rows_distance
+    np.testing.assert_equal(path, rows_path)
+
+
+@pytest.mark.parametrize('storage', ['rolling', 'linear'])
+@pytest.mark.parametrize('threads', [2, 5])
+def test_threads_give_same_path(storage, threads):
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(2000, 12))
+    t = np.repeat(s, 2, axis=0)[:3000] + rng.normal(scale=0.1, size=(3000, 12))
+    expected_distance, expected_path = c_FastDTWBD(s, t, skip_penalty=5, radius=50, storage=storage)
+    distance, path = c_FastDTWBD(s, t, skip_penalty=5, radius=50, storage=storage, threads=threads)
+    assert distance == expected_distance
+    np.testing.assert_equal(path, expected_path)
+
+
+def read_slowly(s, m, rng, noise=0.1):
+    """Returns m frames of audio reading the frames of s twice each, with Gaussian noise"""
+    return np.repeat(s, 2, axis=0)[:m] + rng.normal(scale=noise, size=(m, s.shape[1]))
+
+
+def align_with_options(s, t, options, **kwargs):
+    """Aligns s and t with and without options, checks that the paths are the same and returns both stats"""
+    expected_distance, expected_path, expected_stats = c_FastDTWBD(s, t, return_stats=True, **kwargs)
+    distance, path, stats = c_FastDTWBD(s, t, return_stats=True, **kwargs, **options)
+    assert distance == expected_distance
+    np.testing.assert_equal(path, expected_path)
+    assert stats['workspace_peak'] <= stats['workspace_size']
+    return stats, expected_stats
+
+
+@pytest.mark.parametrize('storage', ['rolling', 'linear'])
+@pytest.mark.parametrize('features, n, m, skip_penalty', [
+    ('normal', 1000, 1500, 1),
+    ('normal', 1000, 1500, 2),
+    ('normal', 1001, 1499, 0),
+    # Many ties and zero distances
+    ('integers', 1000, 1500, 1),
+    ('integers', 333, 501, 0),
+    ('integers', 333, 501, 2),
+])
+def test_pruning_gives_same_path(storage, features, n, m, skip_penalty):
+    rng = np.random.default_rng(0)
+    if features == 'integers':
+        s = rng.integers(0, 3, size=(n, 12)).astype('float64')
+        t = read_slowly(s, m, rng, noise=0)
+    else:
+        s = rng.normal(size=(n, 12))
+        t = read_slowly(s, m, rng)
+    stats, expected_stats = align_with_options(
+        s, t, {'prune': True}, skip_penalty=skip_penalty, radius=10, storage=storage
+    )
+    cells = [level['cells_evaluated'] for level in stats['levels']]
+    expected_cells = [level['cells_evaluated'] for level in expected_stats['levels']]
+    assert all(c <= e for c, e in zip(cells, expected_cells)) and sum(cells) < sum(expected_cells)
+
+
+def test_adaptive_window_gives_same_path_with_fewer_cells():
+    rng = np.random.default_rng(0)
+    # Consecutive frames are correlated as MFCCs of speech are, with a pause
+    s = rng.normal(size=(2000, 12))
+    for i in range(1, 2000):
+        s[i] += 0.8 * s[i - 1]
+    s[500:600] = rng.normal(scale=0.05, size=(1, 12))
+    t = read_slowly(s, 3000, rng)
+    stats, expected_stats = align_with_options(s, t, {'window': 'adaptive'}, skip_penalty=5, radius=50)
+    assert stats['levels'][0]['window_cells'] < expected_stats['levels'][0]['window_cells'] / 2
+
+    # The unbudgeted adaptive window has about 125 cells per row, a budget of 100 narrows it
+    _, _, budget_stats = c_FastDTWBD(
+        s, t, skip_penalty=5, radius=50, window='adaptive', window_budget=100, return_stats=True
+    )
+    assert budget_stats['levels'][0]['window_cells'] < stats['levels'][0]['window_cells']
+    assert budget_stats['levels'][0]['window_cells'] <= 100 * 2000
+    with pytest.raises(ValueError):
+        c_FastDTWBD(s, t, skip_penalty=5, radius=50, window='wide')
+    with pytest.raises(ValueError):
+        c_FastDTWBD(s, t, skip_penalty=5, radius=-1, window='adaptive')
+
+
+def test_log_level_and_file(tmp_path):
+    s = np.arange(10, dtype='float64').reshape(-1,1)
+    log_path = tmp_path / 'afaligner.log'
+    default_level = c_get_log_level()
+    default_file = c_get_log_file()
+    try:
+        c_set_log_file(str(log_path))
+        c_set_log_level('warn')
+        c_FastDTWBD(s, s, skip_penalty=100, radius=10)
+        c_flush_log()
+        assert not log_path.exists() or 'Starting DTWBD function' not in log_path.read_text()
+        c_set_log_level('info')
+        c_FastDTWBD(s, s, skip_penalty=100, radius=10)
+        c_flush_log()
+        assert '[INFO] Starting DTWBD function' in log_path.read_text()
+    finally:
+        c_set_log_level(default_level)
+        c_set_log_file(default_file)
+
+
+def test_idle_logger_is_woken_by_new_messages(tmp_path):
+    import time
+    s = np.arange(10, dtype='float64').reshape(-1,1)
+    log_path = tmp_path / 'afaligner.log'
+    count = lambda: log_path.read_text().count('Starting DTWBD function') if log_path.exists() else 0
+    default_level = c_get_log_level()
+    default_file = c_get_log_file()
+    try:
+        c_set_log_file(str(log_path))
+        c_set_log_level('info')
+        for _ in range(3):
+            # The drainer waits on the empty ring, the messages are written without c_flush_log()
+            time.sleep(0.05)
+            written = count()
+            c_FastDTWBD(s, s, skip_penalty=100, radius=10)
+            deadline = time.monotonic() + 5
+            while count() == written:
+                assert time.monotonic() < deadline
+                time.sleep(0.001)
+    finally:
+        c_set_log_level(default_level)
+        c_set_log_file(default_file)
+
+
+@pytest.mark.parametrize('storage', ['rolling', 'linear'])
+def test_stats_describe_every_level(storage):
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(1000, 12))
+    t = np.repeat(s, 2, axis=0)[:1500] + rng.normal(scale=0.1, size=(1500, 12))
+    expected_distance, expected_path = c_FastDTWBD(s, t, skip_penalty=5, radius=10, storage=storage)
+    distance, path, stats = c_FastDTWBD(s, t, skip_penalty=5, radius=10, storage=storage, return_stats=True)
+    assert distance == expected_distance
+    np.testing.assert_equal(path, expected_path)
+
+    levels = stats['levels']
+    assert [(level['n'], level['m']) for level in levels] == [(1000 >> k, 1500 >> k) for k in range(len(levels))]
+    assert min(levels[-1]['n'], levels[-1]['m']) < 2 * (10 + 1) + 1
+    for level in levels:
+        assert level['min_row_cells'] <= level['max_row_cells'] <= level['m']
+        assert level['window_cells'] <= level['n'] * level['max_row_cells']
+        assert level['cells_evaluated'] >= level['window_cells']
+        assert level['distance_evaluations'] == level['cells_evaluated']
+        assert 0 < level['bytes_allocated'] and level['peak_workspace'] <= stats['workspace_peak']
+    assert all(level['cells_evaluated'] == level['window_cells'] for level in levels[:-1])
+    assert stats['workspace_peak'] <= stats['workspace_size']
+    assert stats['seconds'] >= sum(level['seconds'] for level in levels)
+
+
+def test_alignments_run_in_python_threads():
+    from concurrent.futures import ThreadPoolExecutor
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(2000, 12))
+    t = np.repeat(s, 2, axis=0)[:3000] + rng.normal(scale=0.1, size=(3000, 12))
+    expected_distance, expected_path = c_FastDTWBD(s, t, skip_penalty=5, radius=10)
+    assert expected_path.shape == (len(expected_path), 2) and expected_path.flags.c_contiguous
+    with ThreadPoolExecutor(4) as executor:
+        results = list(executor.map(lambda _: c_FastDTWBD(s, t, skip_penalty=5, radius=10), range(4)))
+    for distance, path in results:
+        assert distance == expected_distance
+        np.testing.assert_equal(path, expected_path)
+
+    with pytest.raises(ValueError):
+        c_FastDTWBD(s, t[:, :6], skip_penalty=5, radius=10)
+    with pytest.raises(ValueError):
+        c_FastDTWBD(np.asfortranarray(s), t, skip_penalty=5, radius=10)
+    with pytest.raises(TypeError):
+        c_FastDTWBD(s.astype('int64'), t, skip_penalty=5, radius=10)
+    # The options of one entry point are never dropped by running the other
+    with pytest.raises(TypeError):
+        c_FastDTWBD(s.astype('float32'), t.astype('float32'), skip_penalty=5, radius=10, storage='band')
+    with pytest.raises(TypeError):
+        c_FastDTWBD_f32(s, t, skip_penalty=5, radius=10)
+
+
+def test_aligner_reuses_its_workspace():
+    from concurrent.futures import ThreadPoolExecutor
+    rng = np.random.default_rng(0)
+    pairs = []
+    for n in [2000, 500, 1000]:
+        s = rng.normal(size=(n, 12))
+        t = np.repeat(s, 2, axis=0)[:n * 3 // 2] + rng.normal(scale=0.1, size=(n * 3 // 2, 12))
+        pairs.append((s, t))
+    expected = [c_FastDTWBD(s, t, skip_penalty=5, radius=10, return_stats=True) for s, t in pairs]
+
+    aligner = Aligner()
+    assert aligner.workspace_size == 0
+    for (s, t), (expected_distance, expected_path, expected_stats) in zip(pairs, expected):
+        distance, path, stats = aligner.align(s, t, skip_penalty=5, radius=10, return_stats=True)
+        assert distance == expected_distance
+        np.testing.assert_equal(path, expected_path)
+        assert [level['cells_evaluated'] for level in stats['levels']] == \
+               [level['cells_evaluated'] for level in expected_stats['levels']]
+    # The workspace of the first and largest alignment is kept
+    assert aligner.workspace_size == c_FastDTWBD_workspace_size(2000, 3000, 12, radius=10)
+    assert stats['workspace_size'] == aligner.workspace_size
+
+    f32_distance, f32_path = Aligner().align(*(x.astype('float32') for x in pairs[1]), skip_penalty=5, radius=10)
+    np.testing.assert_equal(f32_path, c_FastDTWBD_f32(*(x.astype('float32') for x in pairs[1]), skip_penalty=5, radius=10)[1])
+
+    aligner.reset()
+    assert aligner.workspace_size == 0
+
+    aligners = [Aligner(log_level='error') for _ in range(3)]
+    with ThreadPoolExecutor(3) as executor:
+        results = list(executor.map(lambda k: aligners[k].align(*pairs[k], skip_penalty=5, radius=10), range(3)))
+    for (distance, path), (expected_distance, expected_path, _) in zip(results, expected):
+        assert distance == expected_distance
+        np.testing.assert_equal(path, expected_path)
+
+
+def test_busy_aligner_refuses_its_setters():
+    import threading
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(20000, 12))
+    t = np.repeat(s, 2, axis=0)[:30000] + rng.normal(scale=0.1, size=(30000, 12))
+    aligner = Aligner()
+    worker = threading.Thread(target=aligner.align, args=(s, t), kwargs={'skip_penalty': 5, 'radius': 100})
+    worker.start()
+    refused = False
+    while worker.is_alive() and not refused:
+        try:
+            aligner.set_log_level('error')
+        except RuntimeError:
+            refused = True
+    worker.join()
+    assert refused
+    aligner.set_log_level('error')
+
+
+def test_aligner_reuses_pyramids_for_tails():
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(2000, 12))
+    t = np.repeat(s, 2, axis=0)[:3000] + rng.normal(scale=0.1, size=(3000, 12))
+    s_pyramid, t_pyramid = Pyramid(s, radius=10), Pyramid(t, radius=10)
+    assert len(t_pyramid) == 3000 and t_pyramid.levels > 1 and t_pyramid.memory > 0
+
+    aligner = Aligner()
+    # Offsets aligned to the coarsest level give the levels of the slices
+    step = 2 ** (s_pyramid.levels - 1)
+    for s_offset, t_offset in [(0, 0), (step, 2 * step), (3 * step, 4 * step)]:
+        expected_distance, expected_path = aligner.align(s[s_offset:], t[t_offset:], skip_penalty=5, radius=10)
+        distance, path = aligner.align_pyramid(s_pyramid, t_pyramid, skip_penalty=5, radius=10,
+                                               s_offset=s_offset, t_offset=t_offset)
+        assert distance == expected_distance
+        np.testing.assert_equal(path, expected_path)
+
+    # Any part can be aligned, e.g. a window of the audio tail
+    distance, path = aligner.align_pyramid(s_pyramid, t_pyramid, skip_penalty=5, radius=10,
+                                           s_offset=1001, n=400, t_offset=2001, m=700)
+    np.testing.assert_equal(path[0], [0, 0])
+    assert path[:, 0].max() < 400 and path[:, 1].max() < 700
+    steps = np.diff(path, axis=0)
+    assert np.all((steps >= 0) & (steps <= 1)) and np.all(steps.sum(axis=1) > 0)
+
+    with pytest.raises(ValueError):
+        aligner.align_pyramid(s_pyramid, t_pyramid, skip_penalty=5, radius=10, s_offset=1900, n=200)
+
+def test_pyramid_files_are_mapped(tmp_path):
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(1000, 12))
+    t = np.repeat(s, 2, axis=0)[:1500] + rng.normal(scale=0.1, size=(1500, 12))
+    s_pyramid, t_pyramid = Pyramid(s, radius=10), Pyramid(t, radius=10)
+    t_pyramid.save(tmp_path / 'audio.pyramid')
+
+    mapped = Pyramid.open(tmp_path / 'audio.pyramid')
+    assert mapped.mapped and not t_pyramid.mapped
+    assert (len(mapped), mapped.levels, mapped.radius, mapped.memory) == \
+           (len(t_pyramid), t_pyramid.levels, t_pyramid.radius, t_pyramid.memory)
+    assert not mapped.frames.flags.writeable
+    np.testing.assert_equal(mapped.frames, t)
+
+    aligner = Aligner()
+    expected_distance, expected_path = aligner.align_pyramid(s_pyramid, t_pyramid, skip_penalty=5, radius=10,
+                                                             s_offset=300, t_offset=501)
+    distance, path = aligner.align_pyramid(s_pyramid, mapped, skip_penalty=5, radius=10, s_offset=300, t_offset=501)
+    assert distance == expected_distance
+    np.testing.assert_equal(path, expected_path)
+
+    with open(tmp_path / 'audio.pyramid', 'rb') as f:
+        data = f.read()
+    (tmp_path / 'truncated.pyramid').write_bytes(data[:len(data) // 2])
+    with pytest.raises(FastDTWBDError):
+        Pyramid.open(tmp_path / 'truncated.pyramid')
+
+def test_streaming_aligner_commits_the_path_incrementally():
+    rng = np.random.default_rng(0)
+    s = rng.normal(size=(300, 12))
+    t = np.vstack([
+        rng.normal(size=(40, 12)),
+        np.repeat(s, 2, axis=0)[:450] + rng.normal(scale=0.1, size=(450, 12)),
+        rng.normal(size=(30, 12)),
+    ])
+    expected_distance, expected_path = c_FastDTWBD(s, t, skip_penalty=5, radius=1000)
+
+    def stream(radius, window):
+        aligner = StreamingAligner(s, skip_penalty=5, radius=radius, window=window)
+        parts = [aligner.push(t[k:k + 10]) for k in range(0, len(t), 10)]
+        distance, rest = aligner.finish()
+        assert aligner.frames == len(t)
+        return distance, np.vstack(parts + [rest]), parts, aligner.memory
+
+    # Unbounded, the path is the one of DTWBD
+    distance, path, _, _ = stream(radius=300, window=600)
+    assert distance == expected_distance
+    np.testing.assert_equal(path, expected_path)
+
+    # Bounded, the path is committed as audio arrives and is still a valid path
+    distance, path, parts, memory = stream(radius=20, window=64)
+    assert sum(len(part) for part in parts[:-1]) > len(path) // 2
+    np.testing.assert_equal(path[0], [0, 0])
+    steps = np.diff(path, axis=0)
+    assert np.all((steps >= 0) & (steps <= 1)) and np.all(steps.sum(axis=1) > 0)
+    assert distance < 1.5 * expected_distance
+    assert memory == StreamingAligner(s, skip_penalty=5, radius=20, window=64).memory
@@ -0,0 +1,94 @@
+import os
+import time
+
+import numpy as np
+
+from afaligner.c_dtwbd_wrapper import Pyramid
+from afaligner.feature_cache import FeatureCache
+
+
+PARAMETERS = {'window_shift': 0.040}
+
+
+def test_feature_cache_is_content_addressed_and_lru(tmp_path):
+    rng = np.random.default_rng(0)
+    audio_paths = []
+    for k in range(3):
+        path = tmp_path / f'audio{k}.mp3'
+        path.write_bytes(rng.bytes(1000))
+        audio_paths.append(path)
+    (tmp_path / 'copy.mp3').write_bytes(audio_paths[0].read_bytes())
+
+    cache = FeatureCache(tmp_path / 'cache')
+    key = cache.key(audio_paths[0], PARAMETERS)
+    assert key == cache.key(tmp_path / 'copy.mp3', PARAMETERS)
+    assert key != cache.key(audio_paths[1], PARAMETERS)
+    assert key != cache.key(audio_paths[0], {'window_shift': 0.020})
+    assert cache.get(key) is None
+
+    frames = rng.normal(size=(500, 12))
+    cache.put(key, Pyramid(frames, radius=10))
+    cached = cache.get(key)
+    assert cached.mapped and cached.levels == Pyramid(frames, radius=10).levels
+    np.testing.assert_equal(cached.frames, frames)
+
+    # A limit of two entries keeps the most recently used ones
+    entry_size = cache.size()
+    cache = FeatureCache(tmp_path / 'cache', max_size=2 * entry_size)
+    keys = [cache.key(path, PARAMETERS) for path in audio_paths]
+    cache.put(keys[1], Pyramid(frames, radius=10))
+    # Entries are ordered by mtime, which get() sets to now
+    now = time.time()
+    for k, age in [(0, 200), (1, 100)]:
+        entry = tmp_path / 'cache' / (keys[k] + FeatureCache.SUFFIX)
+        os.utime(entry, (now - age, now - age))
+    assert cache.get(keys[0]) is not None
+    cache.put(keys[2], Pyramid(frames, radius=10))
+    assert cache.get(keys[1]) is None
+    assert cache.get(keys[0]) is not None and cache.get(keys[2]) is not None
+    assert cache.size() <= 2 * entry_size
+
+    # Corrupted entries are dropped
+    entry = tmp_path / 'cache' / (keys[2] + FeatureCache.SUFFIX)
+    entry.write_bytes(b'not a pyramid')
+    assert cache.get(keys[2]) is None and not os.path.exists(entry)
+
+
+def test_synthesized_texts_are_cached_with_anchors(tmp_path, monkeypatch):
+    import afaligner
+
+    contents = {'p001.xhtml': [['f001', 'Hello'], ['f002', 'world']], 'p002.xhtml': [['f001', 'Other']]}
+    monkeypatch.setattr(afaligner, 'text_content', lambda text_path, language: contents[os.path.basename(text_path)])
+
+    frames = np.random.default_rng(0).normal(size=(300, 12))
+    synthesized = []
+
+    def synthesize(text_path):
+        synthesized.append(text_path)
+        # Every synthesis gives other frames, so an overwritten entry is seen
+        return os.path.basename(text_path), ['f001', 'f002'], np.array([0, 120]), frames + (len(synthesized) - 1)
+
+    cache = FeatureCache(tmp_path / 'cache')
+    first = afaligner.prepare_text('text/p001.xhtml', synthesize, 10, 'eng', cache)
+    # Renamed texts with the same fragments hit the entry
+    second = afaligner.prepare_text('moved/p001.xhtml', synthesize, 10, 'eng', cache)
+    assert synthesized == ['text/p001.xhtml']
+    assert second[0] == 'p001.xhtml' and second[1] == first[1] == ['f001', 'f002']
+    np.testing.assert_equal(second[2], first[2])
+    assert second[3].mapped and not first[3].mapped
+    np.testing.assert_equal(second[3].frames, frames)
+
+    # Other fragments or another language are synthesized into entries of their own
+    afaligner.prepare_text('text/p002.xhtml', synthesize, 10, 'eng', cache)
+    afaligner.prepare_text('text/p001.xhtml', synthesize, 10, 'fra', cache)
+    assert len(synthesized) == 3
+    key = lambda name, language: cache.content_key(
+        contents[name], {**afaligner.SYNTHESIS_PARAMETERS, 'language': language}
+    )
+    keys = [key('p001.xhtml', 'eng'), key('p002.xhtml', 'eng'), key('p001.xhtml', 'fra')]
+    assert len(set(keys)) == 3
+    entries = [cache.get_with_metadata(k) for k in keys]
+    assert all(entry is not None for entry in entries)
+    for (pyramid, _), offset in zip(entries, [0, 1, 2]):
+        np.testing.assert_equal(pyramid.frames, frames + offset)
+    assert entries[0][1] == {'fragments': ['f001', 'f002'], 'anchors': [0, 120]}
@@ -0,0 +1,124 @@
+import os
+import sys
+
+import numpy as np
+import pytest
+
+from afaligner.audio import decode_audio_mfcc
+from afaligner.c_dtwbd_wrapper import c_compute_mfcc, MFCCStream
+
+
+def reference_mfcc(data, sample_rate=16000, filters_count=40, mfcc_size=13, fft_order=512,
+                   lower_frequency=133.3333, upper_frequency=6855.4976, emphasis_factor=0.970,
+                   window_length=0.100, window_shift=0.040):
+    """
+    NumPy transcription of aeneas.mfcc.MFCC.compute_from_data() with coefficient 0 dropped.
+    """
+    hz_to_mel = lambda f: 2595.0 * np.log10(1.0 + f / 700.0)
+    mel_to_hz = lambda m: 700.0 * (10 ** (m / 2595.0) - 1)
+
+    filters = np.zeros((1 + fft_order // 2, filters_count))
+    dfreq = sample_rate / fft_order
+    mel_min, mel_max = hz_to_mel(lower_frequency), hz_to_mel(upper_frequency)
+    dmelbw = (mel_max - mel_min) / (filters_count + 1)
+    edges = mel_to_hz(mel_min + dmelbw * np.arange(filters_count + 2, dtype='d'))
+    for f in range(filters_count):
+        left, center, right = (int(round(edges[f + k] / dfreq)) for k in range(3))
+        height = 2.0 / ((right - left) * dfreq)
+        left_slope = height / (center - left) if center != left else 0
+        right_slope = height / (center - right) if center != right else 0
+        for b in range(left + 1, right):
+            filters[b, f] = (b - left) * left_slope if b < center else \
+                            height if b == center else (b - right) * right_slope
+
+    dct = np.array([np.cos(np.pi * i / filters_count * np.arange(0.5, 0.5 + filters_count)) for i in range(mfcc_size)])
+    dct[:, 0] *= 0.5
+
+    data = np.append(data[0], data[1:] - emphasis_factor * data[:-1])
+    frame_length, frame_shift = int(round(window_length * sample_rate)), int(round(window_shift * sample_rate))
+    window = np.hamming(frame_length)
+    log_energies = np.zeros((len(data) // frame_shift, filters_count))
+    for i in range(len(log_energies)):
+        frame = np.zeros(frame_length)
+        segment = data[i * frame_shift:i * frame_shift + frame_length]
+        frame[:len(segment)] = segment
+        power = np.abs(np.fft.rfft(frame * window, fft_order)) ** 2
+        log_energies[i] = np.log(np.dot(power, filters).clip(0.00001, np.inf))
+
+    return (np.dot(log_energies, dct.T) / filters_count)[:, 1:]
+
+
+def test_mfcc_matches_aeneas():
+    rng = np.random.default_rng(0)
+    t = np.arange(16000 * 5 + 123) / 16000
+    samples = 0.3 * np.sin(2 * np.pi * 220 * t) * np.sin(2 * np.pi * 0.5 * t) + 0.05 * rng.normal(size=t.shape)
+
+    frames = c_compute_mfcc(samples, threads=3)
+    assert frames.shape == (len(samples) // 640, 12) and frames.flags.c_contiguous
+    np.testing.assert_allclose(frames, reference_mfcc(samples), rtol=0, atol=1e-9)
+    np.testing.assert_equal(c_compute_mfcc(samples, threads=1), frames)
+
+    pcm = (samples * 32767).astype('int16')
+    np.testing.assert_allclose(c_compute_mfcc(pcm), reference_mfcc(pcm / 32768.0), rtol=0, atol=1e-9)
+
+    assert c_compute_mfcc(np.zeros(100)).shape == (0, 12)
+    with pytest.raises(TypeError):
+        c_compute_mfcc(samples.astype('float32'))
+
+
+def test_mfcc_matches_aeneas_package():
+    mfcc = pytest.importorskip('aeneas.mfcc')
+    samples = np.random.default_rng(0).normal(scale=0.1, size=16000 * 3)
+
+    expected = mfcc.MFCC().compute_from_data(samples, 16000)[1:].T
+    frames = c_compute_mfcc(samples)
+    count = min(len(expected), len(frames))
+    assert abs(len(expected) - len(frames)) <= 1
+    np.testing.assert_allclose(frames[:count], expected[:count], rtol=0, atol=1e-6)
+
+
+def test_mfcc_stream_matches_whole_audio():
+    rng = np.random.default_rng(0)
+    pcm = (rng.normal(scale=3000, size=16000 * 3 + 17)).astype('int16')
+    expected = c_compute_mfcc(pcm)
+
+    for threads in (1, 3):
+        stream = MFCCStream(threads=threads)
+        blocks, start, memory = [], 0, 0
+        while start < len(pcm):
+            count = int(rng.integers(1, 5000))
+            blocks.append(stream.push(pcm[start:start + count]))
+            start += count
+            memory = max(memory, stream.memory)
+        blocks.append(stream.finish())
+
+        np.testing.assert_equal(np.concatenate(blocks), expected)
+        # Chunk and a window of pending samples, not the whole audio
+        assert memory <= 2 * (5000 + 1600) * 8 < pcm.size * 8
+
+    with pytest.raises(TypeError):
+        MFCCStream().push(pcm.astype('float64'))
+
+
+def test_decode_audio_mfcc_reads_ffmpeg_pipe(tmp_path, monkeypatch):
+    # Stands for ffmpeg: writes the raw PCM file given as input to stdout
+    ffmpeg = tmp_path / 'ffmpeg'
+    ffmpeg.write_text(
+        f'#!{sys.executable}\n'
+        'import sys\n'
+        'path = sys.argv[sys.argv.index("-i") + 1]\n'
+        'data = open(path, "rb").read() if path.endswith(".pcm") else sys.exit("no such file")\n'
+        'for i in range(0, len(data), 777):\n'
+        '    sys.stdout.buffer.write(data[i:i + 777]); sys.stdout.buffer.flush()\n'
+    )
+    ffmpeg.chmod(0o755)
+    monkeypatch.setenv('PATH', f'{tmp_path}{os.pathsep}{os.environ["PATH"]}')
+
+    pcm = np.random.default_rng(0).normal(scale=3000, size=16000 * 2 + 5).astype('<i2')
+    (tmp_path / 'audio.pcm').write_bytes(pcm.tobytes())
+
+    frames = decode_audio_mfcc(str(tmp_path / 'audio.pcm'), block_size=1001)
+    np.testing.assert_equal(frames, c_compute_mfcc(pcm.astype('int16')))
+
+    with pytest.raises(RuntimeError, match='no such file'):
+        decode_audio_mfcc(str(tmp_path / 'missing.mp3'))
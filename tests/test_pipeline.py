@@ -0,0 +1,69 @@
+import os
+import threading
+
+import pytest
+
+from afaligner import synthesis
+from afaligner.pipeline import prefetch
+
+
+def test_prefetch_computes_results_ahead_in_order():
+    started = []
+    lock = threading.Lock()
+
+    def work(x):
+        with lock:
+            started.append(x)
+        return x * x
+
+    for depth in (0, 1, 3):
+        started.clear()
+        results = prefetch(work, range(10), depth)
+        assert next(results) == 0
+        # The worker is at most `depth` items ahead of the caller
+        assert len(started) <= 1 + depth
+        assert list(results) == [x * x for x in range(1, 10)]
+        assert sorted(started) == list(range(10))
+
+
+def test_prefetch_raises_errors_in_order_and_stops_on_close():
+    def work(x):
+        if x == 2:
+            raise ValueError(x)
+        return x
+
+    results = prefetch(work, range(5), 2)
+    assert [next(results), next(results)] == [0, 1]
+    with pytest.raises(ValueError):
+        next(results)
+
+    started = []
+    results = prefetch(started.append, iter(range(100)), 1)
+    next(results)
+    results.close()
+    assert len(started) <= 2
+
+
+class CountingSynthesizer:
+    def __init__(self):
+        self.pid = os.getpid()
+        self.calls = 0
+
+
+def use_worker_synthesizer(x):
+    synthesizer = synthesis._worker_synthesizer
+    synthesizer.calls += 1
+    return x, synthesizer.pid, synthesizer.calls
+
+
+def test_synthesizer_pool_keeps_a_synthesizer_per_worker():
+    with synthesis.start_synthesizer_pool(2, CountingSynthesizer) as pool:
+        results = list(prefetch(use_worker_synthesizer, range(20), 4, pool))
+
+    assert [x for x, _, _ in results] == list(range(20))
+    # Every worker counts all the texts it synthesized with the same synthesizer
+    pids = {pid for _, pid, _ in results}
+    assert 1 <= len(pids) <= 2 and os.getpid() not in pids
+    for pid in pids:
+        calls = [c for _, p, c in results if p == pid]
+        assert sorted(calls) == list(range(1, len(calls) + 1))
@@ -15,3 +15,7 @@ def test_sync_map(complete_sync_map):
             assert 'end_time' in fragment_map
 
             assert fragment_map['begin_time'] < fragment_map['end_time']
+
+
+def test_tail_window_gives_same_sync_map(complete_sync_map, windowed_sync_map):
+    assert windowed_sync_map == complete_sync_map